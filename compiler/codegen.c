@@ -225,14 +225,70 @@ void gen_literal_cmp(int operand_index, int literal) {
   free_if_reg(operand_index);
 }
 
+// returns k if the operand is a literal equal to 2^k, otherwise -1
+int literal_power_of_two(int index) {
+  if (index < 0 || get_kind(index) != LIT) {
+    return -1;
+  }
+  unsigned long value = strtoul(get_name(index), NULL, 10);
+  if (value == 0 || (value & (value - 1)) != 0) {
+    return -1;
+  }
+  int k = 0;
+  while ((1UL << k) != value) {
+    k++;
+  }
+  return k;
+}
+
+// multiplication and division by 2^k become shifts, returns taken register
+int gen_shift_instruction(int operation, int operand_index, int k) {
+  int result_reg = take_reg();
+  int operand_reg = gen_load(operand_index);
+  char *rd = get_name(result_reg);
+  char *rs = get_name(operand_reg);
+  if (k == 0) {
+    code("\n\tmv\t%s, %s", rd, rs);
+  } else if (operation == MUL) {
+    code("\n\tslli\t%s, %s, %d", rd, rs, k);
+  } else if (get_type(operand_index) == UINT) {
+    code("\n\tsrli\t%s, %s, %d", rd, rs, k);
+  } else {
+    // negative dividends are biased by 2^k - 1 so the result is rounded towards zero like div
+    code("\n\tsrai\t%s, %s, 31", rd, rs);
+    code("\n\tsrli\t%s, %s, %d", rd, rd, 32 - k);
+    code("\n\tadd\t%s, %s, %s", rd, rs, rd);
+    code("\n\tsrai\t%s, %s, %d", rd, rd, k);
+  }
+  free_if_reg(operand_reg);
+  return result_reg;
+}
+
 int gen_arithmetic_instruction(int operation, int left_index, int right_index) {
+  if (operation == MUL || operation == DIV) {
+    int k = literal_power_of_two(right_index);
+    if (k >= 0) {
+      return gen_shift_instruction(operation, left_index, k);
+    }
+    k = literal_power_of_two(left_index);
+    if (operation == MUL && k >= 0) {
+      return gen_shift_instruction(operation, right_index, k);
+    }
+  }
   int result_reg = take_reg();
   int left_reg = gen_load(left_index);
   int right_reg = gen_load(right_index);
+  bool is_unsigned = get_type(left_index) == UINT;
   if (operation == ADD) {
     code("\n\tadd\t");
-  } else {
+  } else if (operation == SUB) {
     code("\n\tsub\t");
+  } else if (operation == MUL) {
+    code("\n\tmul\t");
+  } else if (operation == DIV) {
+    code(is_unsigned ? "\n\tdivu\t" : "\n\tdiv\t");
+  } else {
+    code(is_unsigned ? "\n\tremu\t" : "\n\trem\t");
   }
   gen_sym_name(result_reg);
   code(", ");
@@ -42,7 +42,7 @@ enum kinds { NO_KIND = 0x1, REG = 0x2, LIT = 0x4,
 enum logops { AND, OR };
 
 //konstante arithmetickih operatora
-enum arops { ADD, SUB, MUL, DIV, AROP_NUMBER };
+enum arops { ADD, SUB, MUL, DIV, MOD, AROP_NUMBER };
 
 //stringovi za generisanje aritmetickih naredbi
 static char *ar_instructions[] = { "ADDS", "SUBS", "MULS", "DIVS",
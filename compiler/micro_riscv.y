@@ -66,6 +66,7 @@
 %token _ASSIGN
 %token _SEMICOLON
 %token <i> _AROP
+%token <i> _MULOP
 %token <i> _RELOP
 
 %token _SELECT
@@ -93,7 +94,7 @@
 
 %token <i> _LOGOP
 
-%type <i> num_exp exp literal
+%type <i> num_exp term exp literal
 %type <i> function_call rel_exp if_part
 %type <i> post_increment argument_list argument arguments para_iter branch_var ternary_exp ternary_exp_op condition label_inc_lparen
 
@@ -330,8 +331,8 @@ assignment_statement
   ;
 
 num_exp
-  : exp
-  | num_exp _AROP exp
+  : term
+  | num_exp _AROP term
     {
       if(get_type($1) != get_type($3))
         err("invalid operands: arithmetic operation");
@@ -343,6 +344,20 @@ num_exp
     }
   ;
 
+term
+  : exp
+  | term _MULOP exp
+    {
+      if(get_type($1) != get_type($3))
+        err("invalid operands: arithmetic operation");
+      else {
+        int t1 = get_type($1);
+        $$ = gen_arithmetic_instruction($2, $1, $3);
+        set_type($$, t1);
+      }
+    }
+  ;
+
 exp
   : literal
   | _ID
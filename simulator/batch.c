@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "batch.h"
+#include "host_io.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+// reads non-empty lines which don't start with #, returns number of jobs
+int read_job_list(const char *list_path, s_batch_job **jobs) {
+    FILE *f = fopen(list_path, "r");
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    int count = 0, capacity = 0;
+    if (f == NULL) {
+        argerror("Can't open batch file %s", list_path);
+    }
+    *jobs = NULL;
+    while ((length = getline(&line, &size, f)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ')) {
+            line[--length] = 0;
+        }
+        if (length == 0 || line[0] == '#') continue;
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            *jobs = realloc(*jobs, capacity * sizeof(s_batch_job));
+            if (*jobs == NULL) {
+                simerror("batch: out of memory");
+            }
+        }
+        memset(&(*jobs)[count], 0, sizeof(s_batch_job));
+        (*jobs)[count].path = strdup(line);
+        count++;
+    }
+    free(line);
+    fclose(f);
+    return count;
+}
+
+// runs the program in its own context, errors end up in the job instead of exiting
+void run_job(s_batch_job *job) {
+    s_sim_context *ctx = create_context();
+    FILE *output = open_memstream(&job->output, &job->output_size);
+    jmp_buf jump;
+    if (output == NULL) {
+        simerror("batch: out of memory");
+    }
+    ctx->error_jump = &jump;
+    current_context = ctx;
+    // the workers run at the same time, the output is printed with the result of the job
+    host_io_capture(ctx, output);
+    if (setjmp(jump) == 0) {
+        load_program(ctx, job->path, FALSE);
+        if (ctx->error_count) {
+            sim_abort(PARSE_ERROR);
+        }
+        link_program(ctx);
+        job->result = run_simulator(ctx);
+        job->status = ctx->max_steps != 0 ? NO_ERROR : STEP_ERROR;
+    } else {
+        job->status = ctx->error_code;
+        strcpy(job->message, ctx->error_message);
+    }
+    current_context = NULL;
+    free_context(ctx);
+    fclose(output);
+}
+
+// prints what the program wrote to stdout, one line at a time after the path
+void print_job_output(s_batch_job *job) {
+    char *line = job->output, *end;
+    while (line != NULL && line < job->output + job->output_size) {
+        end = memchr(line, '\n', job->output + job->output_size - line);
+        if (end == NULL) {
+            end = job->output + job->output_size;
+        }
+        printf("%s\t>\t%.*s\n", job->path, (int) (end - line), line);
+        line = end + 1;
+    }
+}
+
+// takes the next job from the own queue, or steals one from the other workers, -1 if there are none left
+int next_job(s_batch_pool *pool, int index) {
+    int i, job = -1;
+    for (i = 0; i < pool->queue_count && job == -1; i++) {
+        s_batch_queue *queue = &pool->queues[(index + i) % pool->queue_count];
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail) {
+            job = i == 0 ? queue->jobs[--queue->tail] : queue->jobs[queue->head++];
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return job;
+}
+
+void *batch_worker(void *arg) {
+    s_batch_worker *worker = arg;
+    int job;
+    while ((job = next_job(worker->pool, worker->index)) != -1) {
+        run_job(&worker->pool->jobs[job]);
+    }
+    return NULL;
+}
+
+int run_batch(const char *list_path, int threads) {
+    s_batch_pool pool;
+    s_batch_worker *workers;
+    pthread_t *thread_ids;
+    int count, i, status = NO_ERROR;
+
+    count = read_job_list(list_path, &pool.jobs);
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+    pool.queue_count = threads;
+    pool.queues = calloc(threads, sizeof(s_batch_queue));
+    workers = calloc(threads, sizeof(s_batch_worker));
+    thread_ids = calloc(threads, sizeof(pthread_t));
+    if (pool.queues == NULL || workers == NULL || thread_ids == NULL) {
+        simerror("batch: out of memory");
+    }
+    // jobs are dealt round robin, workers which finish early steal the rest
+    for (i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].jobs = malloc((count / threads + 1) * sizeof(int));
+        if (pool.queues[i].jobs == NULL) {
+            simerror("batch: out of memory");
+        }
+    }
+    for (i = 0; i < count; i++) {
+        s_batch_queue *queue = &pool.queues[i % threads];
+        queue->jobs[queue->tail++] = i;
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].pool = &pool;
+        workers[i].index = i;
+        if (pthread_create(&thread_ids[i], NULL, batch_worker, &workers[i]) != 0) {
+            simerror("batch: can't create worker thread");
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(thread_ids[i], NULL);
+    }
+
+    for (i = 0; i < count; i++) {
+        s_batch_job *job = &pool.jobs[i];
+        if (job->status == NO_ERROR) {
+            printf("%s\t%d\t%d\n", job->path, job->status, job->result);
+        } else if (job->status == STEP_ERROR) {
+            printf("%s\t%d\tProgram terminated.\n", job->path, job->status);
+        } else {
+            printf("%s\t%d\t%s\n", job->path, job->status, job->message);
+        }
+        print_job_output(job);
+        if (job->status > status) status = job->status;
+        free(job->path);
+        free(job->output);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&pool.queues[i].lock);
+        free(pool.queues[i].jobs);
+    }
+    free(pool.jobs);
+    free(pool.queues);
+    free(workers);
+    free(thread_ids);
+    return status;
+}
@@ -0,0 +1,50 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <pthread.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*******************
+* Structures
+*******************/
+
+// one program from the list and the outcome of its run
+typedef struct _batch_job {
+    char *path;
+    int status;
+    word result;
+    char message[CHAR_BUFFER_LENGTH];
+    char *output;
+    size_t output_size;
+} s_batch_job;
+
+// jobs of one worker, the owner takes them from the back and idle workers steal from the front
+typedef struct _batch_queue {
+    pthread_mutex_t lock;
+    int *jobs;
+    int head;
+    int tail;
+} s_batch_queue;
+
+typedef struct _batch_pool {
+    s_batch_job *jobs;
+    s_batch_queue *queues;
+    int queue_count;
+} s_batch_pool;
+
+typedef struct _batch_worker {
+    s_batch_pool *pool;
+    int index;
+} s_batch_worker;
+
+/*******************
+* Functions
+*******************/
+
+// runs every program listed in the file on a pool of threads, prints one line per program
+// (path, exit code, exit value or error) in the list order, followed by the lines the program
+// wrote to stdout as path, > and the line, returns the highest exit code
+int run_batch(const char *list_path, int threads);
+
+#endif
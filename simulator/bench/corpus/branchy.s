@@ -0,0 +1,37 @@
+# Data-dependent branches: every iteration takes or skips short blocks on bits of a
+# linear congruential sequence, so the blocks are short and the branches unpredictable
+.data
+.text
+main:
+		li	s0, 2000000
+		li	s1, 12345
+		li	s2, 1103515245
+		li	a0, 0
+loop:
+		mul	s1, s1, s2
+		addi	s1, s1, 1013
+		srli	t0, s1, 16
+		slli	t1, t0, 31
+		blt	t1, zero, odd
+		addi	a0, a0, 3
+		j	second
+odd:
+		addi	a0, a0, -1
+second:
+		slli	t1, t0, 30
+		bge	t1, zero, third
+		add	a0, a0, t0
+third:
+		srli	t2, t0, 8
+		slli	t2, t2, 29
+		beq	t2, zero, next
+		bltu	t2, s2, small
+		sub	a0, a0, t2
+		j	next
+small:
+		srai	t2, t2, 3
+		add	a0, a0, t2
+next:
+		addi	s0, s0, -1
+		bne	s0, zero, loop
+		nop
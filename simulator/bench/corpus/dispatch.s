@@ -0,0 +1,136 @@
+# dispatch.mc compiled by compiler/micro_riscv (kept compiled, so that the workload does not change with the compiler)
+.data
+.text
+_start:
+	mv	fp, sp
+	jal main
+	nop
+main:
+	addi sp, sp, -84
+	sw	ra, 80(sp)
+	sw	fp, 76(sp)
+	sw	s1, 72(sp)
+	sw	s2, 68(sp)
+	sw	s3, 64(sp)
+	sw	s4, 60(sp)
+	sw	s5, 56(sp)
+	sw	s6, 52(sp)
+	sw	s7, 48(sp)
+	sw	s8, 44(sp)
+	sw	s9, 40(sp)
+	sw	s10, 36(sp)
+	sw	s11, 32(sp)
+	sw	a0, 28(sp)
+	sw	a1, 24(sp)
+	sw	a2, 20(sp)
+	sw	a3, 16(sp)
+	sw	a4, 12(sp)
+	sw	a5, 8(sp)
+	sw	a6, 4(sp)
+	sw	a7, 0(sp)
+	addi fp, sp, 84
+	addi sp, sp, -16
+.main_body:
+	li	s1, 12345
+	lw	s2, -88(fp)
+	mv  s2, s1
+	sw	s2, -88(fp)
+	li	s1, 0
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+	li	s1, 0
+	lw	s2, -100(fp)
+	mv  s2, s1
+	sw	s2, -100(fp)
+.while0:
+	lw	s1, -100(fp)
+	li	s2, 1000000
+	bge	s1, s2, .false0
+.true0:
+	lw	s2, -88(fp)
+	li	s3, 1103
+	mul	s1, s2, s3
+	li	s3, 12345
+	add	s2, s1, s3
+	li	s3, 65536
+	rem	s1, s2, s3
+	lw	s2, -88(fp)
+	mv  s2, s1
+	sw	s2, -88(fp)
+	lw	s2, -88(fp)
+	li	s3, 5
+	rem	s1, s2, s3
+	lw	s2, -92(fp)
+	mv  s2, s1
+	sw	s2, -92(fp)
+.branch0:
+	lw	s1, -92(fp)
+	li	s2, 0
+	beq	s1, s2, .branch0_first
+	li	s2, 1
+	beq	s1, s2, .branch0_second
+	li	s2, 2
+	beq	s1, s2, .branch0_third
+	j 	.branch0_otherwise
+.branch0_first:
+	lw	s2, -96(fp)
+	lw	s3, -88(fp)
+	add	s1, s2, s3
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+	j 	.branch0_exit
+.branch0_second:
+	lw	s2, -96(fp)
+	lw	s3, -92(fp)
+	sub	s1, s2, s3
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+	j 	.branch0_exit
+.branch0_third:
+	lw	s2, -96(fp)
+	li	s3, 3
+	mul	s1, s2, s3
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+	j 	.branch0_exit
+.branch0_otherwise:
+	lw	s2, -96(fp)
+	srai	s1, s2, 31
+	srli	s1, s1, 31
+	add	s1, s2, s1
+	srai	s1, s1, 1
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+.branch0_exit:
+	lw	s1, -100(fp)
+	addi s1, s1, 1
+	lw	s2, -100(fp)
+	mv  s2, s1
+	sw	s2, -100(fp)
+	j 	.while0
+.false0:
+	lw	s1, -96(fp)
+	mv  a0, s1
+	j 	.main_exit
+.main_exit:
+	addi sp, sp, 16
+	lw	ra, -4(fp)
+	lw	s1, -12(fp)
+	lw	s2, -16(fp)
+	lw	s3, -20(fp)
+	lw	s4, -24(fp)
+	lw	s5, -28(fp)
+	lw	s6, -32(fp)
+	lw	s7, -36(fp)
+	lw	s8, -40(fp)
+	lw	s9, -44(fp)
+	lw	s10, -48(fp)
+	lw	s11, -52(fp)
+	mv	sp, fp
+	lw	fp, -8(fp)
+	ret
\ No newline at end of file
@@ -0,0 +1,121 @@
+# fib.mc compiled by compiler/micro_riscv (kept compiled, so that the workload does not change with the compiler)
+.data
+.text
+_start:
+	mv	fp, sp
+	jal main
+	nop
+fib:
+	addi sp, sp, -84
+	sw	ra, 80(sp)
+	sw	fp, 76(sp)
+	sw	s1, 72(sp)
+	sw	s2, 68(sp)
+	sw	s3, 64(sp)
+	sw	s4, 60(sp)
+	sw	s5, 56(sp)
+	sw	s6, 52(sp)
+	sw	s7, 48(sp)
+	sw	s8, 44(sp)
+	sw	s9, 40(sp)
+	sw	s10, 36(sp)
+	sw	s11, 32(sp)
+	sw	a0, 28(sp)
+	sw	a1, 24(sp)
+	sw	a2, 20(sp)
+	sw	a3, 16(sp)
+	sw	a4, 12(sp)
+	sw	a5, 8(sp)
+	sw	a6, 4(sp)
+	sw	a7, 0(sp)
+	addi fp, sp, 84
+.fib_body:
+.if0:
+	lw	s1, -56(fp)
+	li	s2, 2
+	bge	s1, s2, .false0
+.true0:
+	lw	s1, -56(fp)
+	mv  a0, s1
+	j 	.fib_exit
+	j	.exit0
+.false0:
+.exit0:
+	lw	s2, -56(fp)
+	li	s3, 1
+	sub	s1, s2, s3
+	mv  a0, s1
+	jal	fib
+	mv  s1, a0
+	lw	s3, -56(fp)
+	li	s4, 2
+	sub	s2, s3, s4
+	mv  a0, s2
+	jal	fib
+	mv  s2, a0
+	add	s3, s1, s2
+	mv  a0, s3
+	j 	.fib_exit
+.fib_exit:
+	lw	ra, -4(fp)
+	lw	s1, -12(fp)
+	lw	s2, -16(fp)
+	lw	s3, -20(fp)
+	lw	s4, -24(fp)
+	lw	s5, -28(fp)
+	lw	s6, -32(fp)
+	lw	s7, -36(fp)
+	lw	s8, -40(fp)
+	lw	s9, -44(fp)
+	lw	s10, -48(fp)
+	lw	s11, -52(fp)
+	mv	sp, fp
+	lw	fp, -8(fp)
+	ret
+main:
+	addi sp, sp, -84
+	sw	ra, 80(sp)
+	sw	fp, 76(sp)
+	sw	s1, 72(sp)
+	sw	s2, 68(sp)
+	sw	s3, 64(sp)
+	sw	s4, 60(sp)
+	sw	s5, 56(sp)
+	sw	s6, 52(sp)
+	sw	s7, 48(sp)
+	sw	s8, 44(sp)
+	sw	s9, 40(sp)
+	sw	s10, 36(sp)
+	sw	s11, 32(sp)
+	sw	a0, 28(sp)
+	sw	a1, 24(sp)
+	sw	a2, 20(sp)
+	sw	a3, 16(sp)
+	sw	a4, 12(sp)
+	sw	a5, 8(sp)
+	sw	a6, 4(sp)
+	sw	a7, 0(sp)
+	addi fp, sp, 84
+.main_body:
+	li	s1, 27
+	mv  a0, s1
+	jal	fib
+	mv  s1, a0
+	mv  a0, s1
+	j 	.main_exit
+.main_exit:
+	lw	ra, -4(fp)
+	lw	s1, -12(fp)
+	lw	s2, -16(fp)
+	lw	s3, -20(fp)
+	lw	s4, -24(fp)
+	lw	s5, -28(fp)
+	lw	s6, -32(fp)
+	lw	s7, -36(fp)
+	lw	s8, -40(fp)
+	lw	s9, -44(fp)
+	lw	s10, -48(fp)
+	lw	s11, -52(fp)
+	mv	sp, fp
+	lw	fp, -8(fp)
+	ret
\ No newline at end of file
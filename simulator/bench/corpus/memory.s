@@ -0,0 +1,28 @@
+# Memory-bound loop: four passes over a 4 MiB array above the globals with a stride of a
+# page and a word, so consecutive accesses go to different pages and every word is visited
+.data
+first:
+		.word	0
+.text
+main:
+		li	s0, 4
+		li	s2, 4194304
+		li	s3, 4100
+		li	s4, 1048576
+		li	a0, 0
+		li	s1, 0
+pass:
+		mv	s5, s4
+walk:
+		add	t0, gp, s1
+		lw	t1, 0(t0)
+		add	t1, t1, s1
+		sw	t1, 0(t0)
+		add	a0, a0, t1
+		add	s1, s1, s3
+		remu	s1, s1, s2
+		addi	s5, s5, -1
+		bne	s5, zero, walk
+		addi	s0, s0, -1
+		bne	s0, zero, pass
+		nop
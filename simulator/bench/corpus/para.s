@@ -0,0 +1,129 @@
+# para.mc compiled by compiler/micro_riscv (kept compiled, so that the workload does not change with the compiler)
+.data
+.text
+_start:
+	mv	fp, sp
+	jal main
+	nop
+main:
+	addi sp, sp, -84
+	sw	ra, 80(sp)
+	sw	fp, 76(sp)
+	sw	s1, 72(sp)
+	sw	s2, 68(sp)
+	sw	s3, 64(sp)
+	sw	s4, 60(sp)
+	sw	s5, 56(sp)
+	sw	s6, 52(sp)
+	sw	s7, 48(sp)
+	sw	s8, 44(sp)
+	sw	s9, 40(sp)
+	sw	s10, 36(sp)
+	sw	s11, 32(sp)
+	sw	a0, 28(sp)
+	sw	a1, 24(sp)
+	sw	a2, 20(sp)
+	sw	a3, 16(sp)
+	sw	a4, 12(sp)
+	sw	a5, 8(sp)
+	sw	a6, 4(sp)
+	sw	a7, 0(sp)
+	addi fp, sp, 84
+	addi sp, sp, -4
+.main_body:
+	li	s1, 0
+	lw	s2, -88(fp)
+	mv  s2, s1
+	sw	s2, -88(fp)
+.para0_init:
+	addi sp, sp, -4
+	li	s1, 0
+	lw	s2, -92(fp)
+	mv  s2, s1
+	sw	s2, -92(fp)
+.para0_check:
+	lw	s1, -92(fp)
+	li	s2, 99
+	bgt	s1, s2, .para0_exit
+.para0_body:
+.para1_init:
+	addi sp, sp, -4
+	li	s1, 0
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+.para1_check:
+	lw	s1, -96(fp)
+	li	s2, 99
+	bgt	s1, s2, .para1_exit
+.para1_body:
+.para2_init:
+	addi sp, sp, -4
+	li	s1, 0
+	lw	s2, -100(fp)
+	mv  s2, s1
+	sw	s2, -100(fp)
+.para2_check:
+	lw	s1, -100(fp)
+	li	s2, 99
+	bgt	s1, s2, .para2_exit
+.para2_body:
+	lw	s2, -92(fp)
+	lw	s3, -96(fp)
+	mul	s1, s2, s3
+	lw	s3, -100(fp)
+	add	s2, s1, s3
+	li	s3, 7
+	rem	s1, s2, s3
+	lw	s3, -88(fp)
+	add	s2, s3, s1
+	lw	s1, -88(fp)
+	mv  s1, s2
+	sw	s1, -88(fp)
+.para2_step:
+	lw	s1, -100(fp)
+	addi s1, s1, 1
+	lw	s2, -100(fp)
+	mv  s2, s1
+	sw	s2, -100(fp)
+	j 	.para2_check
+.para2_exit:
+	addi sp, sp, 4
+.para1_step:
+	lw	s1, -96(fp)
+	addi s1, s1, 1
+	lw	s2, -96(fp)
+	mv  s2, s1
+	sw	s2, -96(fp)
+	j 	.para1_check
+.para1_exit:
+	addi sp, sp, 4
+.para0_step:
+	lw	s1, -92(fp)
+	addi s1, s1, 1
+	lw	s2, -92(fp)
+	mv  s2, s1
+	sw	s2, -92(fp)
+	j 	.para0_check
+.para0_exit:
+	addi sp, sp, 4
+	lw	s1, -88(fp)
+	mv  a0, s1
+	j 	.main_exit
+.main_exit:
+	addi sp, sp, 16
+	lw	ra, -4(fp)
+	lw	s1, -12(fp)
+	lw	s2, -16(fp)
+	lw	s3, -20(fp)
+	lw	s4, -24(fp)
+	lw	s5, -28(fp)
+	lw	s6, -32(fp)
+	lw	s7, -36(fp)
+	lw	s8, -40(fp)
+	lw	s9, -44(fp)
+	lw	s10, -48(fp)
+	lw	s11, -52(fp)
+	mv	sp, fp
+	lw	fp, -8(fp)
+	ret
\ No newline at end of file
@@ -0,0 +1,260 @@
+# Straight-line ALU code: a loop around a long basic block without memory accesses
+.data
+.text
+main:
+		li	s0, 100000
+		li	s1, 1
+		li	s2, 2
+		li	s3, 3
+		li	s4, 4
+		li	s5, 5
+		li	s6, 6
+		li	s7, 7
+		li	s8, 8
+loop:
+		add	s1, s4, s6
+		addi	s2, s5, 2
+		sub	s3, s6, s8
+		slli	s4, s7, 4
+		mul	s5, s8, s2
+		srli	s6, s1, 6
+		add	s7, s2, s4
+		addi	s8, s3, 8
+		sub	s1, s4, s6
+		slli	s2, s5, 5
+		mul	s3, s6, s8
+		srli	s4, s7, 5
+		add	s5, s8, s2
+		addi	s6, s1, 14
+		sub	s7, s2, s4
+		slli	s8, s3, 1
+		mul	s1, s4, s6
+		srli	s2, s5, 4
+		add	s3, s6, s8
+		addi	s4, s7, 20
+		sub	s5, s8, s2
+		slli	s6, s1, 2
+		mul	s7, s2, s4
+		srli	s8, s3, 3
+		add	s1, s4, s6
+		addi	s2, s5, 26
+		sub	s3, s6, s8
+		slli	s4, s7, 3
+		mul	s5, s8, s2
+		srli	s6, s1, 2
+		add	s7, s2, s4
+		addi	s8, s3, 32
+		sub	s1, s4, s6
+		slli	s2, s5, 4
+		mul	s3, s6, s8
+		srli	s4, s7, 1
+		add	s5, s8, s2
+		addi	s6, s1, 38
+		sub	s7, s2, s4
+		slli	s8, s3, 5
+		mul	s1, s4, s6
+		srli	s2, s5, 7
+		add	s3, s6, s8
+		addi	s4, s7, 44
+		sub	s5, s8, s2
+		slli	s6, s1, 1
+		mul	s7, s2, s4
+		srli	s8, s3, 6
+		add	s1, s4, s6
+		addi	s2, s5, 50
+		sub	s3, s6, s8
+		slli	s4, s7, 2
+		mul	s5, s8, s2
+		srli	s6, s1, 5
+		add	s7, s2, s4
+		addi	s8, s3, 56
+		sub	s1, s4, s6
+		slli	s2, s5, 3
+		mul	s3, s6, s8
+		srli	s4, s7, 4
+		add	s5, s8, s2
+		addi	s6, s1, 62
+		sub	s7, s2, s4
+		slli	s8, s3, 4
+		mul	s1, s4, s6
+		srli	s2, s5, 3
+		add	s3, s6, s8
+		addi	s4, s7, 68
+		sub	s5, s8, s2
+		slli	s6, s1, 5
+		mul	s7, s2, s4
+		srli	s8, s3, 2
+		add	s1, s4, s6
+		addi	s2, s5, 74
+		sub	s3, s6, s8
+		slli	s4, s7, 1
+		mul	s5, s8, s2
+		srli	s6, s1, 1
+		add	s7, s2, s4
+		addi	s8, s3, 80
+		sub	s1, s4, s6
+		slli	s2, s5, 2
+		mul	s3, s6, s8
+		srli	s4, s7, 7
+		add	s5, s8, s2
+		addi	s6, s1, 86
+		sub	s7, s2, s4
+		slli	s8, s3, 3
+		mul	s1, s4, s6
+		srli	s2, s5, 6
+		add	s3, s6, s8
+		addi	s4, s7, 92
+		sub	s5, s8, s2
+		slli	s6, s1, 4
+		mul	s7, s2, s4
+		srli	s8, s3, 5
+		add	s1, s4, s6
+		addi	s2, s5, 98
+		sub	s3, s6, s8
+		slli	s4, s7, 5
+		mul	s5, s8, s2
+		srli	s6, s1, 4
+		add	s7, s2, s4
+		addi	s8, s3, 4
+		sub	s1, s4, s6
+		slli	s2, s5, 1
+		mul	s3, s6, s8
+		srli	s4, s7, 3
+		add	s5, s8, s2
+		addi	s6, s1, 10
+		sub	s7, s2, s4
+		slli	s8, s3, 2
+		mul	s1, s4, s6
+		srli	s2, s5, 2
+		add	s3, s6, s8
+		addi	s4, s7, 16
+		sub	s5, s8, s2
+		slli	s6, s1, 3
+		mul	s7, s2, s4
+		srli	s8, s3, 1
+		add	s1, s4, s6
+		addi	s2, s5, 22
+		sub	s3, s6, s8
+		slli	s4, s7, 4
+		mul	s5, s8, s2
+		srli	s6, s1, 7
+		add	s7, s2, s4
+		addi	s8, s3, 28
+		sub	s1, s4, s6
+		slli	s2, s5, 5
+		mul	s3, s6, s8
+		srli	s4, s7, 6
+		add	s5, s8, s2
+		addi	s6, s1, 34
+		sub	s7, s2, s4
+		slli	s8, s3, 1
+		mul	s1, s4, s6
+		srli	s2, s5, 5
+		add	s3, s6, s8
+		addi	s4, s7, 40
+		sub	s5, s8, s2
+		slli	s6, s1, 2
+		mul	s7, s2, s4
+		srli	s8, s3, 4
+		add	s1, s4, s6
+		addi	s2, s5, 46
+		sub	s3, s6, s8
+		slli	s4, s7, 3
+		mul	s5, s8, s2
+		srli	s6, s1, 3
+		add	s7, s2, s4
+		addi	s8, s3, 52
+		sub	s1, s4, s6
+		slli	s2, s5, 4
+		mul	s3, s6, s8
+		srli	s4, s7, 2
+		add	s5, s8, s2
+		addi	s6, s1, 58
+		sub	s7, s2, s4
+		slli	s8, s3, 5
+		mul	s1, s4, s6
+		srli	s2, s5, 1
+		add	s3, s6, s8
+		addi	s4, s7, 64
+		sub	s5, s8, s2
+		slli	s6, s1, 1
+		mul	s7, s2, s4
+		srli	s8, s3, 7
+		add	s1, s4, s6
+		addi	s2, s5, 70
+		sub	s3, s6, s8
+		slli	s4, s7, 2
+		mul	s5, s8, s2
+		srli	s6, s1, 6
+		add	s7, s2, s4
+		addi	s8, s3, 76
+		sub	s1, s4, s6
+		slli	s2, s5, 3
+		mul	s3, s6, s8
+		srli	s4, s7, 5
+		add	s5, s8, s2
+		addi	s6, s1, 82
+		sub	s7, s2, s4
+		slli	s8, s3, 4
+		mul	s1, s4, s6
+		srli	s2, s5, 4
+		add	s3, s6, s8
+		addi	s4, s7, 88
+		sub	s5, s8, s2
+		slli	s6, s1, 5
+		mul	s7, s2, s4
+		srli	s8, s3, 3
+		add	s1, s4, s6
+		addi	s2, s5, 94
+		sub	s3, s6, s8
+		slli	s4, s7, 1
+		mul	s5, s8, s2
+		srli	s6, s1, 2
+		add	s7, s2, s4
+		addi	s8, s3, 100
+		sub	s1, s4, s6
+		slli	s2, s5, 2
+		mul	s3, s6, s8
+		srli	s4, s7, 1
+		add	s5, s8, s2
+		addi	s6, s1, 6
+		sub	s7, s2, s4
+		slli	s8, s3, 3
+		mul	s1, s4, s6
+		srli	s2, s5, 7
+		add	s3, s6, s8
+		addi	s4, s7, 12
+		sub	s5, s8, s2
+		slli	s6, s1, 4
+		mul	s7, s2, s4
+		srli	s8, s3, 6
+		add	s1, s4, s6
+		addi	s2, s5, 18
+		sub	s3, s6, s8
+		slli	s4, s7, 5
+		mul	s5, s8, s2
+		srli	s6, s1, 5
+		add	s7, s2, s4
+		addi	s8, s3, 24
+		sub	s1, s4, s6
+		slli	s2, s5, 1
+		mul	s3, s6, s8
+		srli	s4, s7, 4
+		add	s5, s8, s2
+		addi	s6, s1, 30
+		sub	s7, s2, s4
+		slli	s8, s3, 2
+		mul	s1, s4, s6
+		srli	s2, s5, 3
+		add	s3, s6, s8
+		addi	s4, s7, 36
+		sub	s5, s8, s2
+		slli	s6, s1, 3
+		mul	s7, s2, s4
+		srli	s8, s3, 2
+		addi	s0, s0, -1
+		bne	s0, zero, loop
+		add	a0, s1, s2
+		add	a0, a0, s3
+		add	a0, a0, s4
+		nop
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Load time of synthetic programs with the label pattern of compiled if statements
+# (.trueN, .falseN, .exitN). Time per label should stay flat as the program grows.
+# The load time is the shortest "Load time" of --stats over RUNS runs, so the execution of
+# the program isn't measured. When the time per label of the largest program exceeds the
+# one of the smallest by more than TOLERANCE percent, loading isn't linear (exit code 1).
+# Usage: bench/load_labels.sh [-n runs] [-t tolerance] [simulator] [number of if statements ...]
+
+RUNS=5
+TOLERANCE=50
+while getopts "n:t:" opt; do
+    case $opt in
+        n) RUNS=$OPTARG ;;
+        t) TOLERANCE=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+SIMULATOR=${1:-./riscvsim}
+shift
+SIZES=${@:-10000 20000 40000 80000}
+INPUT=$(mktemp /tmp/riscvsim-labels.XXXXXX)
+STATS=$(mktemp /tmp/riscvsim-stats.XXXXXX)
+trap 'rm -f $INPUT $STATS' EXIT
+
+printf "%10s %14s %10s %14s\n" "Labels" "Instructions" "Seconds" "us per label"
+first=""
+for n in $SIZES; do
+    awk -v n=$n 'BEGIN {
+        print ".data\ncount:\n\t.word 0\n.text\nmain:\n\t\tli\ta0, 0";
+        for (i = 0; i < n; i++) {
+            printf "\t\tli\tt0, %d\n\t\tblt\tzero, t0, .true%d\n", i % 2, i;
+            printf ".false%d:\n\t\taddi\ta0, a0, 1\n\t\tj\t.exit%d\n", i, i;
+            printf ".true%d:\n\t\taddi\ta0, a0, 2\n.exit%d:\n", i, i;
+        }
+        print "\t\tnop";
+    }' > $INPUT
+    best=""
+    for ((run = 0; run < RUNS; run++)); do
+        $SIMULATOR -r --stats $INPUT > /dev/null 2> $STATS || exit 1
+        seconds=$(awk -F: '$1 == "Load time" { split($2, v, " "); print v[1] }' $STATS)
+        best=$(awk -v a="$best" -v b="$seconds" 'BEGIN { print (a == "" || b < a) ? b : a }')
+    done
+    per_label=$(awk -v n=$n -v s=$best 'BEGIN { printf "%.3f", s * 1e6 / (3*n) }')
+    printf "%10d %14d %10.6f %14s\n" $((3*n)) $((5*n + 2)) $best $per_label
+    first=${first:-$per_label}
+    last=$per_label
+done
+
+if awk -v a=$first -v b=$last -v t=$TOLERANCE 'BEGIN { exit !(b > a * (1 + t / 100)) }'; then
+    echo "Time per label grew from $first us to $last us (more than $TOLERANCE%)"
+    exit 1
+fi
@@ -0,0 +1,112 @@
+#!/bin/bash
+# Throughput of the simulator on the workloads in bench/corpus: compiled Micro-C programs
+# (recursion, nested para loops, a branch dispatcher) and synthetic straight-line, branchy
+# and memory-bound assembly. Every workload is run with every engine RUNS times, the best
+# MIPS (the run least disturbed by the rest of the machine), the shortest load time and the
+# largest peak RSS reported by --stats are written as JSON and compared with the baseline,
+# where a drop of more than TOLERANCE percent of MIPS is a regression (exit code 1). The
+# baseline depends on the machine, so it isn't kept in the repository: without one there is
+# nothing to compare with until -u (make bench-baseline) records it. The best of the runs still
+# varies between invocations, so the tolerance is well above that noise; a busy machine needs
+# a larger one (-t).
+# Usage: bench/run.sh [-n runs] [-e "engines"] [-b baseline] [-t tolerance] [-o output] [-u] [simulator]
+#        -u saves the results as the new baseline
+
+DIR=$(dirname "$0")
+RUNS=5
+ENGINES="interpreter threaded jit"
+BASELINE=$DIR/baseline.json
+TOLERANCE=20
+OUTPUT=/dev/stdout
+UPDATE=0
+while getopts "n:e:b:t:o:u" opt; do
+    case $opt in
+        n) RUNS=$OPTARG ;;
+        e) ENGINES=$OPTARG ;;
+        b) BASELINE=$OPTARG ;;
+        t) TOLERANCE=$OPTARG ;;
+        o) OUTPUT=$OPTARG ;;
+        u) UPDATE=1 ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+SIMULATOR=${1:-./riscvsim}
+RESULTS=$(mktemp /tmp/riscvsim-bench.XXXXXX)
+STATS=$(mktemp /tmp/riscvsim-stats.XXXXXX)
+JSON=$(mktemp /tmp/riscvsim-json.XXXXXX)
+trap 'rm -f $RESULTS $STATS $JSON' EXIT
+
+# value of a line of the --stats report
+stat() {
+    awk -F: -v name="$1" '$1 == name { split($2, v, " "); print v[1] }' $STATS
+}
+
+printf "%-10s %-12s %14s %10s %10s %10s\n" "Workload" "Engine" "Instructions" "MIPS" "Load ms" "RSS KiB" >&2
+for program in $DIR/corpus/*.s; do
+    workload=$(basename $program .s)
+    for engine in $ENGINES; do
+        case $engine in
+            interpreter) flag= ;;
+            threaded) flag=-t ;;
+            jit) flag=-j ;;
+            *) echo "Unknown engine $engine" >&2; exit 2 ;;
+        esac
+        mips=0 load= rss=0
+        for ((run = 0; run < RUNS; run++)); do
+            result=$($SIMULATOR -r $flag --stats $program 2> $STATS) || { echo "$workload failed with $engine" >&2; exit 2; }
+            m=$(stat Throughput)
+            l=$(stat "Load time")
+            r=$(stat "Peak RSS")
+            if awk -v a=$m -v b=$mips 'BEGIN { exit !(a > b) }'; then
+                mips=$m
+            fi
+            if [ -z "$load" ] || awk -v a=$l -v b=$load 'BEGIN { exit !(a < b) }'; then
+                load=$l
+            fi
+            if [ $r -gt $rss ]; then
+                rss=$r
+            fi
+        done
+        instructions=$(stat Instructions)
+        printf "%-10s %-12s %14d %10.2f %10.3f %10d\n" $workload $engine $instructions $mips $(awk -v l=$load 'BEGIN { print l * 1000 }') $rss >&2
+        printf '    {"workload": "%s", "engine": "%s", "instructions": %d, "result": %d, "mips": %.2f, "load_seconds": %s, "peak_rss_kib": %d}\n' \
+            $workload $engine $instructions $result $mips $load $rss >> $RESULTS
+    done
+done
+
+{
+    printf '{\n  "runs": %d,\n  "results": [\n' $RUNS
+    sed '$!s/$/,/' $RESULTS
+    printf '  ]\n}\n'
+} > $JSON
+cat $JSON > $OUTPUT
+
+if [ $UPDATE -eq 1 ]; then
+    cp $JSON $BASELINE
+    echo "Baseline saved to $BASELINE" >&2
+    exit 0
+fi
+[ -f $BASELINE ] || { echo "No baseline $BASELINE, comparison skipped (record one with -u or make bench-baseline)" >&2; exit 0; }
+
+# every result is on a line of its own, in the baseline as well
+awk -v tolerance=$TOLERANCE '
+    function field(line, name,    v) {
+        if (!match(line, "\"" name "\": \"?[^,\"}]*")) return "";
+        v = substr(line, RSTART, RLENGTH);
+        sub(/.*: "?/, "", v);
+        return v;
+    }
+    /"workload"/ {
+        key = field($0, "workload") " " field($0, "engine");
+        if (FILENAME == ARGV[1]) { base[key] = field($0, "mips"); count[key] = field($0, "instructions"); next; }
+        if (!(key in base)) { printf "%-24s new\n", key; next; }
+        change = 100 * (field($0, "mips") - base[key]) / base[key];
+        status = change < -tolerance ? "REGRESSION" : (change > tolerance ? "faster" : "ok");
+        if (count[key] != field($0, "instructions")) status = status " (instruction count changed)";
+        printf "%-24s %10.2f -> %10.2f MIPS %+7.1f%%  %s\n", key, base[key], field($0, "mips"), change, status;
+        if (change < -tolerance) regressions++;
+    }
+    END {
+        if (regressions) { printf "%d regression(s) of more than %s%%\n", regressions, tolerance; exit 1; }
+    }' $BASELINE $RESULTS >&2
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cache.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+int is_power_of_two(uword value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+// size in bytes with an optional k suffix, 0 if it is not valid
+uword parse_cache_size(const char *s) {
+    char *end;
+    uword value = strtoul(s, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        value *= 1024;
+        end++;
+    }
+    return *s == 0 || *s == '-' || *end != 0 ? 0 : value;
+}
+
+// returns index of the name in the list, or -1
+int find_name(const char *s, char **names, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(s, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+s_cache *cache_create(s_sim_context *ctx, const char *name, const char *config) {
+    s_cache *cache = calloc(1, sizeof(s_cache));
+    char *fields = strdup(config);
+    char *field;
+    int i;
+    if (cache == NULL || fields == NULL) {
+        simerror("cache_create: out of memory");
+    }
+    cache->name = name;
+    cache->line_size = CACHE_DEFAULT_LINE;
+    cache->ways = CACHE_DEFAULT_WAYS;
+    field = strtok(fields, ":");
+    for (i = 0; field != NULL; i++, field = strtok(NULL, ":")) {
+        switch (i) {
+            case 0: cache->size = parse_cache_size(field); break;
+            case 1: cache->line_size = parse_cache_size(field); break;
+            case 2: cache->ways = parse_cache_size(field); break;
+            case 3: cache->replacement = find_name(field, replacement_names, REPLACE_NUMBER); break;
+            case 4: cache->write_policy = find_name(field, write_names, WRITE_NUMBER); break;
+            default: argerror("Too many fields in %s cache configuration %s", name, config);
+        }
+    }
+    free(fields);
+    if (!is_power_of_two(cache->size) || !is_power_of_two(cache->line_size) || !is_power_of_two(cache->ways)
+            || cache->line_size < 4 || cache->size < cache->line_size * cache->ways
+            || cache->replacement < 0 || cache->write_policy < 0) {
+        argerror("Invalid %s cache configuration %s (expected size[:line[:ways[:lru|fifo|random[:wb|wt]]]], powers of two)", name, config);
+    }
+    cache->sets = cache->size / (cache->line_size * cache->ways);
+    cache->random_state = 2463534242u;
+    cache->lines = calloc(cache->sets * cache->ways, sizeof(s_cache_line));
+    cache->pc_accesses = calloc(ctx->program_image.text_length + 1, sizeof(uquad));
+    cache->pc_misses = calloc(ctx->program_image.text_length + 1, sizeof(uquad));
+    if (cache->lines == NULL || cache->pc_accesses == NULL || cache->pc_misses == NULL) {
+        simerror("cache_create: out of memory");
+    }
+    return cache;
+}
+
+int segment_of(uword address) {
+    if (address < STATIC_DATA_START) return SEGMENT_TEXT;
+    if (address < STACK_SEGMENT_BOTTOM) return SEGMENT_DATA;
+    return SEGMENT_STACK;
+}
+
+// returns the line which is replaced on a miss in the set
+s_cache_line *victim_line(s_cache *cache, s_cache_line *set) {
+    s_cache_line *victim = &set[0];
+    uword i;
+    for (i = 0; i < cache->ways; i++) {
+        if (!set[i].valid) return &set[i];
+    }
+    if (cache->replacement == REPLACE_RANDOM) {
+        // xorshift, so that runs are repeatable
+        cache->random_state ^= cache->random_state << 13;
+        cache->random_state ^= cache->random_state >> 17;
+        cache->random_state ^= cache->random_state << 5;
+        return &set[cache->random_state % cache->ways];
+    }
+    for (i = 1; i < cache->ways; i++) {
+        if (set[i].stamp < victim->stamp) victim = &set[i];
+    }
+    return victim;
+}
+
+void cache_access(s_cache *cache, uword address, int write, int pc) {
+    uword block = address / cache->line_size;
+    uword tag = block / cache->sets;
+    s_cache_line *set = &cache->lines[(block % cache->sets) * cache->ways];
+    s_cache_line *line;
+    uword i;
+    cache->clock++;
+    cache->accesses[segment_of(address)]++;
+    cache->pc_accesses[pc]++;
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].valid && set[i].tag == tag) {
+            if (cache->replacement == REPLACE_LRU) set[i].stamp = cache->clock;
+            if (write && cache->write_policy == WRITE_BACK) set[i].dirty = TRUE;
+            if (write && cache->write_policy == WRITE_THROUGH) cache->writebacks++;
+            return;
+        }
+    }
+    cache->misses[segment_of(address)]++;
+    cache->pc_misses[pc]++;
+    if (write && cache->write_policy == WRITE_THROUGH) {
+        cache->writebacks++;
+        return;
+    }
+    line = victim_line(cache, set);
+    if (line->valid && line->dirty) cache->writebacks++;
+    line->tag = tag;
+    line->valid = TRUE;
+    line->dirty = write;
+    line->stamp = cache->clock;
+}
+
+void cache_step(s_sim_context *ctx) {
+    int pc = ctx->processor.pc;
+    const s_instruction *ins;
+    const s_operand *base;
+    // invalid pc and registers are reported by step()
+    if (pc < 0 || pc >= ctx->program_image.text_length) {
+        return;
+    }
+    ins = &ctx->program_image.text[pc];
+    if (ctx->icache != NULL) {
+        cache_access(ctx->icache, TEXT_SEGMENT_START + 4*pc, FALSE, pc);
+    }
+    if (ctx->dcache != NULL && (ins->instruction_type == INS_LW || ins->instruction_type == INS_SW)) {
+        base = ins->instruction_type == INS_LW ? &ins->source1 : &ins->destination;
+        if (base->register_index < RV32I_REG_NUM) {
+            cache_access(ctx->dcache, (uword) ctx->processor.regs[base->register_index] + base->data,
+                         ins->instruction_type == INS_SW, pc);
+        }
+    } else if (ctx->dcache != NULL && is_atomic(ins->instruction_type) && ins->source1.register_index < RV32I_REG_NUM) {
+        cache_access(ctx->dcache, ctx->processor.regs[ins->source1.register_index], ins->instruction_type != INS_LR, pc);
+    }
+}
+
+double miss_rate(uquad misses, uquad accesses) {
+    return accesses > 0 ? 100.0 * misses / accesses : 0.0;
+}
+
+// sort order of the source lines, the most misses first
+uquad *sort_misses;
+
+int compare_misses(const void *a, const void *b) {
+    int i = *(const int *) a, j = *(const int *) b;
+    if (sort_misses[i] != sort_misses[j]) {
+        return sort_misses[i] < sort_misses[j] ? 1 : -1;
+    }
+    return i - j;
+}
+
+void print_cache(s_sim_context *ctx, s_cache *cache, FILE *out) {
+    static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+    int length = ctx->program_image.text_length;
+    int *order = calloc(length + 1, sizeof(int));
+    const char **lines = calloc(length + 1, sizeof(char *));
+    const char **labels = calloc(length + 1, sizeof(char *));
+    char line_buffer[CHAR_BUFFER_LENGTH], label_buffer[CHAR_BUFFER_LENGTH];
+    uquad accesses = 0, misses = 0;
+    int i, missed = 0;
+    if (order == NULL || lines == NULL || labels == NULL) {
+        simerror("print_cache: out of memory");
+    }
+    fprintf(out, "\n### L1 %s cache: %u B, %u B lines, %u-way, %s, %s ###\n", cache->name, cache->size, cache->line_size,
+            cache->ways, replacement_names[cache->replacement], write_names[cache->write_policy]);
+    fprintf(out, "%-8s %14s %14s %10s\n", "Segment", "Accesses", "Misses", "Miss rate");
+    for (i = 0; i < SEGMENT_NUMBER; i++) {
+        accesses += cache->accesses[i];
+        misses += cache->misses[i];
+        if (cache->accesses[i] == 0) continue;
+        fprintf(out, "%-8s %14llu %14llu %9.2f%%\n", segment_names[i], (unsigned long long) cache->accesses[i],
+                (unsigned long long) cache->misses[i], miss_rate(cache->misses[i], cache->accesses[i]));
+    }
+    fprintf(out, "%-8s %14llu %14llu %9.2f%%\n", "total", (unsigned long long) accesses, (unsigned long long) misses,
+            miss_rate(misses, accesses));
+    fprintf(out, "%s: %llu\n", cache->write_policy == WRITE_BACK ? "Write-backs" : "Write-throughs",
+            (unsigned long long) cache->writebacks);
+
+    for (i = 0; i < length; i++) {
+        if (cache->pc_misses[i] != 0) order[missed++] = i;
+    }
+    pthread_mutex_lock(&sort_mutex);
+    sort_misses = cache->pc_misses;
+    qsort(order, missed, sizeof(int), compare_misses);
+    pthread_mutex_unlock(&sort_mutex);
+    source_lines(ctx, lines, labels);
+    if (missed > 0) {
+        fprintf(out, "%14s %14s %10s %12s  %-14s %s\n", "Misses", "Accesses", "Miss rate", "Addr", "Label", "Instruction");
+    }
+    for (i = 0; i < missed && i < CACHE_REPORT_LINES; i++) {
+        int pc = order[i];
+        fprintf(out, "%14llu %14llu %9.2f%% [%#10x]  %-14s %s\n", (unsigned long long) cache->pc_misses[pc],
+                (unsigned long long) cache->pc_accesses[pc], miss_rate(cache->pc_misses[pc], cache->pc_accesses[pc]),
+                TEXT_SEGMENT_START + 4*pc, labels[pc] ? source_text(labels[pc], label_buffer) : "-",
+                lines[pc] ? source_text(lines[pc], line_buffer) : ins_names[ctx->program_image.text[pc].instruction_type]);
+    }
+    free(order);
+    free(lines);
+    free(labels);
+}
+
+void cache_free(s_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    free(cache->lines);
+    free(cache->pc_accesses);
+    free(cache->pc_misses);
+    free(cache);
+}
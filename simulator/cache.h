@@ -0,0 +1,76 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Set associative L1 cache model, it only counts hits and misses and doesn't hold any data.
+Instruction fetches go to the instruction cache, lw and sw to the data cache.
+Configuration is given as size[:line[:ways[:lru|fifo|random[:wb|wt]]]], sizes are in bytes
+and can have a k suffix. wb is write-back with write allocate, wt is write-through without it.
+*/
+
+#define CACHE_DEFAULT_LINE       32
+#define CACHE_DEFAULT_WAYS       1
+// number of source lines with the most misses shown for each cache
+#define CACHE_REPORT_LINES       20
+// data above this address is counted as stack
+#define STACK_SEGMENT_BOTTOM     (0x80000000)
+
+enum replacement_types { REPLACE_LRU = 0, REPLACE_FIFO, REPLACE_RANDOM, REPLACE_NUMBER };
+static char *replacement_names[] = { "lru", "fifo", "random" };
+
+enum write_types { WRITE_BACK = 0, WRITE_THROUGH, WRITE_NUMBER };
+static char *write_names[] = { "wb", "wt" };
+
+enum segment_types { SEGMENT_TEXT = 0, SEGMENT_DATA, SEGMENT_STACK, SEGMENT_NUMBER };
+static char *segment_names[] = { "text", "data", "stack" };
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _cache_line {
+    uword tag;
+    uquad stamp;            // time of the last use (lru) or of the fill (fifo)
+    uchar valid;
+    uchar dirty;
+} s_cache_line;
+
+typedef struct _cache {
+    const char *name;
+    uword size;
+    uword line_size;
+    uword ways;
+    uword sets;
+    int replacement;
+    int write_policy;
+    s_cache_line *lines;    // ways lines of set i start at lines[i * ways]
+    uquad clock;
+    uword random_state;
+    uquad accesses[SEGMENT_NUMBER];
+    uquad misses[SEGMENT_NUMBER];
+    uquad writebacks;       // dirty lines written back (wb) or stores written through (wt)
+    uquad *pc_accesses;     // per text index of the accessing instruction
+    uquad *pc_misses;
+} s_cache;
+
+/*******************
+* Functions
+*******************/
+
+// creates the cache described by the configuration string for the linked program
+s_cache *cache_create(s_sim_context *ctx, const char *name, const char *config);
+
+// feeds the fetch and the memory access of the instruction at pc to the caches (called before step())
+void cache_step(s_sim_context *ctx);
+
+// prints hit and miss rates per segment and the source lines with the most misses
+void print_cache(s_sim_context *ctx, s_cache *cache, FILE *out);
+
+// releases the cache
+void cache_free(s_cache *cache);
+
+#endif
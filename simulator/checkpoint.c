@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+#include "defs.h"
+
+void write_checked(FILE *f, const void *data, size_t size) {
+    if (fwrite(data, 1, size, f) != size) {
+        simerror("checkpoint: write failed");
+    }
+}
+
+void read_checked(FILE *f, void *data, size_t size) {
+    if (fread(data, 1, size, f) != size) {
+        simerror("checkpoint: file is truncated");
+    }
+}
+
+void write_string(FILE *f, const char *s) {
+    int length = strlen(s);
+    write_checked(f, &length, sizeof(length));
+    write_checked(f, s, length);
+}
+
+char *read_string(FILE *f) {
+    int length;
+    char *s;
+    read_checked(f, &length, sizeof(length));
+    if (length < 0 || (s = malloc(length + 1)) == NULL) {
+        simerror("checkpoint: invalid string");
+    }
+    read_checked(f, s, length);
+    s[length] = 0;
+    return s;
+}
+
+// reads a count and checks that it is not negative
+int read_count(FILE *f) {
+    int count;
+    read_checked(f, &count, sizeof(count));
+    if (count < 0) {
+        simerror("checkpoint: invalid length %d", count);
+    }
+    return count;
+}
+
+// fields are written one by one, so that the file doesn't depend on struct padding
+void write_operand(FILE *f, const s_operand *op) {
+    write_checked(f, &op->operand_type, sizeof(op->operand_type));
+    write_checked(f, &op->register_index, sizeof(op->register_index));
+    write_checked(f, &op->data, sizeof(op->data));
+}
+
+void read_operand(FILE *f, s_operand *op) {
+    read_checked(f, &op->operand_type, sizeof(op->operand_type));
+    read_checked(f, &op->register_index, sizeof(op->register_index));
+    read_checked(f, &op->data, sizeof(op->data));
+}
+
+void save_checkpoint(s_sim_context *ctx, const char *path) {
+    FILE *f = fopen(path, "wb");
+    int i, j, count;
+    uword page_count = 0;
+    if (f == NULL) {
+        simerror("checkpoint: can't create %s", path);
+    }
+    write_checked(f, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LENGTH);
+    write_checked(f, &ctx->step_count, sizeof(ctx->step_count));
+    write_checked(f, &ctx->processor.pc, sizeof(ctx->processor.pc));
+    write_checked(f, ctx->processor.regs, sizeof(ctx->processor.regs));
+    write_checked(f, &ctx->processor.done, sizeof(ctx->processor.done));
+    write_checked(f, &ctx->reserved, sizeof(ctx->reserved));
+    write_checked(f, &ctx->reservation_address, sizeof(ctx->reservation_address));
+    write_checked(f, &ctx->reservation_value, sizeof(ctx->reservation_value));
+
+    write_checked(f, &ctx->text_index, sizeof(ctx->text_index));
+    for (i = 0; i < ctx->text_index; i++) {
+        write_checked(f, &ctx->section_text[i].instruction_type, sizeof(ctx->section_text[i].instruction_type));
+        write_checked(f, &ctx->section_text[i].sign_type, sizeof(ctx->section_text[i].sign_type));
+        write_operand(f, &ctx->section_text[i].destination);
+        write_operand(f, &ctx->section_text[i].source1);
+        write_operand(f, &ctx->section_text[i].source2);
+    }
+    write_checked(f, &ctx->source_index, sizeof(ctx->source_index));
+    for (i = 0; i < ctx->source_index; i++) {
+        write_checked(f, &ctx->source[i].address, sizeof(ctx->source[i].address));
+        write_checked(f, &ctx->source[i].line, sizeof(ctx->source[i].line));
+        write_string(f, ctx->source[i].text);
+    }
+    write_checked(f, &ctx->data_index, sizeof(ctx->data_index));
+    write_checked(f, &ctx->global_index, sizeof(ctx->global_index));
+    for (i = 0; i < ctx->global_index; i++) {
+        write_checked(f, &ctx->globals[i].offset, sizeof(ctx->globals[i].offset));
+        write_string(f, ctx->globals[i].name);
+    }
+    // labels only used as operands are already resolved in the text
+    count = 0;
+    for (i = 0; i < ctx->symtab_index; i++) {
+        if (ctx->symbol_table[i].defined && ctx->symbol_table[i].offset >= 0) count++;
+    }
+    write_checked(f, &count, sizeof(count));
+    for (i = 0; i < ctx->symtab_index; i++) {
+        if (ctx->symbol_table[i].defined && ctx->symbol_table[i].offset >= 0) {
+            write_checked(f, &ctx->symbol_table[i].offset, sizeof(ctx->symbol_table[i].offset));
+            write_string(f, ctx->symbol_table[i].name);
+        }
+    }
+
+    for (i = 0; i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; ctx->memory.directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            if (ctx->memory.directory[i][j] != NULL) page_count++;
+        }
+    }
+    write_checked(f, &page_count, sizeof(page_count));
+    for (i = 0; i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; ctx->memory.directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            if (ctx->memory.directory[i][j] != NULL) {
+                uword base = (uword) i << (PAGE_SHIFT + PAGE_TABLE_BITS) | (uword) j << PAGE_SHIFT;
+                write_checked(f, &base, sizeof(base));
+                write_checked(f, ctx->memory.directory[i][j], PAGE_SIZE);
+            }
+        }
+    }
+    if (fclose(f) != 0) {
+        simerror("checkpoint: write failed");
+    }
+}
+
+void load_checkpoint(s_sim_context *ctx, const char *path) {
+    FILE *f = fopen(path, "rb");
+    char magic[CHECKPOINT_MAGIC_LENGTH];
+    uword page_count, base;
+    int i, count;
+    if (f == NULL) {
+        argerror("Can't open checkpoint file %s", path);
+    }
+    read_checked(f, magic, CHECKPOINT_MAGIC_LENGTH);
+    if (memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LENGTH) != 0) {
+        simerror("checkpoint: %s is not a checkpoint file", path);
+    }
+    read_checked(f, &ctx->step_count, sizeof(ctx->step_count));
+    read_checked(f, &ctx->processor.pc, sizeof(ctx->processor.pc));
+    read_checked(f, ctx->processor.regs, sizeof(ctx->processor.regs));
+    read_checked(f, &ctx->processor.done, sizeof(ctx->processor.done));
+    read_checked(f, &ctx->reserved, sizeof(ctx->reserved));
+    read_checked(f, &ctx->reservation_address, sizeof(ctx->reservation_address));
+    read_checked(f, &ctx->reservation_value, sizeof(ctx->reservation_value));
+
+    count = read_count(f);
+    reserve_text(ctx, count);
+    ctx->text_index = count;
+    for (i = 0; i < ctx->text_index; i++) {
+        read_checked(f, &ctx->section_text[i].instruction_type, sizeof(ctx->section_text[i].instruction_type));
+        read_checked(f, &ctx->section_text[i].sign_type, sizeof(ctx->section_text[i].sign_type));
+        read_operand(f, &ctx->section_text[i].destination);
+        read_operand(f, &ctx->section_text[i].source1);
+        read_operand(f, &ctx->section_text[i].source2);
+        if (ctx->section_text[i].instruction_type >= INS_NUMBER) {
+            simerror("checkpoint: invalid instruction");
+        }
+    }
+    count = read_count(f);
+    reserve_source(ctx, count);
+    ctx->source_index = count;
+    for (i = 0; i < ctx->source_index; i++) {
+        read_checked(f, &ctx->source[i].address, sizeof(ctx->source[i].address));
+        read_checked(f, &ctx->source[i].line, sizeof(ctx->source[i].line));
+        ctx->source[i].text = read_string(f);
+    }
+    read_checked(f, &ctx->data_index, sizeof(ctx->data_index));
+    count = read_count(f);
+    reserve_globals(ctx, count);
+    ctx->global_index = count;
+    for (i = 0; i < ctx->global_index; i++) {
+        read_checked(f, &ctx->globals[i].offset, sizeof(ctx->globals[i].offset));
+        ctx->globals[i].name = read_string(f);
+        add_symbol(&ctx->global_hash, ctx->globals, i + 1, i);
+    }
+    count = read_count(f);
+    for (i = 0; i < count; i++) {
+        word offset;
+        char *name;
+        read_checked(f, &offset, sizeof(offset));
+        name = read_string(f);
+        if (offset < 0 || offset >= ctx->text_index || find_symbol(&ctx->label_hash, ctx->symbol_table, name) >= 0) {
+            simerror("checkpoint: invalid label %s", name);
+        }
+        insert_label_unchecked(ctx, name, TRUE);
+        ctx->symbol_table[ctx->symtab_index - 1].offset = offset;
+        free(name);
+    }
+
+    read_checked(f, &page_count, sizeof(page_count));
+    while (page_count-- > 0) {
+        read_checked(f, &base, sizeof(base));
+        if (base & PAGE_OFFSET_MASK) {
+            simerror("checkpoint: invalid page address %#x", base);
+        }
+        read_checked(f, memory_page(&ctx->memory, base), PAGE_SIZE);
+    }
+    fclose(f);
+}
+
+void checkpoint_if_due(s_sim_context *ctx) {
+    if (ctx->checkpoint_path != NULL && ctx->step_count == ctx->checkpoint_at) {
+        save_checkpoint(ctx, ctx->checkpoint_path);
+        ctx->checkpoint_path = NULL;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Checkpoint file layout (host byte order, tied to the simulator build):
+    magic, step counter, processor (pc, registers, done flag), reservation of lr.w
+    program text (linked instructions), source lines and globals for the interactive mode
+    defined labels as | text index | name |, for --break and --flamegraph
+    every allocated guest memory page as | base address | PAGE_SIZE bytes |
+*/
+
+#define CHECKPOINT_MAGIC         "RVSIMCK4"
+#define CHECKPOINT_MAGIC_LENGTH  8
+
+/*******************
+* Functions
+*******************/
+
+// writes the complete simulator state to the file
+void save_checkpoint(s_sim_context *ctx, const char *path);
+
+// replaces parsing: restores program, processor and memory from the file
+void load_checkpoint(s_sim_context *ctx, const char *path);
+
+// saves the checkpoint requested with --checkpoint-at if step_count has reached it
+void checkpoint_if_due(s_sim_context *ctx);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cosim.h"
+#include "checkpoint.h"
+#include "debugger.h"
+#include "host_io.h"
+#include "memory.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+#define REG_A1                   11
+
+extern int use_threaded_engine;
+extern int use_jit;
+
+const char *engine_name() {
+    if (use_jit) return "JIT";
+    if (use_threaded_engine) return "threaded engine";
+    return "block interpreter";
+}
+
+void cosim_init(s_sim_context *ctx, const char *path, const char *restore_path, uquad interval) {
+    s_cosim *cosim = calloc(1, sizeof(s_cosim));
+    if (cosim == NULL) {
+        simerror("cosim_init: out of memory");
+    }
+    cosim->reference = create_context();
+    if (restore_path != NULL) {
+        load_checkpoint(cosim->reference, restore_path);
+    } else {
+        load_program(cosim->reference, path, FALSE);
+    }
+    link_program(cosim->reference);
+    memory_track_dirty(&ctx->memory);
+    memory_track_dirty(&cosim->reference->memory);
+    cosim->interval = interval;
+    cosim->matched_pc = cosim->reference->processor.pc;
+    ctx->cosim = cosim;
+}
+
+int at_ecall(s_sim_context *ctx) {
+    int pc = ctx->processor.pc;
+    return pc >= 0 && pc < ctx->program_image.text_length && ctx->program_image.text[pc].instruction_type == INS_ECALL;
+}
+
+// executes the system call in the context and gives its result to the reference as well
+void shared_ecall(s_sim_context *ctx, s_sim_context *reference) {
+    uchar buffer[CHAR_BUFFER_LENGTH];
+    word number = ctx->processor.regs[SYSCALL_NUMBER_REG];
+    uword address = ctx->processor.regs[REG_A1];
+    uword length, done, n;
+    run_budget(ctx, 1);
+    length = host_ecall_written(number, ctx->processor.regs[FUNCTION_REGISTER]);
+    for (done = 0; done < length; done += n) {
+        n = length - done < sizeof(buffer) ? length - done : sizeof(buffer);
+        memory_load_bytes(&ctx->memory, address + done, buffer, n);
+        memory_store_bytes(&reference->memory, address + done, buffer, n);
+    }
+    reference->processor.regs[FUNCTION_REGISTER] = ctx->processor.regs[FUNCTION_REGISTER];
+    reference->processor.done = ctx->processor.done;
+    reference->processor.pc++;
+    reference->step_count++;
+}
+
+// prints one difference, returns FALSE once the report is full
+int report(s_cosim *cosim, int *count, const char *what, word expected, word actual, int hex) {
+    if (*count == 0) {
+        fprintf(stderr, "\n### Co-simulation diverged (%s) ###\n", engine_name());
+        fprintf(stderr, "Between steps %llu and %llu\n", (unsigned long long) cosim->matched, (unsigned long long) cosim->steps);
+        fprintf(stderr, "%-22s %12s %12s\n", "", "reference", "engine");
+    }
+    if (++*count > COSIM_REPORT_LIMIT) {
+        fprintf(stderr, "...\n");
+        return FALSE;
+    }
+    fprintf(stderr, hex ? "%-22s %#12x %#12x\n" : "%-22s %12d %12d\n", what, expected, actual);
+    return TRUE;
+}
+
+// compares the whole state of both contexts, returns the number of differences
+int compare(s_sim_context *ctx) {
+    s_cosim *cosim = ctx->cosim;
+    s_processor *expected = &cosim->reference->processor;
+    s_processor *actual = &ctx->processor;
+    s_memory *reference = &cosim->reference->memory;
+    s_memory *memory = reference;
+    char what[CHAR_BUFFER_LENGTH];
+    word *page, *other;
+    uword base, w;
+    int i, k, count = 0;
+    cosim->comparisons++;
+    if (expected->pc != actual->pc) {
+        report(cosim, &count, "pc", TEXT_SEGMENT_START + 4*expected->pc, TEXT_SEGMENT_START + 4*actual->pc, TRUE);
+    }
+    if (expected->done != actual->done) {
+        report(cosim, &count, "done", expected->done, actual->done, FALSE);
+    }
+    for (i = 1; i < RV32I_REG_NUM; i++) {
+        if (expected->regs[i] != actual->regs[i]) {
+            snprintf(what, sizeof(what), "%s (x%d)", abi_regs[i], i);
+            if (!report(cosim, &count, what, expected->regs[i], actual->regs[i], FALSE)) return count;
+        }
+    }
+    // only pages accessed since the last comparison can differ, those of both sides are compared once
+    for (k = 0; k < 2; k++, memory = &ctx->memory) {
+        for (i = 0; i < memory->dirty_count; i++) {
+            base = memory->dirty_bases[i];
+            if (k == 1 && reference->dirty[base >> PAGE_SHIFT]) continue;
+            page = memory_find_page(reference, base);
+            other = memory_find_page(&ctx->memory, base);
+            if (page != NULL && other != NULL && memcmp(page, other, PAGE_SIZE) == 0) continue;
+            // a page allocated on one side only has to be all zeros
+            for (w = 0; w < PAGE_WORDS; w++) {
+                word ours = page != NULL ? page[w] : 0;
+                word theirs = other != NULL ? other[w] : 0;
+                if (ours == theirs) continue;
+                snprintf(what, sizeof(what), "memory %#x", base + 4*w);
+                if (!report(cosim, &count, what, ours, theirs, FALSE)) return count;
+            }
+        }
+    }
+    memory_clear_dirty(reference);
+    memory_clear_dirty(&ctx->memory);
+    return count;
+}
+
+word run_cosim(s_sim_context *ctx) {
+    s_cosim *cosim = ctx->cosim;
+    s_sim_context *reference = cosim->reference;
+    uquad budget = ctx->max_steps > 0 ? ctx->max_steps : (ctx->max_steps == 0 ? 1 : UNLIMITED_STEPS);
+    uquad executed = 0, chunk, count;
+    char location[CHAR_BUFFER_LENGTH];
+    while (executed < budget && !reference->processor.done) {
+        chunk = cosim->interval < budget - executed ? cosim->interval : budget - executed;
+        // the reference stops before system calls, which only the engine executes
+        for (count = 0; count < chunk && !reference->processor.done && !at_ecall(reference); count++) {
+            step(reference);
+            reference->step_count++;
+        }
+        if (count == 0) {
+            shared_ecall(ctx, reference);
+            count = 1;
+        } else {
+            run_budget(ctx, count);
+        }
+        executed += count;
+        cosim->steps += count;
+        if (compare(ctx) > 0) {
+            describe_pc(ctx, cosim->matched_pc, location, sizeof(location));
+            fprintf(stderr, "Last match at %s\n", location);
+            describe_pc(ctx, reference->processor.pc, location, sizeof(location));
+            fprintf(stderr, "Reference stopped at %s\n", location);
+            sim_fail(COSIM_ERROR, "Co-simulation error:", "the %s diverged from the reference interpreter", engine_name());
+        }
+        cosim->matched = cosim->steps;
+        cosim->matched_pc = reference->processor.pc;
+    }
+    if (ctx->max_steps > 0) ctx->max_steps -= executed;
+    host_io_flush(ctx);
+    return ctx->processor.regs[FUNCTION_REGISTER];
+}
+
+void print_cosim(s_sim_context *ctx, FILE *out) {
+    s_cosim *cosim = ctx->cosim;
+    fprintf(out, "\n### Co-simulation (%s) ###\n", engine_name());
+    fprintf(out, "Instructions:  %llu\n", (unsigned long long) cosim->steps);
+    fprintf(out, "Comparisons:   %llu (every %llu instructions and at system calls)\n",
+            (unsigned long long) cosim->comparisons, (unsigned long long) cosim->interval);
+    fprintf(out, "No differences\n");
+}
+
+void cosim_free(s_sim_context *ctx) {
+    if (ctx->cosim == NULL) {
+        return;
+    }
+    free_context(ctx->cosim->reference);
+    free(ctx->cosim);
+    ctx->cosim = NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Differential co-simulation (--cosim N). The program is loaded a second time into a reference
+context, which is executed one instruction at a time by step(), while the context of the run
+executes the same number of instructions with the selected engine (the block interpreter,
+-t or -j). Every N instructions both are stopped and their pc, registers and the memory pages
+which either of them accessed since the previous comparison are compared; the first difference ends the run with a report of the steps between the last
+matching comparison and this one. The engines run whole basic blocks and leave the rest of
+their budget to step(), so N should be well above the length of the blocks. System calls
+are executed only once, by the engine, and the reference takes over their result, so input
+and output are not duplicated.
+*/
+
+// differences listed in the report
+#define COSIM_REPORT_LIMIT       16
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _cosim {
+    s_sim_context *reference;   // executed by step() only
+    uquad interval;             // instructions between comparisons
+    uquad steps;                // instructions executed by both so far
+    uquad matched;              // steps of the last comparison without differences
+    int matched_pc;             // and the pc there
+    uquad comparisons;
+} s_cosim;
+
+/*******************
+* Functions
+*******************/
+
+// loads the program of the context from the same file or checkpoint into the reference context
+void cosim_init(s_sim_context *ctx, const char *path, const char *restore_path, uquad interval);
+
+// complete run of both contexts like run_simulator(), a difference exits with COSIM_ERROR
+word run_cosim(s_sim_context *ctx);
+
+// prints the number of executed instructions and comparisons
+void print_cosim(s_sim_context *ctx, FILE *out);
+
+// releases the reference context
+void cosim_free(s_sim_context *ctx);
+
+#endif
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debugger.h"
+#include "riscv_simulator.h"
+#include "threaded_engine.h"
+#include "memory.h"
+#include "defs.h"
+
+int breakpoint_location(s_sim_context *ctx, const char *location) {
+    char buffer[CHAR_BUFFER_LENGTH];
+    char *end;
+    int i;
+    if (location[0] == ':') {
+        long line = strtol(location + 1, &end, 10);
+        if (location[1] == 0 || *end != 0 || line <= 0) return -1;
+        // a label line stops at the instruction it labels
+        for (i = 0; i < ctx->source_index; i++) {
+            if (ctx->source[i].line == line) {
+                return ctx->source[i].address < ctx->program_image.text_length ? ctx->source[i].address : -1;
+            }
+        }
+        return -1;
+    }
+    if (location[0] >= '0' && location[0] <= '9') {
+        uword address = strtoul(location, &end, 0);
+        if (*end != 0 || address < TEXT_SEGMENT_START || address % 4 != 0) return -1;
+        i = (address - TEXT_SEGMENT_START) / 4;
+        return i < ctx->program_image.text_length ? i : -1;
+    }
+    i = find_symbol(&ctx->label_hash, ctx->symbol_table, location);
+    if (i >= 0 && ctx->symbol_table[i].defined && ctx->symbol_table[i].offset >= 0) {
+        return ctx->symbol_table[i].offset < ctx->program_image.text_length ? ctx->symbol_table[i].offset : -1;
+    }
+    // labels of ELF programs are known only from their source lines
+    for (i = 0; i < ctx->source_index; i++) {
+        if (ctx->source[i].text[0] != '\t' && strcmp(source_text(ctx->source[i].text, buffer), location) == 0) {
+            return ctx->source[i].address < ctx->program_image.text_length ? ctx->source[i].address : -1;
+        }
+    }
+    return -1;
+}
+
+int watchpoint_location(s_sim_context *ctx, const char *location, uword *address) {
+    char *end;
+    int i;
+    if ((location[0] >= '0' && location[0] <= '9') || location[0] == '-') {
+        long value = strtol(location, &end, 0);
+        if (end == location) return FALSE;
+        if (strcmp(end, "(sp)") == 0) {
+            *address = (uword) ctx->processor.regs[STACK_POINTER] + value;
+        } else if (strcmp(end, "(fp)") == 0) {
+            *address = (uword) ctx->processor.regs[FRAME_POINTER] + value;
+        } else if (*end == 0 && location[0] != '-') {
+            *address = strtoul(location, &end, 0);
+        } else {
+            return FALSE;
+        }
+        return *address % 4 == 0;
+    }
+    for (i = 0; i < ctx->global_index; i++) {
+        if (strcmp(ctx->globals[i].name, location) == 0) {
+            *address = STATIC_DATA_START + 4*ctx->globals[i].offset;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int breakpoint_at(s_sim_context *ctx, int pc) {
+    return ctx->debug != NULL && pc >= 0 && pc < ctx->program_image.text_length && ctx->debug->breakpoints[pc];
+}
+
+int watchpoint_at(s_sim_context *ctx, uword address) {
+    int i;
+    for (i = 0; i < ctx->memory.watch_count; i++) {
+        if (ctx->memory.watched[i] == address) return TRUE;
+    }
+    return FALSE;
+}
+
+s_debugger *debugger_create(s_sim_context *ctx) {
+    s_debugger *debug = calloc(1, sizeof(s_debugger));
+    int length = ctx->program_image.text_length;
+    if (debug == NULL) {
+        simerror("debugger_create: out of memory");
+    }
+    debug->breakpoints = calloc(length + 1, sizeof(uchar));
+    debug->block_length = calloc(length + 1, sizeof(int));
+    if (debug->breakpoints == NULL || debug->block_length == NULL) {
+        simerror("debugger_create: out of memory");
+    }
+    debug->skip_pc = -1;
+    return debug;
+}
+
+// brings the engines in line with the changed breakpoints and watchpoints
+void debug_update(s_sim_context *ctx) {
+    s_debugger *debug = ctx->debug;
+    const s_instruction *text = ctx->program_image.text;
+    int length = ctx->program_image.text_length;
+    int i;
+    // the handler stream is translated again, with the break handlers
+    threaded_free(ctx);
+    ctx->memory.last_base = NO_PAGE;
+    if (debug->breakpoint_count == 0 && ctx->memory.watch_count == 0) {
+        debug_free(ctx);
+        return;
+    }
+    // every breakpoint starts a block and every store ends one, so the interpreter checks only between blocks
+    for (i = length - 1; i >= 0; i--) {
+        if (i == length - 1 || is_block_end(text[i].instruction_type) || debug->breakpoints[i + 1]
+                || (ctx->memory.watch_count > 0 && (text[i].instruction_type == INS_SW
+                    || (is_atomic(text[i].instruction_type) && text[i].instruction_type != INS_LR)))) {
+            debug->block_length[i] = 1;
+        } else {
+            debug->block_length[i] = debug->block_length[i + 1] + 1;
+        }
+    }
+}
+
+void set_breakpoint(s_sim_context *ctx, int pc, int enabled) {
+    if (breakpoint_at(ctx, pc) == enabled) {
+        return;
+    }
+    if (ctx->debug == NULL) {
+        ctx->debug = debugger_create(ctx);
+    }
+    ctx->debug->breakpoints[pc] = enabled;
+    ctx->debug->breakpoint_count += enabled ? 1 : -1;
+    debug_update(ctx);
+}
+
+int set_watchpoint(s_sim_context *ctx, uword address, int enabled) {
+    s_memory *memory = &ctx->memory;
+    int i;
+    if (watchpoint_at(ctx, address) == enabled) {
+        return TRUE;
+    }
+    if (enabled) {
+        if (memory->watch_count == MAX_WATCHPOINTS) {
+            return FALSE;
+        }
+        memory->watched[memory->watch_count++] = address;
+    } else {
+        for (i = 0; memory->watched[i] != address; i++);
+        memory->watched[i] = memory->watched[--memory->watch_count];
+    }
+    if (ctx->debug == NULL) {
+        ctx->debug = debugger_create(ctx);
+    }
+    debug_update(ctx);
+    return TRUE;
+}
+
+void debug_check_stop(s_sim_context *ctx) {
+    s_debugger *debug = ctx->debug;
+    int pc = ctx->processor.pc;
+    debug->stop = STOP_NONE;
+    if (ctx->memory.watch_hit) {
+        // a store never jumps, so it is the previous instruction
+        ctx->memory.watch_hit = FALSE;
+        debug->stop = STOP_WATCHPOINT;
+        debug->stop_pc = pc - 1;
+        debug->watch_address = ctx->memory.watch_address;
+        debug->watch_old = ctx->memory.watch_old;
+        debug->watch_new = memory_peek(&ctx->memory, ctx->memory.watch_address);
+    } else if (!ctx->processor.done && breakpoint_at(ctx, pc)) {
+        debug->stop = STOP_BREAKPOINT;
+        debug->stop_pc = pc;
+    }
+    debug->skip_pc = debug->stop == STOP_BREAKPOINT ? pc : -1;
+}
+
+int debug_stopped(s_sim_context *ctx) {
+    return ctx->debug != NULL && ctx->debug->stop != STOP_NONE;
+}
+
+void describe_pc(s_sim_context *ctx, int pc, char *buffer, size_t size) {
+    char label[CHAR_BUFFER_LENGTH];
+    int i;
+    for (i = 0; i < ctx->source_index; i++) {
+        if (ctx->source[i].address == pc && ctx->source[i].text[0] != '\t') {
+            snprintf(buffer, size, "%#x (%s)", TEXT_SEGMENT_START + 4*pc, source_text(ctx->source[i].text, label));
+            return;
+        }
+    }
+    snprintf(buffer, size, "%#x", TEXT_SEGMENT_START + 4*pc);
+}
+
+void debug_stop_text(s_sim_context *ctx, char *buffer, size_t size) {
+    s_debugger *debug = ctx->debug;
+    char location[CHAR_BUFFER_LENGTH];
+    char name[CHAR_BUFFER_LENGTH] = "";
+    int i;
+    if (!debug_stopped(ctx)) {
+        buffer[0] = 0;
+        return;
+    }
+    describe_pc(ctx, debug->stop_pc, location, sizeof(location));
+    if (debug->stop == STOP_BREAKPOINT) {
+        snprintf(buffer, size, "Breakpoint at %s after %llu steps", location, (unsigned long long) ctx->step_count);
+        return;
+    }
+    for (i = 0; i < ctx->global_index; i++) {
+        if (STATIC_DATA_START + 4*ctx->globals[i].offset == debug->watch_address) {
+            snprintf(name, sizeof(name), " (%s)", ctx->globals[i].name);
+        }
+    }
+    snprintf(buffer, size, "Watchpoint %#x%s: %d -> %d, stored by %s after %llu steps", debug->watch_address, name,
+             debug->watch_old, debug->watch_new, location, (unsigned long long) ctx->step_count);
+}
+
+void debug_free(s_sim_context *ctx) {
+    if (ctx->debug == NULL) {
+        return;
+    }
+    free(ctx->debug->breakpoints);
+    free(ctx->debug->block_length);
+    free(ctx->debug);
+    ctx->debug = NULL;
+}
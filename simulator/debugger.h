@@ -0,0 +1,74 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Breakpoints stop a run before the instruction at their text index is executed, watchpoints stop
+it right after an instruction has stored to their word. Without any of them the context has no
+debugger and the execution engines run unchanged. Otherwise the threaded engine gets a break
+handler patched over every instruction with a breakpoint, the interpreter runs basic blocks
+which are split before breakpoints and after stores, and the memory keeps watched pages out of
+its page cache, so that only stores to them are checked. The JIT gives way to the threaded engine.
+Breakpoint locations are labels, text addresses or :LINE of the assembly file, watchpoint
+locations are globals, data addresses or stack slots OFFSET(sp) and OFFSET(fp).
+*/
+
+enum stop_types { STOP_NONE = 0, STOP_BREAKPOINT, STOP_WATCHPOINT };
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _debugger {
+    uchar *breakpoints;         // per text index
+    int breakpoint_count;
+    int *block_length;          // basic blocks of the interpreter, split before breakpoints and after stores
+    int skip_pc;                // a run which starts at this breakpoint executes its instruction
+    int stop;                   // why the last run stopped
+    int stop_pc;                // instruction with the breakpoint, or the one which stored to the watched word
+    uword watch_address;
+    word watch_old;
+    word watch_new;
+} s_debugger;
+
+/*******************
+* Functions
+*******************/
+
+// returns text index of the breakpoint location, or -1 if there is no instruction there
+int breakpoint_location(s_sim_context *ctx, const char *location);
+
+// finds word address of the watchpoint location, returns FALSE if it is not valid
+int watchpoint_location(s_sim_context *ctx, const char *location, uword *address);
+
+// returns TRUE if there is a breakpoint at the text index
+int breakpoint_at(s_sim_context *ctx, int pc);
+
+// returns TRUE if the word is watched
+int watchpoint_at(s_sim_context *ctx, uword address);
+
+// sets or clears the breakpoint at the text index
+void set_breakpoint(s_sim_context *ctx, int pc, int enabled);
+
+// sets or clears the watchpoint on the word, returns FALSE if there are already MAX_WATCHPOINTS
+int set_watchpoint(s_sim_context *ctx, uword address, int enabled);
+
+// records whether the run which has just returned stopped at a breakpoint or a watchpoint
+void debug_check_stop(s_sim_context *ctx);
+
+// returns TRUE if the last run stopped at a breakpoint or a watchpoint
+int debug_stopped(s_sim_context *ctx);
+
+// writes address of the instruction at the text index and its label, if it has one
+void describe_pc(s_sim_context *ctx, int pc, char *buffer, size_t size);
+
+// describes the last stop
+void debug_stop_text(s_sim_context *ctx, char *buffer, size_t size);
+
+// releases the debugger
+void debug_free(s_sim_context *ctx);
+
+#endif
@@ -16,31 +16,54 @@ typedef int64_t quad;
 typedef uint64_t uquad;
 
 //tipovi naredbi
-enum { NO_TYPE = 0, SIGNED_TYPE, UNSIGNED_TYPE } sign_type;
+enum sign_types { NO_TYPE = 0, SIGNED_TYPE, UNSIGNED_TYPE };
 
-//vrste operanada
-enum { OP_REGISTER, OP_IMMEDIATE, OP_REGISTER_OFFSET, OP_ADDRESS } operand_type;
+//vrste operanada (link_program zamenjuje OP_ADDRESS sa OP_TEXT_INDEX)
+enum operand_types { OP_REGISTER, OP_IMMEDIATE, OP_REGISTER_OFFSET, OP_ADDRESS, OP_TEXT_INDEX };
 
 //instrukcije
-enum { INS_JAL, INS_RET, INS_J, INS_BGE, INS_BLE, INS_BGT, INS_BLT, INS_BEQ, INS_BNE, INS_ADD, INS_ADDI, INS_SUB, INS_MV, INS_LW, INS_SW, INS_LI, INS_NOP } ins_type;
+enum ins_types { INS_JAL, INS_RET, INS_J, INS_BGE, INS_BLE, INS_BGT, INS_BLT, INS_BEQ, INS_BNE, INS_ADD, INS_ADDI, INS_SUB, INS_MV, INS_LW, INS_SW, INS_LI,
+                 INS_SLLI, INS_SRLI, INS_SRAI, INS_MUL, INS_MULH, INS_MULHSU, INS_MULHU, INS_DIV, INS_DIVU, INS_REM, INS_REMU, INS_NOP, INS_ECALL,
+                 INS_LR, INS_SC, INS_AMOSWAP, INS_AMOADD, INS_AMOXOR, INS_AMOAND, INS_AMOOR, INS_AMOMIN, INS_AMOMAX, INS_AMOMINU, INS_AMOMAXU,
+                 INS_CSRR, INS_NUMBER };
+
+//nazivi instrukcija (branches without the u suffix)
+static char *ins_names[] = {
+        "jal", "ret", "j", "bge", "ble", "bgt", "blt", "beq", "bne", "add", "addi", "sub", "mv", "lw", "sw", "li",
+        "slli", "srli", "srai", "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu", "nop", "ecall",
+        "lr.w", "sc.w", "amoswap.w", "amoadd.w", "amoxor.w", "amoand.w", "amoor.w", "amomin.w", "amomax.w", "amominu.w", "amomaxu.w",
+        "csrr"
+};
 
 #define RV32I_REG_NUM            32
-#define SYMTAB_LENGTH            64
 
 #define NO_ADDRESS               -123
 
+//budget used when -s is not given
+#define UNLIMITED_STEPS          UINT64_MAX
+
 #define FUNCTION_REGISTER        10
 #define FRAME_POINTER            8
 #define STACK_POINTER            2
 #define GLOBAL_POINTER           3
 #define RETURN_ADDRESS_REG       1
+#define SYSCALL_NUMBER_REG       17
+
+//CSRs which csrr can read, in RV32 the upper halves of the counters are CSRs of their own
+#define CSR_CYCLE                0xc00
+#define CSR_TIME                 0xc01
+#define CSR_INSTRET              0xc02
+#define CSR_CYCLEH               0xc80
+#define CSR_TIMEH                0xc81
+#define CSR_INSTRETH             0xc82
+#define CSR_MHARTID              0xf14
 
 #define PRINT_SRCLINES           10
 #define PRINT_STKLINES           10
 
-#define STACK_SEGMENT_LENGTH     500
-#define SECTION_DATA_LENGTH      20
-#define SECTION_TEXT_LENGTH      2000 // :D
+#define STACK_CACHE_LENGTH       256
+//initial length of the program, symbol and source arrays, they grow as needed
+#define INITIAL_ARRAY_LENGTH     64
 
 #define TEXT_SEGMENT_START       (0x10000)
 #define STATIC_DATA_START        (0x10000000)
@@ -55,17 +78,25 @@ static char *abi_regs[] = {
         "t3", "t4", "t5", "t6"
 };
 
+struct _sim_context;
 extern char char_buffer[CHAR_BUFFER_LENGTH];
-extern int yyerror(char *s);
+extern int yyerror(struct _sim_context *ctx, char *s);
 extern void warning(char *s);
 
 //kodovi grešaka
-enum { NO_ERROR = 0, PARSE_ERROR, ARG_ERROR, SIM_ERROR, STEP_ERROR };
+enum { NO_ERROR = 0, PARSE_ERROR, ARG_ERROR, SIM_ERROR, STEP_ERROR, COSIM_ERROR };
+
+// prints the error and exits, or hands it over to the current context if it catches errors
+void sim_fail(int code, const char *title, const char *format, ...) __attribute__((noreturn, format(printf, 3, 4)));
+
+// exits with the code, or jumps back to the current context if it catches errors
+void sim_abort(int code) __attribute__((noreturn));
 
 //pomoćni makroi za ispis
-#define parsererror(args...) sprintf(char_buffer, args), yyerror(char_buffer), exit(PARSE_ERROR)
-#define argerror(args...) cprintf("\n{RED}Argument error:{NRM} "), printf(args), printf("\n"), exit(ARG_ERROR)
-#define simerror(args...) cprintf("\n{RED}Simulation error:{NRM} "), printf(args), printf("\n"), exit(SIM_ERROR)
+#define parsererror(args...) sprintf(char_buffer, args), yyerror(current_context, char_buffer), sim_abort(PARSE_ERROR)
+#define argerror(args...) sim_fail(ARG_ERROR, "Argument error:", args)
+#define elferror(args...) sim_fail(PARSE_ERROR, "ELF error:", args)
+#define simerror(args...) sim_fail(SIM_ERROR, "Simulation error:", args)
 
 #if RISCV_SIM_DEBUG
         #define debug(args...) printf(args), printf("\n")
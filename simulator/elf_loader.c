@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "elf_loader.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+#include "defs.h"
+
+// RV32 opcodes which have a counterpart in the simulator
+#define OPCODE_LUI      0x37
+#define OPCODE_AUIPC    0x17
+#define OPCODE_JAL      0x6f
+#define OPCODE_JALR     0x67
+#define OPCODE_BRANCH   0x63
+#define OPCODE_LOAD     0x03
+#define OPCODE_STORE    0x23
+#define OPCODE_OP_IMM   0x13
+#define OPCODE_OP       0x33
+#define OPCODE_SYSTEM   0x73
+#define OPCODE_AMO      0x2f
+
+#define FUNCT7_MULDIV   0x01
+#define FUNCT7_ALT      0x20
+
+int is_elf_file(const char *path) {
+    unsigned char magic[SELFMAG];
+    FILE *f = fopen(path, "rb");
+    int is_elf;
+    if (f == NULL) {
+        argerror("Can't open input file %s", path);
+    }
+    is_elf = fread(magic, 1, SELFMAG, f) == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0;
+    fclose(f);
+    return is_elf;
+}
+
+word imm_i(uword code) {
+    return (word) code >> 20;
+}
+
+word imm_s(uword code) {
+    return ((word) code >> 25) << 5 | ((code >> 7) & 0x1f);
+}
+
+word imm_b(uword code) {
+    return ((word) code >> 31) << 12 | ((code >> 7) & 0x1) << 11 | ((code >> 25) & 0x3f) << 5 | ((code >> 8) & 0xf) << 1;
+}
+
+word imm_j(uword code) {
+    return ((word) code >> 31) << 20 | ((code >> 12) & 0xff) << 12 | ((code >> 20) & 0x1) << 11 | ((code >> 21) & 0x3ff) << 1;
+}
+
+// text index of a pc relative jump, everything outside of the text section is rejected
+int jump_target(int index, word offset, int length, uword address) {
+    if (offset % 4 != 0 || index + offset / 4 < 0 || index + offset / 4 >= length) {
+        elferror("jump target %#x outside of text section (instruction at %#x)", address + offset, address);
+    }
+    return index + offset / 4;
+}
+
+void unsupported_instruction(uword code, uword address) {
+    elferror("unsupported instruction %#010x at %#x", code, address);
+}
+
+// writes to x0 are hints, they become addi zero, zero, 0 so that x0 stays 0
+int write_to_zero(s_sim_context *ctx, uchar rd, int with_source) {
+    if (rd != 0) {
+        return FALSE;
+    }
+    if (with_source) insert_source(ctx, "\t\t\taddi zero, zero, 0");
+    insert_arithmetic_immediate(ctx, INS_ADDI, 0, 0, 0);
+    return TRUE;
+}
+
+void decode_instruction(s_sim_context *ctx, uword code, int index, uword address, int length, int with_source) {
+    uchar rd = (code >> 7) & 0x1f;
+    uchar funct3 = (code >> 12) & 0x7;
+    uchar rs1 = (code >> 15) & 0x1f;
+    uchar rs2 = (code >> 20) & 0x1f;
+    uchar funct7 = code >> 25;
+    static const uchar branch_types[] = { INS_BEQ, INS_BNE, 0, 0, INS_BLT, INS_BGE, INS_BLT, INS_BGE };
+    static const uchar muldiv_types[] = { INS_MUL, INS_MULH, INS_MULHSU, INS_MULHU, INS_DIV, INS_DIVU, INS_REM, INS_REMU };
+    // by funct5, INS_NUMBER where the encoding is not an RV32A instruction
+    static const uchar amo_types[] = {
+        INS_AMOADD, INS_AMOSWAP, INS_LR, INS_SC, INS_AMOXOR, INS_NUMBER, INS_NUMBER, INS_NUMBER,
+        INS_AMOOR, INS_NUMBER, INS_NUMBER, INS_NUMBER, INS_AMOAND, INS_NUMBER, INS_NUMBER, INS_NUMBER,
+        INS_AMOMIN, INS_NUMBER, INS_NUMBER, INS_NUMBER, INS_AMOMAX, INS_NUMBER, INS_NUMBER, INS_NUMBER,
+        INS_AMOMINU, INS_NUMBER, INS_NUMBER, INS_NUMBER, INS_AMOMAXU, INS_NUMBER, INS_NUMBER, INS_NUMBER };
+    int target;
+    uchar type;
+    word value;
+
+    switch (code & 0x7f) {
+        case OPCODE_LUI:
+        case OPCODE_AUIPC:
+            if (write_to_zero(ctx, rd, with_source)) return;
+            value = code & 0xfffff000;
+            if ((code & 0x7f) == OPCODE_AUIPC) value += address;
+            if (with_source) insert_source(ctx, "\t\t\tli %s, %d", abi_regs[rd], value);
+            insert_load_store(ctx, INS_LI, rd, value, 0);
+            return;
+        case OPCODE_JAL:
+            // the simulator keeps text indexes in ra, so only jal ra and j have a counterpart
+            if (rd != RETURN_ADDRESS_REG && rd != 0) break;
+            type = rd == 0 ? INS_J : INS_JAL;
+            target = jump_target(index, imm_j(code), length, address);
+            if (with_source) insert_source(ctx, "\t\t\t%s %#x", ins_names[type], TEXT_SEGMENT_START + 4*target);
+            insert_jump_to(ctx, type, target);
+            return;
+        case OPCODE_JALR:
+            if (rd != 0 || rs1 != RETURN_ADDRESS_REG || imm_i(code) != 0 || funct3 != 0) break;
+            if (with_source) insert_source(ctx, "\t\t\tret");
+            insert_jump_to(ctx, INS_RET, 0);
+            return;
+        case OPCODE_BRANCH:
+            if (funct3 == 2 || funct3 == 3) break;
+            type = branch_types[funct3];
+            target = jump_target(index, imm_b(code), length, address);
+            uchar sign_type = funct3 < 4 ? NO_TYPE : funct3 < 6 ? SIGNED_TYPE : UNSIGNED_TYPE;
+            if (with_source) insert_source(ctx, "\t\t\t%s%c %s, %s, %#x", ins_names[type], type_char(sign_type), abi_regs[rs1], abi_regs[rs2], TEXT_SEGMENT_START + 4*target);
+            insert_branch_to(ctx, type, sign_type, rs1, rs2, target);
+            return;
+        case OPCODE_LOAD:
+            if (funct3 != 2) break;
+            if (write_to_zero(ctx, rd, with_source)) return;
+            if (with_source) insert_source(ctx, "\t\t\tlw %s, %d(%s)", abi_regs[rd], imm_i(code), abi_regs[rs1]);
+            insert_load_store(ctx, INS_LW, rd, imm_i(code), rs1);
+            return;
+        case OPCODE_STORE:
+            if (funct3 != 2) break;
+            if (with_source) insert_source(ctx, "\t\t\tsw %s, %d(%s)", abi_regs[rs2], imm_s(code), abi_regs[rs1]);
+            insert_load_store(ctx, INS_SW, rs2, imm_s(code), rs1);
+            return;
+        case OPCODE_OP_IMM:
+            if (funct3 == 0) {
+                if (rd == 0 && rs1 == 0 && imm_i(code) == 0) {
+                    // canonical nop, which stops the simulation
+                    if (with_source) insert_source(ctx, "\t\t\tnop");
+                    insert_nop(ctx);
+                    return;
+                }
+                type = INS_ADDI;
+                value = imm_i(code);
+            } else if (funct3 == 1 && funct7 == 0) {
+                type = INS_SLLI;
+                value = rs2;
+            } else if (funct3 == 5 && (funct7 == 0 || funct7 == FUNCT7_ALT)) {
+                type = funct7 == 0 ? INS_SRLI : INS_SRAI;
+                value = rs2;
+            } else {
+                break;
+            }
+            if (write_to_zero(ctx, rd, with_source)) return;
+            if (with_source) insert_source(ctx, "\t\t\t%s %s, %s, %d", ins_names[type], abi_regs[rd], abi_regs[rs1], value);
+            insert_arithmetic_immediate(ctx, type, rd, rs1, value);
+            return;
+        case OPCODE_OP:
+            if (funct7 == FUNCT7_MULDIV) {
+                type = muldiv_types[funct3];
+            } else if (funct3 == 0 && (funct7 == 0 || funct7 == FUNCT7_ALT)) {
+                type = funct7 == 0 ? INS_ADD : INS_SUB;
+            } else {
+                break;
+            }
+            if (write_to_zero(ctx, rd, with_source)) return;
+            if (with_source) insert_source(ctx, "\t\t\t%s %s, %s, %s", ins_names[type], abi_regs[rd], abi_regs[rs1], abi_regs[rs2]);
+            insert_arithmetic(ctx, type, rd, rs1, rs2);
+            return;
+        case OPCODE_SYSTEM:
+            if (code == OPCODE_SYSTEM) {
+                if (with_source) insert_source(ctx, "\t\t\tecall");
+                insert_ecall(ctx);
+                return;
+            }
+            // csrr (and rdcycle, rdtime, rdinstret) is csrrs with x0, other CSR instructions and ebreak stay unsupported
+            if (funct3 != 2 || rs1 != 0 || csr_name(code >> 20) == NULL) break;
+            if (write_to_zero(ctx, rd, with_source)) return;
+            if (with_source) insert_source(ctx, "\t\t\tcsrr %s, %s", abi_regs[rd], csr_name(code >> 20));
+            insert_csrr(ctx, rd, code >> 20);
+            return;
+        case OPCODE_AMO:
+            // aq and rl are ignored, every atomic is sequentially consistent
+            if (funct3 != 2 || (type = amo_types[code >> 27]) == INS_NUMBER) break;
+            if (type == INS_LR && rs2 != 0) break;
+            if (with_source) {
+                if (type == INS_LR) {
+                    insert_source(ctx, "\t\t\tlr.w %s, (%s)", abi_regs[rd], abi_regs[rs1]);
+                } else {
+                    insert_source(ctx, "\t\t\t%s %s, %s, (%s)", ins_names[type], abi_regs[rd], abi_regs[rs2], abi_regs[rs1]);
+                }
+            }
+            insert_atomic(ctx, type, rd, rs2, rs1);
+            return;
+    }
+    unsupported_instruction(code, address);
+}
+
+// labels for the interactive mode, taken from the symbol table
+char **text_labels(const uchar *file, size_t size, const Elf32_Shdr *sections, int section_count, int text_section, int length) {
+    char **labels = calloc(length, sizeof(char *));
+    int i, j;
+    if (labels == NULL) {
+        elferror("out of memory");
+    }
+    for (i = 0; i < section_count; i++) {
+        if (sections[i].sh_type != SHT_SYMTAB || sections[i].sh_link >= section_count) continue;
+        if (sections[i].sh_offset + (size_t) sections[i].sh_size > size) continue;
+        if (sections[sections[i].sh_link].sh_offset + (size_t) sections[sections[i].sh_link].sh_size > size) continue;
+        const Elf32_Sym *symbols = (const Elf32_Sym *) (file + sections[i].sh_offset);
+        const char *names = (const char *) file + sections[sections[i].sh_link].sh_offset;
+        uword names_size = sections[sections[i].sh_link].sh_size;
+        for (j = 0; j < sections[i].sh_size / sizeof(Elf32_Sym); j++) {
+            int type = ELF32_ST_TYPE(symbols[j].st_info);
+            uword offset = symbols[j].st_value - sections[text_section].sh_addr;
+            if (symbols[j].st_shndx != text_section || (type != STT_FUNC && type != STT_NOTYPE)) continue;
+            // the name has to end inside the string table
+            if (symbols[j].st_name == 0 || symbols[j].st_name >= names_size ||
+                memchr(names + symbols[j].st_name, 0, names_size - symbols[j].st_name) == NULL) continue;
+            if (names[symbols[j].st_name] == '$' || offset % 4 != 0 || offset / 4 >= length) continue;
+            labels[offset / 4] = (char *) names + symbols[j].st_name;
+        }
+    }
+    return labels;
+}
+
+void load_elf(s_sim_context *ctx, const char *path, int with_source) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    const uchar *file;
+    const Elf32_Ehdr *header;
+    const Elf32_Shdr *sections;
+    int i, text_section = -1;
+    char **labels = NULL;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        argerror("Can't open input file %s", path);
+    }
+    file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED || st.st_size < sizeof(Elf32_Ehdr)) {
+        elferror("can't map %s", path);
+    }
+    header = (const Elf32_Ehdr *) file;
+    if (header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB || header->e_machine != EM_RISCV) {
+        elferror("%s is not a little-endian RV32 file", path);
+    }
+    if (header->e_type != ET_EXEC) {
+        elferror("%s is not an executable", path);
+    }
+    if (header->e_shoff == 0 || header->e_shentsize != sizeof(Elf32_Shdr) ||
+        header->e_shoff + (size_t) header->e_shnum * sizeof(Elf32_Shdr) > st.st_size) {
+        elferror("%s has no valid section header table", path);
+    }
+    sections = (const Elf32_Shdr *) (file + header->e_shoff);
+
+    // text is the executable section with the entry point, other allocated sections are data
+    for (i = 0; i < header->e_shnum; i++) {
+        if (!(sections[i].sh_flags & SHF_ALLOC) || sections[i].sh_size == 0) continue;
+        if (sections[i].sh_type != SHT_NOBITS && sections[i].sh_offset + (size_t) sections[i].sh_size > st.st_size) {
+            elferror("section %d is outside of the file", i);
+        }
+        if (sections[i].sh_flags & SHF_EXECINSTR) {
+            if (header->e_entry >= sections[i].sh_addr && header->e_entry < sections[i].sh_addr + sections[i].sh_size) {
+                text_section = i;
+            }
+        } else if (sections[i].sh_type == SHT_PROGBITS) {
+            memory_store_bytes(&ctx->memory, sections[i].sh_addr, file + sections[i].sh_offset, sections[i].sh_size);
+        }
+    }
+    if (text_section == -1) {
+        elferror("entry point %#x is not in an executable section", header->e_entry);
+    }
+
+    const Elf32_Shdr *text = &sections[text_section];
+    int length = text->sh_size / 4;
+    if (text->sh_size % 4 != 0 || (header->e_entry - text->sh_addr) % 4 != 0) {
+        elferror("compressed instructions are not supported");
+    }
+    reserve_text(ctx, length);
+    if (with_source) {
+        labels = text_labels(file, st.st_size, sections, header->e_shnum, text_section, length);
+    }
+    for (i = 0; i < length; i++) {
+        uword code;
+        memcpy(&code, file + text->sh_offset + 4*i, 4);
+        if (with_source && labels[i] != NULL) {
+            insert_source(ctx, "%s:", labels[i]);
+        }
+        decode_instruction(ctx, code, i, text->sh_addr + 4*i, length, with_source);
+    }
+    ctx->processor.pc = (header->e_entry - text->sh_addr) / 4;
+    free(labels);
+    munmap((void *) file, st.st_size);
+}
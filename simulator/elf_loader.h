@@ -0,0 +1,18 @@
+#ifndef ELF_LOADER_H
+#define ELF_LOADER_H
+
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*******************
+* Functions
+*******************/
+
+// returns TRUE if the file starts with the ELF magic number
+int is_elf_file(const char *path);
+
+// decodes the text section of a RV32IM executable into section text and copies its data sections
+// into guest memory, source lines for the interactive mode are generated only if with_source is set
+void load_elf(s_sim_context *ctx, const char *path, int with_source);
+
+#endif
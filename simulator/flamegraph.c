@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "flamegraph.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+// child of the frame for the function, created on the first call
+int callee(s_flamegraph *fg, int parent, int function) {
+    int i;
+    for (i = fg->frames[parent].child; i >= 0; i = fg->frames[i].sibling) {
+        if (fg->frames[i].function == function) return i;
+    }
+    if (fg->frame_count == fg->frame_capacity) {
+        fg->frame_capacity *= 2;
+        fg->frames = realloc(fg->frames, fg->frame_capacity * sizeof(s_frame));
+        if (fg->frames == NULL) {
+            simerror("flamegraph: out of memory");
+        }
+    }
+    i = fg->frame_count++;
+    fg->frames[i].function = function;
+    fg->frames[i].parent = parent;
+    fg->frames[i].child = -1;
+    fg->frames[i].sibling = fg->frames[parent].child;
+    fg->frames[i].samples = 0;
+    fg->frames[parent].child = i;
+    return i;
+}
+
+// function of the text index, which may be past the end of the program, without labels it starts there
+int function_at(s_sim_context *ctx, int pc) {
+    if (pc < 0 || pc >= ctx->program_image.text_length) {
+        return pc < 0 ? 0 : ctx->program_image.text_length;
+    }
+    return ctx->flamegraph->function[pc] >= 0 ? ctx->flamegraph->function[pc] : pc;
+}
+
+void flamegraph_init(s_sim_context *ctx, const char *path, uquad interval) {
+    s_flamegraph *fg = calloc(1, sizeof(s_flamegraph));
+    int length = ctx->program_image.text_length;
+    int i;
+    if (fg == NULL || (fg->function = malloc((length + 1) * sizeof(int))) == NULL
+            || (fg->calls = calloc(length + 1, sizeof(uquad))) == NULL
+            || (fg->frames = malloc(CHAR_BUFFER_LENGTH * sizeof(s_frame))) == NULL) {
+        simerror("flamegraph_init: out of memory");
+    }
+    // functions start at labels which don't start with a dot, ELF files have no labels
+    for (i = 0; i < length; i++) {
+        fg->function[i] = -1;
+    }
+    for (i = 0; i < ctx->symtab_index; i++) {
+        s_symbol *symbol = &ctx->symbol_table[i];
+        if (symbol->defined && symbol->offset >= 0 && symbol->offset < length && symbol->name[0] != '.') {
+            fg->function[symbol->offset] = symbol->offset;
+        }
+    }
+    for (i = 0; i < length; i++) {
+        if (fg->function[i] < 0 && i > 0) fg->function[i] = fg->function[i - 1];
+    }
+    fg->function[length] = length;
+    fg->file = fopen(path, "w");
+    if (fg->file == NULL) {
+        argerror("Can't open flamegraph file %s", path);
+    }
+    fg->path = path;
+    fg->interval = interval;
+    fg->countdown = interval;
+    fg->frame_capacity = CHAR_BUFFER_LENGTH;
+    fg->frames[0].function = -1;
+    fg->frames[0].parent = -1;
+    fg->frames[0].child = -1;
+    fg->frames[0].sibling = -1;
+    fg->frames[0].samples = 0;
+    fg->frame_count = 1;
+    ctx->flamegraph = fg;
+    fg->current = callee(fg, 0, function_at(ctx, ctx->processor.pc));
+}
+
+void flamegraph_block(s_sim_context *ctx, int start, int length) {
+    s_flamegraph *fg = ctx->flamegraph;
+    uquad left = length;
+    int function;
+    while (left >= fg->countdown) {
+        left -= fg->countdown;
+        fg->countdown = fg->interval;
+        fg->frames[fg->current].samples++;
+        fg->samples++;
+    }
+    fg->countdown -= left;
+    switch (ctx->program_image.text[start + length - 1].instruction_type) {
+        case INS_JAL:
+            function = function_at(ctx, ctx->processor.pc);
+            fg->calls[function]++;
+            fg->current = callee(fg, fg->current, function);
+            break;
+        case INS_RET:
+            fg->current = fg->frames[fg->current].parent;
+            if (fg->current == 0) {
+                fg->current = callee(fg, 0, function_at(ctx, ctx->processor.pc));
+            }
+            break;
+    }
+}
+
+#define ADDRESS_NAME_LENGTH      16
+
+// name of the function at the text index
+const char *function_name(s_sim_context *ctx, int function, char *buffer) {
+    int i;
+    for (i = 0; i < ctx->symtab_index; i++) {
+        s_symbol *symbol = &ctx->symbol_table[i];
+        if (symbol->defined && symbol->offset == function && symbol->name[0] != '.') return symbol->name;
+    }
+    snprintf(buffer, ADDRESS_NAME_LENGTH, "%#x", TEXT_SEGMENT_START + 4*function);
+    return buffer;
+}
+
+// sort order of the report, the function with the most inclusive samples first
+uquad *sort_inclusive;
+
+int compare_inclusive(const void *a, const void *b) {
+    int i = *(const int *) a, j = *(const int *) b;
+    if (sort_inclusive[i] != sort_inclusive[j]) {
+        return sort_inclusive[i] < sort_inclusive[j] ? 1 : -1;
+    }
+    return i - j;
+}
+
+void print_flamegraph(s_sim_context *ctx, FILE *out) {
+    static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+    s_flamegraph *fg = ctx->flamegraph;
+    int length = ctx->program_image.text_length + 1;
+    const char **names = calloc(length, sizeof(char *));
+    char (*buffers)[ADDRESS_NAME_LENGTH] = calloc(length, ADDRESS_NAME_LENGTH);
+    uquad *inclusive = calloc(length, sizeof(uquad));
+    uquad *self = calloc(length, sizeof(uquad));
+    int *seen = malloc(length * sizeof(int));
+    int *order = calloc(length, sizeof(int));
+    int *path = malloc(fg->frame_count * sizeof(int));
+    int i, j, depth, count = 0;
+    if (names == NULL || buffers == NULL || inclusive == NULL || self == NULL || seen == NULL || order == NULL || path == NULL) {
+        simerror("print_flamegraph: out of memory");
+    }
+    for (i = 0; i < length; i++) {
+        seen[i] = -1;
+    }
+    for (i = 1; i < fg->frame_count; i++) {
+        int function = fg->frames[i].function;
+        if (names[function] == NULL) {
+            names[function] = function_name(ctx, function, buffers[function]);
+            order[count++] = function;
+        }
+        if (fg->frames[i].samples == 0) continue;
+        depth = 0;
+        for (j = i; j > 0; j = fg->frames[j].parent) {
+            path[depth++] = j;
+        }
+        // one line per stack, callers first
+        for (j = depth - 1; j >= 0; j--) {
+            fprintf(fg->file, "%s%c", names[fg->frames[path[j]].function], j > 0 ? ';' : ' ');
+        }
+        fprintf(fg->file, "%llu\n", (unsigned long long) fg->frames[i].samples);
+        // a recursive function counts once per stack
+        self[function] += fg->frames[i].samples;
+        for (j = 0; j < depth; j++) {
+            int caller = fg->frames[path[j]].function;
+            if (seen[caller] == i) continue;
+            seen[caller] = i;
+            inclusive[caller] += fg->frames[i].samples;
+        }
+    }
+    if (fflush(fg->file) != 0 || ferror(fg->file)) {
+        simerror("flamegraph: can't write %s", fg->path);
+    }
+    pthread_mutex_lock(&sort_mutex);
+    sort_inclusive = inclusive;
+    qsort(order, count, sizeof(int), compare_inclusive);
+    pthread_mutex_unlock(&sort_mutex);
+
+    fprintf(out, "\n### Call stacks: %llu samples, one every %llu instructions (written to %s) ###\n",
+            (unsigned long long) fg->samples, (unsigned long long) fg->interval, fg->path);
+    fprintf(out, "%-24s %12s %9s %12s %9s %12s\n", "Function", "Inclusive", "%", "Self", "%", "Calls");
+    for (i = 0; i < count; i++) {
+        int function = order[i];
+        fprintf(out, "%-24s %12llu %8.2f%% %12llu %8.2f%% %12llu\n", names[function],
+                (unsigned long long) inclusive[function], fg->samples ? 100.0 * inclusive[function] / fg->samples : 0.0,
+                (unsigned long long) self[function], fg->samples ? 100.0 * self[function] / fg->samples : 0.0,
+                (unsigned long long) fg->calls[function]);
+    }
+    free(names);
+    free(buffers);
+    free(inclusive);
+    free(self);
+    free(seen);
+    free(order);
+    free(path);
+}
+
+void flamegraph_free(s_sim_context *ctx) {
+    if (ctx->flamegraph == NULL) {
+        return;
+    }
+    fclose(ctx->flamegraph->file);
+    free(ctx->flamegraph->function);
+    free(ctx->flamegraph->calls);
+    free(ctx->flamegraph->frames);
+    free(ctx->flamegraph);
+    ctx->flamegraph = NULL;
+}
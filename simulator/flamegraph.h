@@ -0,0 +1,66 @@
+#ifndef FLAMEGRAPH_H
+#define FLAMEGRAPH_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Call-stack sampling profiler (--flamegraph FILE). A shadow call stack follows jal (push) and
+ret (pop), and every --sample-interval executed instructions the current stack gets a sample.
+Both only change at the end of a basic block, so the stack is sampled once per block, for as
+many samples as the block covers. The stacks form a tree of call paths, where a frame is the
+current node and a call goes to its child for the called function; a ret at the bottom of the
+tree (after --restore, or to a caller that was never seen) starts another root.
+A function is the last label not starting with a dot at or before an address (labels like
+.fib_body or .if0 of compiled code are local). Without labels (ELF files) every call target
+is a function of its own, named by its address.
+At exit the tree is written as folded stacks ("_start;main;fib;fib 42"), the input of
+flamegraph.pl and speedscope, and the functions are listed by inclusive samples.
+*/
+
+#define FLAMEGRAPH_INTERVAL      1000
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _frame {
+    int function;               // text index of the function start, -1 for the top of the tree
+    int parent;
+    int child;                  // first callee, -1 if there is none
+    int sibling;                // next callee of the parent
+    uquad samples;              // taken with this frame on top of the stack
+} s_frame;
+
+typedef struct _flamegraph {
+    FILE *file;
+    const char *path;
+    uquad interval;
+    uquad countdown;            // instructions until the next sample
+    uquad samples;
+    int *function;              // function start of every text index
+    uquad *calls;               // per function start
+    s_frame *frames;            // frames[0] is the top of the tree, the roots are its children
+    int frame_count;
+    int frame_capacity;
+    int current;
+} s_flamegraph;
+
+/*******************
+* Functions
+*******************/
+
+// opens the output file and starts the shadow stack in the function of pc (called after link_program)
+void flamegraph_init(s_sim_context *ctx, const char *path, uquad interval);
+
+// samples the stack for length executed instructions starting at start and follows a call or return at their end
+void flamegraph_block(s_sim_context *ctx, int start, int length);
+
+// writes the folded stacks to the file and prints the functions with inclusive and self samples
+void print_flamegraph(s_sim_context *ctx, FILE *out);
+
+// releases the call tree of the context
+void flamegraph_free(s_sim_context *ctx);
+
+#endif
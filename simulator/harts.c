@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "harts.h"
+#include "host_io.h"
+#include "memory.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+// copy of the first hart which shares its program, memory and output
+s_sim_context *create_hart(s_sim_context *ctx, int id) {
+    s_sim_context *hart = create_context();
+    hart->program_image = ctx->program_image;
+    memory_share(&hart->memory, &ctx->memory);
+    host_io_share(hart, ctx);
+    hart->processor = ctx->processor;
+    hart->processor.regs[STACK_POINTER] -= id * HART_STACK_SIZE;
+    hart->processor.regs[FRAME_POINTER] -= id * HART_STACK_SIZE;
+    hart->max_steps = ctx->max_steps;
+    hart->hart_id = id;
+    return hart;
+}
+
+void harts_init(s_sim_context *ctx, int count) {
+    s_harts *harts = calloc(1, sizeof(s_harts));
+    int i;
+    if (harts == NULL || (harts->contexts = calloc(count, sizeof(s_sim_context *))) == NULL
+            || (harts->threads = calloc(count, sizeof(pthread_t))) == NULL) {
+        simerror("harts_init: out of memory");
+    }
+    harts->count = count;
+    harts->contexts[0] = ctx;
+    for (i = 1; i < count; i++) {
+        harts->contexts[i] = create_hart(ctx, i);
+    }
+    ctx->harts = harts;
+}
+
+// -s 0 executes one step, like in run_simulator()
+uquad hart_budget(s_sim_context *hart) {
+    return hart->max_steps > 0 ? hart->max_steps : (hart->max_steps == 0 ? 1 : UNLIMITED_STEPS);
+}
+
+void *hart_thread(void *arg) {
+    s_sim_context *hart = arg;
+    current_context = hart;
+    run_budget(hart, hart_budget(hart));
+    return NULL;
+}
+
+word run_harts(s_sim_context *ctx) {
+    s_harts *harts = ctx->harts;
+    struct timespec start, end;
+    uquad executed;
+    int i;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < harts->count; i++) {
+        if (pthread_create(&harts->threads[i], NULL, hart_thread, harts->contexts[i]) != 0) {
+            simerror("run_harts: can't start the thread of hart %d", i);
+        }
+    }
+    executed = run_budget(ctx, hart_budget(ctx));
+    for (i = 1; i < harts->count; i++) {
+        pthread_join(harts->threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    harts->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (ctx->max_steps > 0) ctx->max_steps -= executed;
+    host_io_flush(ctx);
+    return ctx->processor.regs[FUNCTION_REGISTER];
+}
+
+void print_harts(s_sim_context *ctx, FILE *out) {
+    s_harts *harts = ctx->harts;
+    uquad total = 0;
+    int i;
+    fprintf(out, "\n### Harts ###\n");
+    fprintf(out, "%-6s %14s %12s\n", "Hart", "Instructions", "a0");
+    for (i = 0; i < harts->count; i++) {
+        s_sim_context *hart = harts->contexts[i];
+        fprintf(out, "%-6d %14llu %12d%s\n", i, (unsigned long long) hart->step_count, hart->processor.regs[FUNCTION_REGISTER],
+                hart->processor.done ? "" : " (not finished)");
+        total += hart->step_count;
+    }
+    fprintf(out, "Total:        %llu instructions\n", (unsigned long long) total);
+    fprintf(out, "Wall time:    %.3f s\n", harts->seconds);
+    fprintf(out, "Throughput:   %.1f MIPS\n", harts->seconds > 0 ? total / harts->seconds / 1e6 : 0.0);
+}
+
+void harts_free(s_sim_context *ctx) {
+    s_harts *harts = ctx->harts;
+    int i;
+    if (harts == NULL) {
+        return;
+    }
+    for (i = 1; i < harts->count; i++) {
+        // the program belongs to the first hart
+        harts->contexts[i]->program_image.text = NULL;
+        free_context(harts->contexts[i]);
+    }
+    free(harts->contexts);
+    free(harts->threads);
+    free(harts);
+    ctx->harts = NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef HARTS_H
+#define HARTS_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Multi-hart runs (--harts N). Every hart is a context of its own with the registers, the page
+cache and the translated code of the selected engine, and runs on a host thread of its own.
+The harts share the linked program, the guest memory and the output buffer. All of them start
+at the entry point with the same registers, except that hart i reads i from mhartid and its
+stack starts HART_STACK_SIZE bytes below the stack of hart i-1; programs split their work by
+mhartid and synchronize with lr.w/sc.w and the amo instructions, which are host atomics.
+Each hart stops at its own nop or exit, the exit code is the one of hart 0.
+*/
+
+#define MAX_HARTS                64
+#define HART_STACK_SIZE          (1 << 20)
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _harts {
+    int count;
+    s_sim_context **contexts;   // contexts[0] is the context of the run
+    pthread_t *threads;
+    double seconds;             // wall time of the parallel run
+} s_harts;
+
+/*******************
+* Functions
+*******************/
+
+// creates the other harts of the linked program in the context
+void harts_init(s_sim_context *ctx, int count);
+
+// complete run of all harts like run_simulator(), returns a0 of hart 0
+word run_harts(s_sim_context *ctx);
+
+// prints instructions of every hart, the wall time and the combined MIPS
+void print_harts(s_sim_context *ctx, FILE *out);
+
+// releases the other harts
+void harts_free(s_sim_context *ctx);
+
+#endif
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+#include "host_io.h"
+#include "debugger.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+#include "defs.h"
+
+// returns register written by the instruction, 0 if it doesn't write one
+int written_register(const s_instruction *ins) {
+    switch (ins->instruction_type) {
+        case INS_JAL:
+            return RETURN_ADDRESS_REG;
+        case INS_ADD: case INS_ADDI: case INS_SUB: case INS_MV: case INS_LW: case INS_LI:
+        case INS_SLLI: case INS_SRLI: case INS_SRAI:
+        case INS_MUL: case INS_MULH: case INS_MULHSU: case INS_MULHU:
+        case INS_DIV: case INS_DIVU: case INS_REM: case INS_REMU:
+            return ins->destination.register_index < RV32I_REG_NUM ? ins->destination.register_index : 0;
+        case INS_ECALL:
+            return FUNCTION_REGISTER;
+        case INS_LR: case INS_SC: case INS_CSRR:
+        case INS_AMOSWAP: case INS_AMOADD: case INS_AMOXOR: case INS_AMOAND: case INS_AMOOR:
+        case INS_AMOMIN: case INS_AMOMAX: case INS_AMOMINU: case INS_AMOMAXU:
+            return ins->destination.register_index < RV32I_REG_NUM ? ins->destination.register_index : 0;
+        default:
+            return 0;
+    }
+}
+
+s_snapshot *snapshot_at(s_history *history, int i) {
+    return &history->snapshots[(history->snapshot_first + i) % HISTORY_SNAPSHOTS];
+}
+
+// releases the pages which no other snapshot shares
+void free_snapshot(s_snapshot *snapshot) {
+    int i;
+    for (i = 0; i < snapshot->page_count; i++) {
+        if (--snapshot->pages[i]->references == 0) {
+            free(snapshot->pages[i]);
+        }
+    }
+    free(snapshot->bases);
+    free(snapshot->pages);
+}
+
+void take_snapshot(s_sim_context *ctx) {
+    s_history *history = ctx->history;
+    s_memory *memory = &ctx->memory;
+    s_snapshot *snapshot, *previous = NULL;
+    s_saved_page *saved;
+    int i, j, k = 0, count = 0;
+    if (history->snapshot_count == HISTORY_SNAPSHOTS) {
+        // the oldest one makes room
+        free_snapshot(snapshot_at(history, 0));
+        history->snapshot_first = (history->snapshot_first + 1) % HISTORY_SNAPSHOTS;
+        history->snapshot_count--;
+    }
+    if (history->snapshot_count > 0) {
+        previous = snapshot_at(history, history->snapshot_count - 1);
+    }
+    snapshot = snapshot_at(history, history->snapshot_count);
+    for (i = 0; i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; memory->directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            if (memory->directory[i][j] != NULL) count++;
+        }
+    }
+    snapshot->bases = malloc((count + 1) * sizeof(uword));
+    snapshot->pages = malloc((count + 1) * sizeof(s_saved_page *));
+    if (snapshot->bases == NULL || snapshot->pages == NULL) {
+        simerror("history: out of memory");
+    }
+    snapshot->step = history->step;
+    snapshot->processor = ctx->processor;
+    snapshot->reserved = ctx->reserved;
+    snapshot->reservation_address = ctx->reservation_address;
+    snapshot->reservation_value = ctx->reservation_value;
+    snapshot->page_count = 0;
+    for (i = 0; i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; memory->directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            uword base = ((uword) i << (PAGE_SHIFT + PAGE_TABLE_BITS)) | ((uword) j << PAGE_SHIFT);
+            word *page = memory->directory[i][j];
+            if (page == NULL) continue;
+            // the previous snapshot has a part of these pages in the same order
+            while (previous != NULL && k < previous->page_count && previous->bases[k] < base) k++;
+            saved = NULL;
+            if (previous != NULL && k < previous->page_count && previous->bases[k] == base
+                    && ((!history->compare_all && !memory->dirty[base >> PAGE_SHIFT])
+                        || memcmp(previous->pages[k]->words, page, PAGE_SIZE) == 0)) {
+                saved = previous->pages[k];
+                saved->references++;
+            } else {
+                saved = malloc(sizeof(s_saved_page));
+                if (saved == NULL) {
+                    simerror("history: out of memory");
+                }
+                saved->references = 1;
+                memcpy(saved->words, page, PAGE_SIZE);
+            }
+            snapshot->bases[snapshot->page_count] = base;
+            snapshot->pages[snapshot->page_count] = saved;
+            snapshot->page_count++;
+        }
+    }
+    history->snapshot_count++;
+    memory_clear_dirty(memory);
+    history->compare_all = FALSE;
+}
+
+void restore_snapshot(s_sim_context *ctx, s_snapshot *snapshot) {
+    s_history *history = ctx->history;
+    int i, j, k = 0;
+    // pages are never freed, so the snapshot has a part of the allocated pages in the same order
+    for (i = 0; i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; ctx->memory.directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            uword base = ((uword) i << (PAGE_SHIFT + PAGE_TABLE_BITS)) | ((uword) j << PAGE_SHIFT);
+            if (ctx->memory.directory[i][j] == NULL) continue;
+            if (k < snapshot->page_count && snapshot->bases[k] == base) {
+                memcpy(ctx->memory.directory[i][j], snapshot->pages[k]->words, PAGE_SIZE);
+                k++;
+            } else {
+                memset(ctx->memory.directory[i][j], 0, PAGE_SIZE);
+            }
+        }
+    }
+    ctx->processor = snapshot->processor;
+    ctx->reserved = snapshot->reserved;
+    ctx->reservation_address = snapshot->reservation_address;
+    ctx->reservation_value = snapshot->reservation_value;
+    history->step = snapshot->step;
+    history->log_count = 0;
+    // the pages were copied past the dirty marks
+    history->compare_all = TRUE;
+}
+
+// drops the snapshots taken after the current step
+void drop_newer_snapshots(s_history *history) {
+    while (history->snapshot_count > 0 && snapshot_at(history, history->snapshot_count - 1)->step > history->step) {
+        free_snapshot(snapshot_at(history, history->snapshot_count - 1));
+        history->snapshot_count--;
+        // the dirty marks are relative to the dropped snapshot
+        history->compare_all = TRUE;
+    }
+}
+
+// forgets everything before the current step, the history starts again after it
+void forget_history(s_history *history) {
+    while (history->snapshot_count > 0) {
+        free_snapshot(snapshot_at(history, history->snapshot_count - 1));
+        history->snapshot_count--;
+    }
+    history->log_count = 0;
+    history->restart = TRUE;
+}
+
+void history_init(s_sim_context *ctx) {
+    s_history *history = calloc(1, sizeof(s_history));
+    if (history == NULL || (history->log = malloc(HISTORY_LOG_LENGTH * sizeof(s_undo))) == NULL) {
+        simerror("history_init: out of memory");
+    }
+    history->step = ctx->step_count;
+    ctx->history = history;
+    // snapshots share the pages which weren't written since the previous one
+    if (ctx->memory.dirty == NULL) {
+        memory_track_dirty(&ctx->memory);
+    }
+    // the start of the history can always be restored
+    take_snapshot(ctx);
+}
+
+void history_record(s_sim_context *ctx) {
+    s_history *history = ctx->history;
+    int pc = ctx->processor.pc;
+    const s_instruction *ins;
+    s_undo *undo;
+    // invalid pc is reported by step()
+    if (pc < 0 || pc >= ctx->program_image.text_length) {
+        return;
+    }
+    if (history->restart || (history->step % HISTORY_INTERVAL == 0 && snapshot_at(history, history->snapshot_count - 1)->step < history->step)) {
+        take_snapshot(ctx);
+        history->restart = FALSE;
+    }
+    ins = &ctx->program_image.text[pc];
+    // a replay couldn't read the same input or time again, so the history can't go back past them
+    if (ins->instruction_type == INS_ECALL && host_ecall_is_input(ctx)) {
+        forget_history(history);
+        history->step++;
+        return;
+    }
+    if (history->log_count == HISTORY_LOG_LENGTH) {
+        history->log_first = (history->log_first + 1) % HISTORY_LOG_LENGTH;
+        history->log_count--;
+    }
+    undo = &history->log[(history->log_first + history->log_count++) % HISTORY_LOG_LENGTH];
+    undo->pc = pc;
+    undo->reg = written_register(ins);
+    undo->reg_old = ctx->processor.regs[undo->reg];
+    undo->reserved = ctx->reserved;
+    undo->reservation_address = ctx->reservation_address;
+    undo->reservation_value = ctx->reservation_value;
+    undo->store = ins->instruction_type == INS_SW && ins->destination.register_index < RV32I_REG_NUM;
+    if (undo->store) {
+        undo->address = (uword) ctx->processor.regs[ins->destination.register_index] + ins->destination.data;
+        undo->memory_old = memory_peek(&ctx->memory, undo->address);
+    } else if (is_atomic(ins->instruction_type) && ins->instruction_type != INS_LR && ins->source1.register_index < RV32I_REG_NUM) {
+        // sc.w and the amo instructions store to the address in rs1
+        undo->store = TRUE;
+        undo->address = ctx->processor.regs[ins->source1.register_index];
+        undo->memory_old = memory_peek(&ctx->memory, undo->address);
+    }
+    history->step++;
+}
+
+s_undo *last_undo(s_history *history) {
+    return &history->log[(history->log_first + history->log_count - 1) % HISTORY_LOG_LENGTH];
+}
+
+void undo_last(s_sim_context *ctx) {
+    s_history *history = ctx->history;
+    s_undo *undo = last_undo(history);
+    if (undo->reg != 0) {
+        ctx->processor.regs[undo->reg] = undo->reg_old;
+    }
+    if (undo->store) {
+        *memory_word(&ctx->memory, undo->address) = undo->memory_old;
+    }
+    ctx->reserved = undo->reserved;
+    ctx->reservation_address = undo->reservation_address;
+    ctx->reservation_value = undo->reservation_value;
+    ctx->processor.pc = undo->pc;
+    ctx->processor.done = FALSE;
+    history->log_count--;
+    history->step--;
+}
+
+// executes forward to the step without any of the observers
+void replay(s_sim_context *ctx, uquad step_number) {
+    ctx->history->replaying = TRUE;
+    while (ctx->history->step < step_number) {
+        // instret reads the same values as in the run which is replayed
+        ctx->step_count = ctx->history->step;
+        history_record(ctx);
+        step(ctx);
+    }
+    ctx->history->replaying = FALSE;
+    ctx->memory.watch_hit = FALSE;
+}
+
+// restores the last snapshot before the step and executes forward to it, so the log ends there
+int refill_log(s_sim_context *ctx) {
+    s_history *history = ctx->history;
+    uquad step_number = history->step;
+    int i;
+    for (i = history->snapshot_count - 1; i >= 0; i--) {
+        if (snapshot_at(history, i)->step < step_number) {
+            restore_snapshot(ctx, snapshot_at(history, i));
+            replay(ctx, step_number);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+uquad history_back(s_sim_context *ctx, uquad steps) {
+    s_history *history = ctx->history;
+    uquad start = history->step;
+    while (start - history->step < steps && (history->log_count > 0 || refill_log(ctx))) {
+        undo_last(ctx);
+    }
+    drop_newer_snapshots(history);
+    ctx->step_count = history->step;
+    return start - history->step;
+}
+
+uquad history_reverse_continue(s_sim_context *ctx) {
+    s_history *history = ctx->history;
+    s_debugger *debug = ctx->debug;
+    uquad start = history->step;
+    s_undo *undo;
+    if (debug != NULL) {
+        debug->stop = STOP_NONE;
+    }
+    while (history->log_count > 0 || refill_log(ctx)) {
+        undo = last_undo(history);
+        // a watchpoint stops right after the store, like in a forward run, but not where the run started
+        if (history->step < start && undo->store && watchpoint_at(ctx, undo->address)) {
+            debug->stop = STOP_WATCHPOINT;
+            debug->stop_pc = undo->pc;
+            debug->watch_address = undo->address;
+            debug->watch_old = undo->memory_old;
+            debug->watch_new = memory_peek(&ctx->memory, undo->address);
+            break;
+        }
+        undo_last(ctx);
+        if (breakpoint_at(ctx, ctx->processor.pc)) {
+            debug->stop = STOP_BREAKPOINT;
+            debug->stop_pc = ctx->processor.pc;
+            break;
+        }
+    }
+    drop_newer_snapshots(history);
+    ctx->step_count = history->step;
+    return start - history->step;
+}
+
+void history_free(s_sim_context *ctx) {
+    int i;
+    if (ctx->history == NULL) {
+        return;
+    }
+    for (i = 0; i < ctx->history->snapshot_count; i++) {
+        free_snapshot(snapshot_at(ctx->history, i));
+    }
+    free(ctx->history->log);
+    free(ctx->history);
+    ctx->history = NULL;
+}
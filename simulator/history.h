@@ -0,0 +1,91 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Execution history of the interactive mode, which lets it step back and run backwards.
+Before every instruction the undo log gets its pc and the values it is about to overwrite
+(the written register, the stored word, the lr.w reservation), so recent steps are undone in place. Every
+HISTORY_INTERVAL steps a snapshot of the registers and of the memory pages is taken; a page
+which isn't dirty (see memory.h) or is equal to its copy in the previous snapshot shares that
+copy, so a snapshot only costs the pages written since the previous one. Older steps are
+reached by restoring the last snapshot before them and executing forward again. The simulation is deterministic, so the replay ends in the same state.
+Only the processor and the memory go back, counters of -p and of the timing models don't.
+System calls that read input or the clock can't be replayed, so the history starts again
+after them; output written again by a replay is dropped.
+*/
+
+#define HISTORY_INTERVAL         (1 << 15)
+// the log always reaches back to the last snapshot, so a replay refills it
+#define HISTORY_LOG_LENGTH       (2 * HISTORY_INTERVAL)
+#define HISTORY_SNAPSHOTS        64
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _undo {
+    int pc;
+    uchar reg;                  // register the instruction writes, 0 for none
+    uchar store;                // TRUE if it stores to address
+    word reg_old;
+    uword address;
+    word memory_old;
+    uchar reserved;             // reservation of lr.w before the instruction
+    uword reservation_address;
+    word reservation_value;
+} s_undo;
+
+// copy of a memory page, shared by the snapshots in which it didn't change
+typedef struct _saved_page {
+    int references;
+    word words[PAGE_WORDS];
+} s_saved_page;
+
+typedef struct _snapshot {
+    uquad step;
+    s_processor processor;
+    int reserved;               // reservation of lr.w
+    uword reservation_address;
+    word reservation_value;
+    uword *bases;               // allocated pages and their contents
+    s_saved_page **pages;
+    int page_count;
+} s_snapshot;
+
+typedef struct _history {
+    uquad step;                 // steps executed so far, step_count of the context outside of runs
+    s_undo *log;                // ring buffer, the last entry is the last executed instruction
+    int log_first;
+    int log_count;
+    s_snapshot snapshots[HISTORY_SNAPSHOTS];    // ring buffer ordered by step
+    int snapshot_first;
+    int snapshot_count;
+    int restart;                // TRUE if the next step needs a snapshot, set after an input system call
+    int compare_all;            // TRUE if the dirty marks don't cover the changes since the last snapshot
+    int replaying;              // TRUE while a replay executes steps again, they don't write output
+} s_history;
+
+/*******************
+* Functions
+*******************/
+
+// starts recording the history of the context
+void history_init(s_sim_context *ctx);
+
+// records the instruction at pc before step() executes it
+void history_record(s_sim_context *ctx);
+
+// goes back by the given number of steps, returns the number of steps it went back
+uquad history_back(s_sim_context *ctx, uquad steps);
+
+// goes back to the last breakpoint or store to a watched word, sets the stop of the debugger like a
+// forward run would (before the breakpoint, right after the store), returns the number of steps
+uquad history_reverse_continue(s_sim_context *ctx);
+
+// releases the history
+void history_free(s_sim_context *ctx);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "host_io.h"
+#include "history.h"
+#include "screen.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+#include "defs.h"
+
+#define REG_A1                   11
+#define REG_A2                   12
+
+s_host_io *host_io(s_sim_context *ctx) {
+    if (ctx->io == NULL) {
+        ctx->io = calloc(1, sizeof(s_host_io));
+        if (ctx->io == NULL || (ctx->io->out = malloc(HOST_IO_BUFFER_SIZE)) == NULL) {
+            simerror("host_io: out of memory");
+        }
+        ctx->io->sink = stdout;
+        pthread_mutex_init(&ctx->io->lock, NULL);
+    }
+    return ctx->io;
+}
+
+void host_io_capture(s_sim_context *ctx, FILE *sink) {
+    host_io(ctx)->sink = sink;
+}
+
+void host_io_share(s_sim_context *ctx, s_sim_context *owner) {
+    ctx->io = host_io(owner);
+    ctx->io_shared = TRUE;
+}
+
+// writes the buffer, the lock is held
+void flush_locked(s_sim_context *ctx) {
+    if (ctx->io->length == 0) {
+        return;
+    }
+    fflush(stdout);
+    fwrite(ctx->io->out, 1, ctx->io->length, ctx->io->sink);
+    fflush(ctx->io->sink);
+    ctx->io->length = 0;
+    // the output went over the frame of the interactive mode
+    if (ctx->screen != NULL) {
+        ctx->screen->clear = TRUE;
+    }
+}
+
+void host_io_flush(s_sim_context *ctx) {
+    if (ctx->io == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&ctx->io->lock);
+    flush_locked(ctx);
+    pthread_mutex_unlock(&ctx->io->lock);
+}
+
+word sys_write(s_sim_context *ctx, word fd, uword address, uword count) {
+    s_host_io *io;
+    uchar buffer[CHAR_BUFFER_LENGTH];
+    uword done, n;
+    // the history executes again what was already written
+    if (ctx->history != NULL && ctx->history->replaying) {
+        return fd == 1 || fd == 2 ? (word) count : -EBADF;
+    }
+    if (fd == 2) {
+        for (done = 0; done < count; done += n) {
+            n = count - done < sizeof(buffer) ? count - done : sizeof(buffer);
+            memory_load_bytes(&ctx->memory, address + done, buffer, n);
+            fwrite(buffer, 1, n, stderr);
+        }
+        return count;
+    }
+    if (fd != 1) {
+        return -EBADF;
+    }
+    io = host_io(ctx);
+    pthread_mutex_lock(&io->lock);
+    for (done = 0; done < count; done += n) {
+        if (io->length == HOST_IO_BUFFER_SIZE) {
+            flush_locked(ctx);
+        }
+        n = count - done < HOST_IO_BUFFER_SIZE - io->length ? count - done : HOST_IO_BUFFER_SIZE - io->length;
+        memory_load_bytes(&ctx->memory, address + done, io->out + io->length, n);
+        io->length += n;
+    }
+    pthread_mutex_unlock(&io->lock);
+    return count;
+}
+
+word sys_read(s_sim_context *ctx, word fd, uword address, uword count) {
+    uchar buffer[HOST_IO_BUFFER_SIZE / 16];
+    ssize_t n;
+    if (fd != 0) {
+        return -EBADF;
+    }
+    // a prompt is written before the program waits for the answer
+    host_io_flush(ctx);
+    n = read(STDIN_FILENO, buffer, count < sizeof(buffer) ? count : sizeof(buffer));
+    if (n < 0) {
+        return -errno;
+    }
+    memory_store_bytes(&ctx->memory, address, buffer, n);
+    return n;
+}
+
+word sys_clock_gettime(s_sim_context *ctx, word clock, uword address, int wide) {
+    struct timespec now;
+    if ((clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC) || clock_gettime(clock, &now) != 0) {
+        return -EINVAL;
+    }
+    if (address % 4 != 0) {
+        return -EFAULT;
+    }
+    if (wide) {
+        *memory_store_word(&ctx->memory, address) = (uquad) now.tv_sec;
+        *memory_store_word(&ctx->memory, address + 4) = (uquad) now.tv_sec >> 32;
+        *memory_store_word(&ctx->memory, address + 8) = now.tv_nsec;
+        *memory_store_word(&ctx->memory, address + 12) = 0;
+    } else {
+        *memory_store_word(&ctx->memory, address) = now.tv_sec;
+        *memory_store_word(&ctx->memory, address + 4) = now.tv_nsec;
+    }
+    return 0;
+}
+
+void host_ecall(s_sim_context *ctx) {
+    word *regs = ctx->processor.regs;
+    switch (regs[SYSCALL_NUMBER_REG]) {
+        case SYS_WRITE:
+            regs[FUNCTION_REGISTER] = sys_write(ctx, regs[FUNCTION_REGISTER], regs[REG_A1], regs[REG_A2]);
+            break;
+        case SYS_READ:
+            regs[FUNCTION_REGISTER] = sys_read(ctx, regs[FUNCTION_REGISTER], regs[REG_A1], regs[REG_A2]);
+            break;
+        case SYS_EXIT:
+            ctx->processor.done = TRUE;
+            break;
+        case SYS_CLOCK_GETTIME:
+        case SYS_CLOCK_GETTIME64:
+            regs[FUNCTION_REGISTER] = sys_clock_gettime(ctx, regs[FUNCTION_REGISTER], regs[REG_A1],
+                                                        regs[SYSCALL_NUMBER_REG] == SYS_CLOCK_GETTIME64);
+            break;
+        default:
+            regs[FUNCTION_REGISTER] = -ENOSYS;
+            break;
+    }
+}
+
+int host_ecall_is_input(s_sim_context *ctx) {
+    word number = ctx->processor.regs[SYSCALL_NUMBER_REG];
+    return number == SYS_READ || number == SYS_CLOCK_GETTIME || number == SYS_CLOCK_GETTIME64;
+}
+
+uword host_ecall_written(word number, word result) {
+    if (result < 0) {
+        return 0;
+    }
+    switch (number) {
+        case SYS_READ:
+            return result;
+        case SYS_CLOCK_GETTIME:
+            return 8;
+        case SYS_CLOCK_GETTIME64:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+void host_io_free(s_sim_context *ctx) {
+    if (ctx->io == NULL) {
+        return;
+    }
+    if (ctx->io_shared) {
+        ctx->io = NULL;
+        return;
+    }
+    host_io_flush(ctx);
+    pthread_mutex_destroy(&ctx->io->lock);
+    free(ctx->io->out);
+    free(ctx->io);
+    ctx->io = NULL;
+}
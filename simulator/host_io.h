@@ -0,0 +1,67 @@
+#ifndef HOST_IO_H
+#define HOST_IO_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+System calls of guest programs (ecall), with the Linux RISC-V numbers and calling convention:
+the number is in a7, arguments in a0-a2 and the result (or -errno) is returned in a0.
+    write(fd, buffer, count)            fd 1 goes through the output buffer, fd 2 straight to stderr
+    read(fd, buffer, count)             only fd 0, the output buffer is flushed first
+    exit(code)                          a0 becomes the exit code and the program stops
+    clock_gettime(clock, timespec)      32-bit tv_sec and tv_nsec of CLOCK_REALTIME or CLOCK_MONOTONIC
+    clock_gettime64(clock, timespec)    the same with 64-bit fields
+The output buffer is written to stdout only when it is full and when the run ends, so a guest
+program can print megabytes with a handful of host system calls. The harts of --harts share
+the buffer of the first hart, each write is copied in as a whole under its lock. The jobs of
+--batch capture their output in a stream of their own instead of stdout.
+*/
+
+#define SYS_READ                 63
+#define SYS_WRITE                64
+#define SYS_EXIT                 93
+#define SYS_CLOCK_GETTIME        113
+#define SYS_CLOCK_GETTIME64      403
+
+#define HOST_IO_BUFFER_SIZE      (1 << 20)
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _host_io {
+    uchar *out;
+    size_t length;
+    FILE *sink;
+    pthread_mutex_t lock;
+} s_host_io;
+
+/*******************
+* Functions
+*******************/
+
+// executes the system call of the guest, called by step() for ecall
+void host_ecall(s_sim_context *ctx);
+
+// returns TRUE if the ecall with the registers of the context makes the run depend on the host
+int host_ecall_is_input(s_sim_context *ctx);
+
+// returns the number of bytes the system call which returned result wrote to its buffer (a1)
+uword host_ecall_written(word number, word result);
+
+// writes the buffered output of the guest to stdout, or to the stream it is captured in
+void host_io_flush(s_sim_context *ctx);
+
+// makes the output of the guest go to the stream instead of stdout
+void host_io_capture(s_sim_context *ctx, FILE *sink);
+
+// makes the context write to the output buffer of the owner, which has to outlive it
+void host_io_share(s_sim_context *ctx, s_sim_context *owner);
+
+// flushes and releases the output buffer (of the owner only)
+void host_io_free(s_sim_context *ctx);
+
+#endif
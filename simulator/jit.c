@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+#include "defs.h"
+
+/*
+Native code conventions:
+    rbx - pointer to ctx->processor.regs, guest register x is at [rbx + 4*x]
+    r12 - pointer to ctx->memory, lw and sw hit its last page cache inline
+    r13 - pointer to the remaining step budget
+    eax - next guest pc when leaving native code
+
+Every block starts with the budget check and charges its instructions in bulk.
+Block exits with a static target are patched into direct jumps once the target
+is translated, so hot loops run without returning to jit_run().
+*/
+
+typedef word (*jit_entry)(word *regs, uquad *budget, uchar *code);
+
+// exit slot waiting for its target to be translated
+typedef struct _jit_exit {
+    uchar *slot;
+    int next;
+} s_jit_exit;
+
+// translator state, one per simulator context
+typedef struct _jit {
+    s_sim_context *ctx;
+    uchar *buffer;
+    uchar *ptr;
+    uchar *epilogue;
+    jit_entry enter;
+    uchar **code;           // native code of the block starting at pc
+    int *length;            // number of guest instructions in that block
+    int *heat;              // entry counters for cold blocks, -1 if the block can't be translated
+    int *exit_head;         // list of unpatched exits per target pc
+    s_jit_exit *exits;
+    int exit_count;
+    int exit_capacity;
+} s_jit;
+
+void emit8(s_jit *jit, uchar b) {
+    *jit->ptr++ = b;
+}
+
+void emit32(s_jit *jit, uword w) {
+    memcpy(jit->ptr, &w, 4);
+    jit->ptr += 4;
+}
+
+void emit64(s_jit *jit, uquad q) {
+    memcpy(jit->ptr, &q, 8);
+    jit->ptr += 8;
+}
+
+// op r32, [rbx + 4*reg]
+void emit_reg_op(s_jit *jit, uchar opcode, uchar host_reg, uchar reg) {
+    emit8(jit, opcode);
+    emit8(jit, 0x80 | (host_reg << 3) | 3);
+    emit32(jit, 4 * reg);
+}
+
+void emit_load_reg(s_jit *jit, uchar reg) {
+    emit_reg_op(jit, 0x8b, 0, reg);       // mov eax, [rbx + 4*reg]
+}
+
+void emit_store_reg(s_jit *jit, uchar reg) {
+    emit_reg_op(jit, 0x89, 0, reg);       // mov [rbx + 4*reg], eax
+}
+
+void patch_rel32(uchar *at, uchar *target) {
+    word rel = target - (at + 4);
+    memcpy(at, &rel, 4);
+}
+
+// mov eax, pc; jmp epilogue - patched into jmp <block> once the block exists
+void emit_exit(s_jit *jit, word pc) {
+    uchar *slot = jit->ptr;
+    if (jit->code[pc] != NULL) {
+        emit8(jit, 0xe9);
+        emit32(jit, 0);
+        patch_rel32(slot + 1, jit->code[pc]);
+        return;
+    }
+    emit8(jit, 0xb8);
+    emit32(jit, pc);
+    emit8(jit, 0xe9);
+    emit32(jit, 0);
+    patch_rel32(jit->ptr - 4, jit->epilogue);
+    if (jit->exit_count == jit->exit_capacity) {
+        jit->exit_capacity = jit->exit_capacity ? 2 * jit->exit_capacity : 256;
+        jit->exits = realloc(jit->exits, jit->exit_capacity * sizeof(s_jit_exit));
+        if (jit->exits == NULL) {
+            simerror("jit: out of memory");
+        }
+    }
+    jit->exits[jit->exit_count].slot = slot;
+    jit->exits[jit->exit_count].next = jit->exit_head[pc];
+    jit->exit_head[pc] = jit->exit_count++;
+}
+
+// called from native code for lw and sw on a page cache miss, reports errors exactly like step()
+word *jit_memory(s_sim_context *ctx, uword reg, word offset) {
+    return get_memory(ctx, reg, offset);
+}
+
+void patch_rel8(uchar *at, uchar *target) {
+    *at = target - (at + 1);
+}
+
+// leaves host address of the guest word in rax
+void emit_memory_address(s_jit *jit, uchar reg, word offset) {
+    uchar *slow, *miss, *done;
+    emit_load_reg(jit, reg);
+    emit8(jit, 0x05); emit32(jit, offset);                                     // add eax, offset
+    emit8(jit, 0xa8); emit8(jit, 0x03);                                        // test al, 3
+    emit8(jit, 0x75); emit8(jit, 0);                                           // jnz slow
+    slow = jit->ptr - 1;
+    emit8(jit, 0x89); emit8(jit, 0xc1);                                        // mov ecx, eax
+    emit8(jit, 0x81); emit8(jit, 0xe1); emit32(jit, ~PAGE_OFFSET_MASK);        // and ecx, ~PAGE_OFFSET_MASK
+    emit8(jit, 0x41); emit8(jit, 0x3b); emit8(jit, 0x8c); emit8(jit, 0x24);    // cmp ecx, [r12 + last_base]
+    emit32(jit, offsetof(s_memory, last_base));
+    emit8(jit, 0x75); emit8(jit, 0);                                           // jne slow
+    miss = jit->ptr - 1;
+    emit8(jit, 0x25); emit32(jit, PAGE_OFFSET_MASK);                           // and eax, PAGE_OFFSET_MASK
+    emit8(jit, 0x49); emit8(jit, 0x03); emit8(jit, 0x84); emit8(jit, 0x24);    // add rax, [r12 + last_page]
+    emit32(jit, offsetof(s_memory, last_page));
+    emit8(jit, 0xeb); emit8(jit, 0);                                           // jmp done
+    done = jit->ptr - 1;
+    patch_rel8(slow, jit->ptr);
+    patch_rel8(miss, jit->ptr);
+    emit8(jit, 0x48); emit8(jit, 0xbf); emit64(jit, (uquad) jit->ctx);         // mov rdi, ctx
+    emit8(jit, 0xbe); emit32(jit, reg);                                        // mov esi, reg
+    emit8(jit, 0xba); emit32(jit, offset);                                     // mov edx, offset
+    emit8(jit, 0x48); emit8(jit, 0xb8); emit64(jit, (uquad) jit_memory);       // mov rax, jit_memory
+    emit8(jit, 0xff); emit8(jit, 0xd0);                                        // call rax
+    patch_rel8(done, jit->ptr);
+}
+
+int jit_can_translate(const s_instruction *ins) {
+    switch (ins->instruction_type) {
+        case INS_JAL: case INS_RET: case INS_J:
+        case INS_BGE: case INS_BLE: case INS_BGT: case INS_BLT: case INS_BEQ: case INS_BNE:
+        case INS_ADD: case INS_ADDI: case INS_SUB: case INS_MV: case INS_LW: case INS_SW: case INS_LI:
+        case INS_SLLI: case INS_SRLI: case INS_SRAI:
+        case INS_MUL: case INS_MULH: case INS_MULHSU: case INS_MULHU: case INS_DIV: case INS_DIVU: case INS_REM: case INS_REMU:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+uchar branch_condition(const s_instruction *ins) {
+    int is_signed = ins->sign_type == SIGNED_TYPE;
+    switch (ins->instruction_type) {
+        case INS_BGE: return is_signed ? 0x8d : 0x83;    // jge / jae
+        case INS_BLE: return is_signed ? 0x8e : 0x86;    // jle / jbe
+        case INS_BGT: return is_signed ? 0x8f : 0x87;    // jg  / ja
+        case INS_BLT: return is_signed ? 0x8c : 0x82;    // jl  / jb
+        case INS_BEQ: return 0x84;                       // je
+        default:      return 0x85;                       // jne
+    }
+}
+
+void emit_instruction(s_jit *jit, const s_instruction *ins, word pc) {
+    uchar *taken;
+    switch (ins->instruction_type) {
+        case INS_JAL:
+            emit8(jit, 0xc7); emit8(jit, 0x83); emit32(jit, 4 * RETURN_ADDRESS_REG); emit32(jit, pc + 1);
+            emit_exit(jit, ins->destination.data);
+            break;
+        case INS_J:
+            emit_exit(jit, ins->destination.data);
+            break;
+        case INS_RET:
+            emit_load_reg(jit, RETURN_ADDRESS_REG);
+            emit8(jit, 0xe9); emit32(jit, 0);
+            patch_rel32(jit->ptr - 4, jit->epilogue);
+            break;
+        case INS_BGE: case INS_BLE: case INS_BGT: case INS_BLT: case INS_BEQ: case INS_BNE:
+            emit_load_reg(jit, ins->source1.register_index);
+            emit_reg_op(jit, 0x3b, 0, ins->source2.register_index);    // cmp eax, [rbx + 4*rs2]
+            emit8(jit, 0x0f); emit8(jit, branch_condition(ins)); emit32(jit, 0);
+            taken = jit->ptr;
+            emit_exit(jit, pc + 1);
+            patch_rel32(taken - 4, jit->ptr);
+            emit_exit(jit, ins->destination.data);
+            break;
+        case INS_ADD:
+        case INS_SUB:
+            emit_load_reg(jit, ins->source1.register_index);
+            emit_reg_op(jit, ins->instruction_type == INS_ADD ? 0x03 : 0x2b, 0, ins->source2.register_index);
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_ADDI:
+            emit_load_reg(jit, ins->source1.register_index);
+            emit8(jit, 0x05); emit32(jit, ins->source2.data);               // add eax, imm32
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_MV:
+            emit_load_reg(jit, ins->source1.register_index);
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_LI:
+            emit8(jit, 0xc7); emit8(jit, 0x83); emit32(jit, 4 * ins->destination.register_index); emit32(jit, ins->source1.data);
+            break;
+        case INS_SLLI:
+        case INS_SRLI:
+        case INS_SRAI:
+            emit_load_reg(jit, ins->source1.register_index);
+            emit8(jit, 0xc1);                                          // shl / shr / sar eax, imm8
+            emit8(jit, ins->instruction_type == INS_SLLI ? 0xe0 : ins->instruction_type == INS_SRLI ? 0xe8 : 0xf8);
+            emit8(jit, ins->source2.data);
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_MUL:
+            emit_load_reg(jit, ins->source1.register_index);
+            emit8(jit, 0x0f); emit_reg_op(jit, 0xaf, 0, ins->source2.register_index);    // imul eax, [rbx + 4*rs2]
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_MULH: case INS_MULHSU: case INS_MULHU:
+        case INS_DIV: case INS_DIVU: case INS_REM: case INS_REMU:
+            // division by zero and overflow are handled by muldiv()
+            emit8(jit, 0xbf); emit32(jit, ins->instruction_type);               // mov edi, ins_type
+            emit_reg_op(jit, 0x8b, 6, ins->source1.register_index);             // mov esi, [rbx + 4*rs1]
+            emit_reg_op(jit, 0x8b, 2, ins->source2.register_index);             // mov edx, [rbx + 4*rs2]
+            emit8(jit, 0x48); emit8(jit, 0xb8); emit64(jit, (uquad) muldiv);    // mov rax, muldiv
+            emit8(jit, 0xff); emit8(jit, 0xd0);                                 // call rax
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_LW:
+            emit_memory_address(jit, ins->source1.register_index, ins->source1.data);
+            emit8(jit, 0x8b); emit8(jit, 0x00);                             // mov eax, [rax]
+            emit_store_reg(jit, ins->destination.register_index);
+            break;
+        case INS_SW:
+            emit_memory_address(jit, ins->destination.register_index, ins->destination.data);
+            emit_reg_op(jit, 0x8b, 1, ins->source1.register_index);    // mov ecx, [rbx + 4*rs]
+            emit8(jit, 0x89); emit8(jit, 0x08);                        // mov [rax], ecx
+            break;
+    }
+}
+
+void jit_init(s_sim_context *ctx) {
+    int length = ctx->program_image.text_length;
+    int i;
+    s_jit *jit = calloc(1, sizeof(s_jit));
+    if (jit == NULL) {
+        simerror("jit: out of memory");
+    }
+    jit->ctx = ctx;
+    ctx->jit = jit;
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    jit->code = calloc(length, sizeof(uchar *));
+    jit->length = calloc(length, sizeof(int));
+    jit->heat = calloc(length, sizeof(int));
+    jit->exit_head = malloc(length * sizeof(int));
+    if (jit->code == NULL || jit->length == NULL || jit->heat == NULL || jit->exit_head == NULL) {
+        simerror("jit: out of memory");
+    }
+    for (i = 0; i < length; i++) {
+        jit->exit_head[i] = -1;
+    }
+    if (jit->buffer == MAP_FAILED) {
+        // no executable memory, everything runs in the interpreter
+        jit->buffer = NULL;
+        for (i = 0; i < length; i++) {
+            jit->heat[i] = -1;
+        }
+        return;
+    }
+    jit->ptr = jit->buffer;
+    // entry: save callee saved registers, keep the stack 16 byte aligned for helper calls
+    jit->enter = (jit_entry) jit->ptr;
+    emit8(jit, 0x53);                                                          // push rbx
+    emit8(jit, 0x41); emit8(jit, 0x54);                                        // push r12
+    emit8(jit, 0x41); emit8(jit, 0x55);                                        // push r13
+    emit8(jit, 0x55);                                                          // push rbp
+    emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0xec); emit8(jit, 0x08);    // sub rsp, 8
+    emit8(jit, 0x48); emit8(jit, 0x89); emit8(jit, 0xfb);                      // mov rbx, rdi
+    emit8(jit, 0x49); emit8(jit, 0x89); emit8(jit, 0xf5);                      // mov r13, rsi
+    emit8(jit, 0x49); emit8(jit, 0xbc); emit64(jit, (uquad) &ctx->memory);     // mov r12, &ctx->memory
+    emit8(jit, 0xff); emit8(jit, 0xe2);                                        // jmp rdx
+    jit->epilogue = jit->ptr;
+    emit8(jit, 0x48); emit8(jit, 0x83); emit8(jit, 0xc4); emit8(jit, 0x08);    // add rsp, 8
+    emit8(jit, 0x5d);                                                          // pop rbp
+    emit8(jit, 0x41); emit8(jit, 0x5d);                                        // pop r13
+    emit8(jit, 0x41); emit8(jit, 0x5c);                                        // pop r12
+    emit8(jit, 0x5b);                                                          // pop rbx
+    emit8(jit, 0xc3);                                                          // ret
+}
+
+// translates the longest translatable prefix of the basic block starting at pc
+void jit_compile(s_jit *jit, word pc) {
+    const s_instruction *text = jit->ctx->program_image.text;
+    int block_length = jit->ctx->program_image.block_length[pc];
+    int length = 0;
+    int exit;
+    uchar *too_few_steps;
+
+    while (length < block_length && jit_can_translate(&text[pc + length])) {
+        length++;
+    }
+    // worst case is a memory access with its page cache check
+    if (length == 0 || jit->ptr + 128 * (length + 2) > jit->buffer + JIT_BUFFER_SIZE) {
+        jit->heat[pc] = -1;
+        return;
+    }
+    jit->code[pc] = jit->ptr;
+    jit->length[pc] = length;
+    // cmp qword [r13], length; jb <leave without charging>; sub qword [r13], length
+    emit8(jit, 0x49); emit8(jit, 0x81); emit8(jit, 0x7d); emit8(jit, 0x00); emit32(jit, length);
+    emit8(jit, 0x0f); emit8(jit, 0x82); emit32(jit, 0);
+    too_few_steps = jit->ptr;
+    emit8(jit, 0x49); emit8(jit, 0x81); emit8(jit, 0x6d); emit8(jit, 0x00); emit32(jit, length);
+    int i;
+    for (i = 0; i < length; i++) {
+        emit_instruction(jit, &text[pc + i], pc + i);
+    }
+    if (!is_block_end(text[pc + length - 1].instruction_type)) {
+        // the rest of the block is left to the interpreter
+        emit_exit(jit, pc + length);
+    }
+    patch_rel32(too_few_steps - 4, jit->ptr);
+    emit8(jit, 0xb8); emit32(jit, pc);
+    emit8(jit, 0xe9); emit32(jit, 0);
+    patch_rel32(jit->ptr - 4, jit->epilogue);
+    // chain all exits that were waiting for this block
+    for (exit = jit->exit_head[pc]; exit != -1; exit = jit->exits[exit].next) {
+        uchar *slot = jit->exits[exit].slot;
+        slot[0] = 0xe9;
+        patch_rel32(slot + 1, jit->code[pc]);
+    }
+    jit->exit_head[pc] = -1;
+}
+
+uquad jit_run(s_sim_context *ctx, uquad budget) {
+    uquad remaining = budget;
+    int i, length;
+    s_jit *jit;
+
+#if defined(__x86_64__)
+    if (ctx->jit == NULL) {
+        jit_init(ctx);
+    }
+#endif
+    jit = ctx->jit;
+    while (remaining > 0 && !ctx->processor.done) {
+        word pc = ctx->processor.pc;
+        if (pc < 0 || pc >= ctx->program_image.text_length) {
+            step(ctx);
+        }
+#if defined(__x86_64__)
+        if (jit->code[pc] == NULL && jit->heat[pc] >= 0 && ++jit->heat[pc] >= JIT_THRESHOLD) {
+            jit_compile(jit, pc);
+        }
+        if (jit->code[pc] != NULL && remaining >= (uquad) jit->length[pc]) {
+            ctx->processor.pc = jit->enter(ctx->processor.regs, &remaining, jit->code[pc]);
+            continue;
+        }
+#endif
+        // cold code runs in the interpreter, one basic block at a time
+        length = ctx->program_image.block_length[pc];
+        if ((uquad) length > remaining) {
+            length = 1;
+        }
+        for (i = 0; i < length; i++) {
+            ctx->run_executed = budget - remaining + i;
+            step(ctx);
+        }
+        remaining -= length;
+    }
+    return budget - remaining;
+}
+
+void jit_free(s_sim_context *ctx) {
+    s_jit *jit = ctx->jit;
+    if (jit == NULL) {
+        return;
+    }
+    if (jit->buffer != NULL) {
+        munmap(jit->buffer, JIT_BUFFER_SIZE);
+    }
+    free(jit->code);
+    free(jit->length);
+    free(jit->heat);
+    free(jit->exit_head);
+    free(jit->exits);
+    free(jit);
+    ctx->jit = NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "defs.h"
+#include "riscv_simulator.h"
+
+// number of entries after which a block is translated to native code
+#define JIT_THRESHOLD            16
+// size of the executable code buffer
+#define JIT_BUFFER_SIZE          (16 * 1024 * 1024)
+
+/*******************
+* Functions
+*******************/
+
+// runs at most budget instructions (or until nop), hot blocks are translated to x86-64 code,
+// everything else is executed by step(); returns number of executed instructions
+uquad jit_run(s_sim_context *ctx, uquad budget);
+
+// releases the code buffer and the translator state of the context
+void jit_free(s_sim_context *ctx);
+
+#endif
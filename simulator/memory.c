@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+void memory_init(s_memory *memory) {
+    memory->directory = calloc(PAGE_TABLE_LENGTH, sizeof(word **));
+    if (memory->directory == NULL) {
+        simerror("memory_init: out of memory");
+    }
+    memory->shared = FALSE;
+    memory->last_base = NO_PAGE;
+    memory->last_page = NULL;
+    memory->watch_count = 0;
+    memory->watch_hit = FALSE;
+    memory->dirty = NULL;
+    memory->dirty_bases = NULL;
+    memory->dirty_count = 0;
+    memory->dirty_capacity = 0;
+}
+
+void memory_free(s_memory *memory) {
+    int i, j;
+    for (i = 0; !memory->shared && memory->directory != NULL && i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; memory->directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            free(memory->directory[i][j]);
+        }
+        free(memory->directory[i]);
+    }
+    if (!memory->shared) {
+        free(memory->directory);
+    }
+    memory->directory = NULL;
+    memory->last_base = NO_PAGE;
+    memory->last_page = NULL;
+    free(memory->dirty);
+    free(memory->dirty_bases);
+    memory->dirty = NULL;
+    memory->dirty_bases = NULL;
+}
+
+void memory_share(s_memory *memory, s_memory *owner) {
+    memory_free(memory);
+    memory->directory = owner->directory;
+    memory->shared = TRUE;
+}
+
+// returns the entry, or stores the new allocation there if it is still empty
+void *publish(void **entry, size_t size) {
+    void *current = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+    void *allocated;
+    if (current != NULL) {
+        return current;
+    }
+    allocated = calloc(1, size);
+    if (allocated == NULL) {
+        simerror("memory_page: out of memory");
+    }
+    if (__atomic_compare_exchange_n(entry, &current, allocated, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return allocated;
+    }
+    // another hart was faster
+    free(allocated);
+    return current;
+}
+
+int is_watched_page(s_memory *memory, uword address) {
+    int i;
+    for (i = 0; i < memory->watch_count; i++) {
+        if ((memory->watched[i] & ~PAGE_OFFSET_MASK) == (address & ~PAGE_OFFSET_MASK)) return TRUE;
+    }
+    return FALSE;
+}
+
+void mark_dirty(s_memory *memory, uword address) {
+    if (memory->dirty[address >> PAGE_SHIFT]) {
+        return;
+    }
+    memory->dirty[address >> PAGE_SHIFT] = TRUE;
+    memory->dirty_bases = grow_array(memory->dirty_bases, &memory->dirty_capacity, memory->dirty_count + 1, sizeof(uword));
+    memory->dirty_bases[memory->dirty_count++] = address & ~PAGE_OFFSET_MASK;
+}
+
+word *memory_page(s_memory *memory, uword address) {
+    uword directory_index = address >> (PAGE_SHIFT + PAGE_TABLE_BITS);
+    uword table_index = (address >> PAGE_SHIFT) & (PAGE_TABLE_LENGTH - 1);
+    word **table = publish((void **) &memory->directory[directory_index], PAGE_TABLE_LENGTH * sizeof(word *));
+    word *page = publish((void **) &table[table_index], PAGE_SIZE);
+    // the page can be written through the cache from now on
+    if (memory->dirty != NULL) {
+        mark_dirty(memory, address);
+    }
+    if (memory->watch_count == 0 || !is_watched_page(memory, address)) {
+        memory->last_base = address & ~PAGE_OFFSET_MASK;
+        memory->last_page = page;
+    }
+    return page;
+}
+
+word *memory_store_page(s_memory *memory, uword address) {
+    word *page = memory_page(memory, address);
+    int i;
+    for (i = 0; i < memory->watch_count; i++) {
+        if (memory->watched[i] == address) {
+            memory->watch_hit = TRUE;
+            memory->watch_address = address;
+            memory->watch_old = page[(address & PAGE_OFFSET_MASK) >> 2];
+        }
+    }
+    return page;
+}
+
+void memory_track_dirty(s_memory *memory) {
+    int i, j;
+    memory->dirty = calloc((size_t) PAGE_TABLE_LENGTH * PAGE_TABLE_LENGTH, 1);
+    if (memory->dirty == NULL) {
+        simerror("memory_track_dirty: out of memory");
+    }
+    for (i = 0; i < PAGE_TABLE_LENGTH; i++) {
+        for (j = 0; memory->directory[i] != NULL && j < PAGE_TABLE_LENGTH; j++) {
+            if (memory->directory[i][j] != NULL) {
+                mark_dirty(memory, (uword) i << (PAGE_SHIFT + PAGE_TABLE_BITS) | (uword) j << PAGE_SHIFT);
+            }
+        }
+    }
+}
+
+void memory_clear_dirty(s_memory *memory) {
+    int i;
+    for (i = 0; i < memory->dirty_count; i++) {
+        memory->dirty[memory->dirty_bases[i] >> PAGE_SHIFT] = FALSE;
+    }
+    memory->dirty_count = 0;
+    // a cached page would be written without being marked
+    memory->last_base = NO_PAGE;
+}
+
+word *memory_find_page(s_memory *memory, uword address) {
+    word **table = memory->directory[address >> (PAGE_SHIFT + PAGE_TABLE_BITS)];
+    if (table == NULL) {
+        return NULL;
+    }
+    return table[(address >> PAGE_SHIFT) & (PAGE_TABLE_LENGTH - 1)];
+}
+
+word memory_peek(s_memory *memory, uword address) {
+    word *page = memory_find_page(memory, address);
+    if (page == NULL) {
+        return 0;
+    }
+    return page[(address & PAGE_OFFSET_MASK) >> 2];
+}
+
+void memory_store_bytes(s_memory *memory, uword address, const uchar *bytes, uword length) {
+    uword i = 0, n;
+    uchar *target;
+    // a word at a time, so a watched word is seen once with its value before the copy
+    while (i < length) {
+        target = (uchar *) memory_store_word(memory, address & ~3);
+        n = 4 - (address & 3) < length - i ? 4 - (address & 3) : length - i;
+        memcpy(target + (address & 3), bytes + i, n);
+        i += n;
+        address += n;
+    }
+}
+
+void memory_load_bytes(s_memory *memory, uword address, uchar *bytes, uword length) {
+    uword done, n, offset;
+    word *page;
+    // a page at a time, so a long write costs one lookup per page
+    for (done = 0; done < length; done += n, address += n) {
+        offset = address & PAGE_OFFSET_MASK;
+        n = PAGE_SIZE - offset < length - done ? PAGE_SIZE - offset : length - done;
+        page = memory_find_page(memory, address);
+        if (page == NULL) {
+            memset(bytes + done, 0, n);
+        } else {
+            memcpy(bytes + done, (uchar *) page + offset, n);
+        }
+    }
+}
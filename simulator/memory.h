@@ -0,0 +1,111 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "defs.h"
+
+/*
+32-bit guest address space made of 4 KiB pages which are allocated on the first access.
+Address is split as | 10 bit directory index | 10 bit table index | 12 bit page offset |.
+Words are kept in host byte order (simulator runs on little-endian hosts).
+Pages with a watched word never enter the page cache, so only accesses to them take the slow
+path, where stores check the watched words.
+For --cosim and the history of the interactive mode a page is marked dirty when it enters the
+page cache or the store path, emptying the cache makes the next access to every page mark it again.
+The harts of --harts share the directory and have their own page caches. Tables and pages are
+published with a compare-and-swap, so harts which fault on the same page at once get one page.
+*/
+
+#define PAGE_SHIFT               12
+#define PAGE_SIZE                (1 << PAGE_SHIFT)
+#define PAGE_OFFSET_MASK         (PAGE_SIZE - 1)
+#define PAGE_WORDS               (PAGE_SIZE / 4)
+#define PAGE_TABLE_BITS          10
+#define PAGE_TABLE_LENGTH        (1 << PAGE_TABLE_BITS)
+
+// any value which is not page aligned never matches the cached page
+#define NO_PAGE                  1
+#define MAX_WATCHPOINTS          16
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _memory {
+    word ***directory;          // PAGE_TABLE_LENGTH tables
+    int shared;                 // TRUE if the directory belongs to another memory
+    // one-entry cache of the last accessed page
+    uword last_base;
+    word *last_page;
+    // watched word addresses and the last store to one of them
+    uword watched[MAX_WATCHPOINTS];
+    int watch_count;
+    int watch_hit;
+    uword watch_address;
+    word watch_old;
+    // pages accessed since the dirty marks were cleared, NULL if they are not tracked
+    uchar *dirty;
+    uword *dirty_bases;
+    int dirty_count;
+    int dirty_capacity;
+} s_memory;
+
+/*******************
+* Functions
+*******************/
+
+// initializes empty address space
+void memory_init(s_memory *memory);
+
+// releases all allocated pages
+void memory_free(s_memory *memory);
+
+// makes the memory use the pages of the owner, which has to outlive it
+void memory_share(s_memory *memory, s_memory *owner);
+
+// returns page which contains the address, allocates it if needed and caches it
+word *memory_page(s_memory *memory, uword address);
+
+// returns page which contains the address or NULL if it was never accessed
+word *memory_find_page(s_memory *memory, uword address);
+
+// returns page which contains the address for a store, records the store if it hits a watched word
+word *memory_store_page(s_memory *memory, uword address);
+
+// starts tracking dirty pages, the pages allocated so far are dirty
+void memory_track_dirty(s_memory *memory);
+
+// clears the dirty marks and empties the page cache
+void memory_clear_dirty(s_memory *memory);
+
+// reads a word without allocating pages (unmapped memory reads as 0)
+word memory_peek(s_memory *memory, uword address);
+
+// copies bytes to guest memory like stores (watched words are recorded), address doesn't have to be aligned
+void memory_store_bytes(s_memory *memory, uword address, const uchar *bytes, uword length);
+
+// copies bytes from guest memory without allocating pages, address doesn't have to be aligned
+void memory_load_bytes(s_memory *memory, uword address, uchar *bytes, uword length);
+
+// returns pointer to the word at 4 byte aligned address
+static inline word *memory_word(s_memory *memory, uword address) {
+    word *page;
+    if ((address & ~PAGE_OFFSET_MASK) == memory->last_base) {
+        page = memory->last_page;
+    } else {
+        page = memory_page(memory, address);
+    }
+    return page + ((address & PAGE_OFFSET_MASK) >> 2);
+}
+
+// returns pointer to the word at 4 byte aligned address which is about to be written
+static inline word *memory_store_word(s_memory *memory, uword address) {
+    word *page;
+    if ((address & ~PAGE_OFFSET_MASK) == memory->last_base) {
+        page = memory->last_page;
+    } else {
+        page = memory_store_page(memory, address);
+    }
+    return page + ((address & PAGE_OFFSET_MASK) >> 2);
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "pipeline.h"
+#include "predictor.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+void pipeline_init(s_sim_context *ctx, int forwarding) {
+    ctx->pipeline = calloc(1, sizeof(s_pipeline));
+    if (ctx->pipeline == NULL) {
+        simerror("pipeline_init: out of memory");
+    }
+    ctx->pipeline->forwarding = forwarding;
+}
+
+// registers read in EX, the store data register and the written register, -1 if there is none
+void operand_registers(const s_instruction *ins, int *rs1, int *rs2, int *store, int *rd) {
+    *rs1 = *rs2 = *store = *rd = -1;
+    switch (ins->instruction_type) {
+        case INS_JAL:
+            *rd = RETURN_ADDRESS_REG;
+            break;
+        case INS_RET:
+            *rs1 = RETURN_ADDRESS_REG;
+            break;
+        case INS_BGE: case INS_BLE: case INS_BGT: case INS_BLT: case INS_BEQ: case INS_BNE:
+            *rs1 = ins->source1.register_index;
+            *rs2 = ins->source2.register_index;
+            break;
+        case INS_ADD: case INS_SUB:
+        case INS_MUL: case INS_MULH: case INS_MULHSU: case INS_MULHU:
+        case INS_DIV: case INS_DIVU: case INS_REM: case INS_REMU:
+            *rd = ins->destination.register_index;
+            *rs1 = ins->source1.register_index;
+            *rs2 = ins->source2.register_index;
+            break;
+        case INS_ADDI: case INS_MV: case INS_SLLI: case INS_SRLI: case INS_SRAI: case INS_LW:
+            *rd = ins->destination.register_index;
+            *rs1 = ins->source1.register_index;
+            break;
+        case INS_SW:
+            *rs1 = ins->destination.register_index;
+            *store = ins->source1.register_index;
+            break;
+        case INS_LI:
+            *rd = ins->destination.register_index;
+            break;
+        case INS_LR:
+            *rd = ins->destination.register_index;
+            *rs1 = ins->source1.register_index;
+            break;
+        case INS_SC:
+        case INS_AMOSWAP: case INS_AMOADD: case INS_AMOXOR: case INS_AMOAND: case INS_AMOOR:
+        case INS_AMOMIN: case INS_AMOMAX: case INS_AMOMINU: case INS_AMOMAXU:
+            *rd = ins->destination.register_index;
+            *rs1 = ins->source1.register_index;
+            *store = ins->source2.register_index;
+            break;
+        case INS_CSRR:
+            *rd = ins->destination.register_index;
+            break;
+        case INS_ECALL:
+            // the system call number and the first argument, the result comes back in a0
+            *rs1 = SYSCALL_NUMBER_REG;
+            *rs2 = FUNCTION_REGISTER;
+            *rd = FUNCTION_REGISTER;
+            break;
+    }
+}
+
+// delays ex until the register can be read, remembers the cause if it is the latest operand so far
+void wait_operand(s_pipeline *pipe, int reg, int at_mem, uquad *ex, int *cause) {
+    uquad ready;
+    if (reg <= 0) {
+        return;
+    }
+    ready = pipe->ready[reg];
+    if (at_mem && pipe->forwarded[reg] && ready > 0) {
+        ready--;
+    }
+    if (ready > *ex) {
+        *ex = ready;
+        *cause = pipe->loaded[reg] ? STALL_LOAD_USE : STALL_DATA;
+    }
+}
+
+void pipeline_account(s_sim_context *ctx, int pc) {
+    s_pipeline *pipe = ctx->pipeline;
+    const s_instruction *ins = &ctx->program_image.text[pc];
+    int rs1, rs2, store, rd, cause = -1;
+    uquad issue, ex;
+    operand_registers(ins, &rs1, &rs2, &store, &rd);
+
+    if (pipe->instructions == 0) {
+        issue = PIPELINE_FIRST_EX;
+    } else {
+        issue = pipe->last_ex + 1 + pipe->flush;
+        pipe->stalls[pipe->flush_cause] += pipe->flush;
+    }
+    ex = issue;
+    wait_operand(pipe, rs1, FALSE, &ex, &cause);
+    wait_operand(pipe, rs2, FALSE, &ex, &cause);
+    // store data is needed in MEM, but without forwarding it is read from the register file in ID
+    wait_operand(pipe, store, TRUE, &ex, &cause);
+    if (cause >= 0) {
+        pipe->stalls[cause] += ex - issue;
+    }
+
+    if (rd > 0) {
+        // the result of an atomic comes from memory as well
+        int load = ins->instruction_type == INS_LW || is_atomic(ins->instruction_type);
+        // the result leaves EX (or MEM for lw) a cycle later, without forwarding it is read in ID after WB
+        pipe->forwarded[rd] = pipe->forwarding == FORWARD_FULL || (pipe->forwarding == FORWARD_ALU && !load);
+        pipe->ready[rd] = pipe->forwarded[rd] ? ex + 1 + load : ex + 3;
+        pipe->loaded[rd] = load;
+    }
+
+    pipe->flush = 0;
+    switch (ins->instruction_type) {
+        case INS_JAL: case INS_J:
+            pipe->flush = JUMP_FLUSH_PENALTY;
+            pipe->flush_cause = STALL_JUMP;
+            break;
+        case INS_RET:
+            if (ctx->predictor == NULL || ctx->predictor->mispredicted) {
+                pipe->flush = RET_FLUSH_PENALTY;
+                pipe->flush_cause = STALL_JUMP;
+            }
+            break;
+        case INS_BGE: case INS_BLE: case INS_BGT: case INS_BLT: case INS_BEQ: case INS_BNE:
+            if (ctx->predictor != NULL ? ctx->predictor->mispredicted : ctx->processor.pc != pc + 1) {
+                pipe->flush = BRANCH_FLUSH_PENALTY;
+                pipe->flush_cause = STALL_BRANCH;
+            }
+            break;
+    }
+    pipe->last_ex = ex;
+    pipe->instructions++;
+}
+
+void print_pipeline(s_sim_context *ctx, FILE *out) {
+    s_pipeline *pipe = ctx->pipeline;
+    uquad cycles = pipe->instructions > 0 ? pipe->last_ex + PIPELINE_EX_TO_WB : 0;
+    int i;
+    fprintf(out, "\n### Pipeline (forwarding: %s) ###\n", forwarding_names[pipe->forwarding]);
+    fprintf(out, "Instructions:  %llu\n", (unsigned long long) pipe->instructions);
+    fprintf(out, "Cycles:        %llu\n", (unsigned long long) cycles);
+    fprintf(out, "CPI:           %.3f\n", pipe->instructions > 0 ? (double) cycles / pipe->instructions : 0.0);
+    fprintf(out, "Stall cycles:\n");
+    for (i = 0; i < STALL_NUMBER; i++) {
+        fprintf(out, "  %-14s %12llu %6.2f%%\n", stall_names[i], (unsigned long long) pipe->stalls[i],
+                cycles > 0 ? 100.0 * pipe->stalls[i] / cycles : 0.0);
+    }
+    if (pipe->instructions > 0) {
+        fprintf(out, "  %-14s %12d %6.2f%%\n", "pipeline fill", PIPELINE_FIRST_EX + PIPELINE_EX_TO_WB - 1,
+                100.0 * (PIPELINE_FIRST_EX + PIPELINE_EX_TO_WB - 1) / cycles);
+    }
+}
+
+void pipeline_free(s_sim_context *ctx) {
+    free(ctx->pipeline);
+    ctx->pipeline = NULL;
+}
@@ -0,0 +1,70 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Timing model of a classic in-order IF/ID/EX/MEM/WB pipeline, driven by the executed instructions.
+For every instruction only the cycle in which it enters EX is tracked: the first instruction
+reaches EX in cycle 3 and every following one a cycle later, unless it waits for an operand
+or for the fetch of its own address after a control transfer. The run ends with the WB of
+the last instruction, two cycles after its EX.
+
+Operands are needed at the start of EX (store data at the start of MEM, if it can be forwarded).
+The register file is written in the first and read in the second half of a cycle.
+Branches are predicted not taken and resolved in EX, jumps are resolved in ID and ret in EX.
+With --predictor branches and ret are predicted by it (targets are assumed to come from a BTB),
+so only mispredictions flush the pipeline.
+*/
+
+// forwarding setups (--pipeline=none|alu|full)
+enum forwarding_types { FORWARD_NONE = 0, FORWARD_ALU, FORWARD_FULL };
+
+static char *forwarding_names[] = { "none", "alu", "full" };
+
+// stall causes in the report
+enum stall_types { STALL_LOAD_USE = 0, STALL_DATA, STALL_BRANCH, STALL_JUMP, STALL_NUMBER };
+
+static char *stall_names[] = { "load-use", "data hazard", "branch flush", "jump flush" };
+
+#define PIPELINE_FIRST_EX        3
+#define PIPELINE_EX_TO_WB        2
+#define BRANCH_FLUSH_PENALTY     2
+#define JUMP_FLUSH_PENALTY       1
+#define RET_FLUSH_PENALTY        2
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _pipeline {
+    int forwarding;
+    uquad instructions;
+    uquad last_ex;                      // EX cycle of the previous instruction
+    int flush;                          // fetch bubbles caused by the previous instruction
+    int flush_cause;
+    uquad ready[RV32I_REG_NUM];         // first EX cycle which can use the last value written to the register
+    uchar forwarded[RV32I_REG_NUM];     // TRUE if that value is forwarded, so stores can take it a cycle later
+    uchar loaded[RV32I_REG_NUM];        // TRUE if that value comes from lw
+    uquad stalls[STALL_NUMBER];
+} s_pipeline;
+
+/*******************
+* Functions
+*******************/
+
+// turns on the timing model with the given forwarding setup
+void pipeline_init(s_sim_context *ctx, int forwarding);
+
+// advances the timing model by the instruction at pc, which step() has just executed
+void pipeline_account(s_sim_context *ctx, int pc);
+
+// prints cycles, CPI and stall cycles per cause
+void print_pipeline(s_sim_context *ctx, FILE *out);
+
+// releases the timing model of the context
+void pipeline_free(s_sim_context *ctx);
+
+#endif
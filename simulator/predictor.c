@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "predictor.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+s_predictor *predictor_create(s_sim_context *ctx, const char *config) {
+    s_predictor *predictor = calloc(1, sizeof(s_predictor));
+    size_t name_length = strcspn(config, ":");
+    char *end;
+    int i;
+    if (predictor == NULL) {
+        simerror("predictor_create: out of memory");
+    }
+    predictor->type = -1;
+    for (i = 0; i < PREDICT_NUMBER; i++) {
+        if (strlen(predictor_names[i]) == name_length && strncmp(config, predictor_names[i], name_length) == 0) {
+            predictor->type = i;
+        }
+    }
+    predictor->bits = PREDICTOR_DEFAULT_BITS;
+    if (config[name_length] == ':') {
+        predictor->bits = strtol(config + name_length + 1, &end, 10);
+        if (config[name_length + 1] == 0 || *end != 0) predictor->bits = -1;
+    }
+    if (predictor->type < 0 || predictor->bits < 1 || predictor->bits > PREDICTOR_MAX_BITS) {
+        argerror("Invalid predictor %s (expected btfn|bimodal|gshare|tournament[:bits], bits 1..%d)", config, PREDICTOR_MAX_BITS);
+    }
+    predictor->mask = (1u << predictor->bits) - 1;
+    // counters start weakly not taken, the chooser weakly prefers bimodal
+    predictor->bimodal = malloc(predictor->mask + 1);
+    predictor->gshare = malloc(predictor->mask + 1);
+    predictor->chooser = malloc(predictor->mask + 1);
+    predictor->executed = calloc(ctx->program_image.text_length + 1, sizeof(uquad));
+    predictor->misses = calloc(ctx->program_image.text_length + 1, sizeof(uquad));
+    if (predictor->bimodal == NULL || predictor->gshare == NULL || predictor->chooser == NULL
+            || predictor->executed == NULL || predictor->misses == NULL) {
+        simerror("predictor_create: out of memory");
+    }
+    memset(predictor->bimodal, 1, predictor->mask + 1);
+    memset(predictor->gshare, 1, predictor->mask + 1);
+    memset(predictor->chooser, 1, predictor->mask + 1);
+    return predictor;
+}
+
+void update_counter(uchar *counter, int taken) {
+    if (taken && *counter < 3) (*counter)++;
+    if (!taken && *counter > 0) (*counter)--;
+}
+
+// returns the predicted direction of the branch at pc and trains the tables with the real one
+int predict_branch(s_predictor *predictor, const s_instruction *ins, int pc, int taken) {
+    uchar *bimodal = &predictor->bimodal[pc & predictor->mask];
+    uchar *gshare = &predictor->gshare[(pc ^ predictor->history) & predictor->mask];
+    uchar *chooser = &predictor->chooser[pc & predictor->mask];
+    int bimodal_taken = *bimodal >= 2;
+    int gshare_taken = *gshare >= 2;
+    int prediction;
+    switch (predictor->type) {
+        case PREDICT_BTFN:
+            // backward branches close loops
+            prediction = ins->destination.data <= pc;
+            break;
+        case PREDICT_BIMODAL:
+            prediction = bimodal_taken;
+            break;
+        case PREDICT_GSHARE:
+            prediction = gshare_taken;
+            break;
+        default:
+            prediction = *chooser >= 2 ? gshare_taken : bimodal_taken;
+            if (bimodal_taken != gshare_taken) update_counter(chooser, gshare_taken == taken);
+            break;
+    }
+    update_counter(bimodal, taken);
+    update_counter(gshare, taken);
+    predictor->history = ((predictor->history << 1) | taken) & predictor->mask;
+    return prediction;
+}
+
+void predictor_account(s_sim_context *ctx, int pc) {
+    s_predictor *predictor = ctx->predictor;
+    const s_instruction *ins = &ctx->program_image.text[pc];
+    int taken, target;
+    switch (ins->instruction_type) {
+        case INS_BGE: case INS_BLE: case INS_BGT: case INS_BLT: case INS_BEQ: case INS_BNE:
+            taken = ctx->processor.pc != pc + 1;
+            predictor->mispredicted = predict_branch(predictor, ins, pc, taken) != taken;
+            predictor->branches++;
+            predictor->branch_misses += predictor->mispredicted;
+            predictor->executed[pc]++;
+            predictor->misses[pc] += predictor->mispredicted;
+            break;
+        case INS_JAL:
+            predictor->ras_top = (predictor->ras_top + 1) % RAS_DEPTH;
+            predictor->ras[predictor->ras_top] = pc + 1;
+            if (predictor->ras_count < RAS_DEPTH) predictor->ras_count++;
+            break;
+        case INS_RET:
+            target = -1;
+            if (predictor->ras_count > 0) {
+                target = predictor->ras[predictor->ras_top];
+                predictor->ras_top = (predictor->ras_top + RAS_DEPTH - 1) % RAS_DEPTH;
+                predictor->ras_count--;
+            }
+            predictor->mispredicted = target != ctx->processor.pc;
+            predictor->returns++;
+            predictor->return_misses += predictor->mispredicted;
+            predictor->executed[pc]++;
+            predictor->misses[pc] += predictor->mispredicted;
+            break;
+    }
+}
+
+double misprediction_rate(uquad misses, uquad executed) {
+    return executed > 0 ? 100.0 * misses / executed : 0.0;
+}
+
+// sort order of the branches, the most mispredictions first
+s_predictor *sort_predictor;
+
+int compare_mispredictions(const void *a, const void *b) {
+    int i = *(const int *) a, j = *(const int *) b;
+    if (sort_predictor->misses[i] != sort_predictor->misses[j]) {
+        return sort_predictor->misses[i] < sort_predictor->misses[j] ? 1 : -1;
+    }
+    return i - j;
+}
+
+void print_predictor(s_sim_context *ctx, FILE *out) {
+    static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+    s_predictor *predictor = ctx->predictor;
+    int length = ctx->program_image.text_length;
+    int *order = calloc(length + 1, sizeof(int));
+    const char **lines = calloc(length + 1, sizeof(char *));
+    const char **labels = calloc(length + 1, sizeof(char *));
+    char line_buffer[CHAR_BUFFER_LENGTH], label_buffer[CHAR_BUFFER_LENGTH];
+    int i, count = 0;
+    if (order == NULL || lines == NULL || labels == NULL) {
+        simerror("print_predictor: out of memory");
+    }
+    if (predictor->type == PREDICT_BTFN) {
+        fprintf(out, "\n### Branch predictor: btfn, %d entry return address stack ###\n", RAS_DEPTH);
+    } else {
+        fprintf(out, "\n### Branch predictor: %s, %u entries, %d entry return address stack ###\n",
+                predictor_names[predictor->type], predictor->mask + 1, RAS_DEPTH);
+    }
+    fprintf(out, "%-8s %14s %14s %10s\n", "", "Executed", "Mispredicted", "Rate");
+    fprintf(out, "%-8s %14llu %14llu %9.2f%%\n", "branches", (unsigned long long) predictor->branches,
+            (unsigned long long) predictor->branch_misses, misprediction_rate(predictor->branch_misses, predictor->branches));
+    fprintf(out, "%-8s %14llu %14llu %9.2f%%\n", "returns", (unsigned long long) predictor->returns,
+            (unsigned long long) predictor->return_misses, misprediction_rate(predictor->return_misses, predictor->returns));
+
+    for (i = 0; i < length; i++) {
+        if (predictor->misses[i] != 0) order[count++] = i;
+    }
+    pthread_mutex_lock(&sort_mutex);
+    sort_predictor = predictor;
+    qsort(order, count, sizeof(int), compare_mispredictions);
+    pthread_mutex_unlock(&sort_mutex);
+    source_lines(ctx, lines, labels);
+    if (count > 0) {
+        fprintf(out, "%14s %14s %10s %12s  %-14s %s\n", "Mispredicted", "Executed", "Rate", "Addr", "Label", "Instruction");
+    }
+    for (i = 0; i < count && i < PREDICTOR_REPORT_LINES; i++) {
+        int pc = order[i];
+        fprintf(out, "%14llu %14llu %9.2f%% [%#10x]  %-14s %s\n", (unsigned long long) predictor->misses[pc],
+                (unsigned long long) predictor->executed[pc], misprediction_rate(predictor->misses[pc], predictor->executed[pc]),
+                TEXT_SEGMENT_START + 4*pc, labels[pc] ? source_text(labels[pc], label_buffer) : "-",
+                lines[pc] ? source_text(lines[pc], line_buffer) : ins_names[ctx->program_image.text[pc].instruction_type]);
+    }
+    free(order);
+    free(lines);
+    free(labels);
+}
+
+void predictor_free(s_predictor *predictor) {
+    if (predictor == NULL) {
+        return;
+    }
+    free(predictor->bimodal);
+    free(predictor->gshare);
+    free(predictor->chooser);
+    free(predictor->executed);
+    free(predictor->misses);
+    free(predictor);
+}
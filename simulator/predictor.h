@@ -0,0 +1,65 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Branch direction predictors and a return address stack, updated with every executed branch,
+jal and ret. Tables are indexed by the text index of the branch and hold 2-bit saturating
+counters (taken if the counter is 2 or 3). The tournament predictor chooses between bimodal
+and gshare with a table of 2-bit counters, which moves towards the one that was right.
+Configuration is given as btfn|bimodal|gshare|tournament[:bits], table size is 2^bits.
+*/
+
+enum predictor_types { PREDICT_BTFN = 0, PREDICT_BIMODAL, PREDICT_GSHARE, PREDICT_TOURNAMENT, PREDICT_NUMBER };
+static char *predictor_names[] = { "btfn", "bimodal", "gshare", "tournament" };
+
+#define PREDICTOR_DEFAULT_BITS   10
+#define PREDICTOR_MAX_BITS       24
+#define RAS_DEPTH                16
+// number of branches with the most mispredictions shown in the report
+#define PREDICTOR_REPORT_LINES   20
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _predictor {
+    int type;
+    int bits;
+    uword mask;
+    uchar *bimodal;
+    uchar *gshare;
+    uchar *chooser;
+    uword history;
+    int ras[RAS_DEPTH];             // circular, the oldest return address is overwritten
+    int ras_top;
+    int ras_count;
+    uchar mispredicted;             // outcome of the last branch or ret, used by the pipeline model
+    uquad branches;
+    uquad branch_misses;
+    uquad returns;
+    uquad return_misses;
+    uquad *executed;                // per text index of the branch
+    uquad *misses;
+} s_predictor;
+
+/*******************
+* Functions
+*******************/
+
+// creates the predictor described by the configuration string for the linked program
+s_predictor *predictor_create(s_sim_context *ctx, const char *config);
+
+// predicts and updates with the instruction at pc, which step() has just executed
+void predictor_account(s_sim_context *ctx, int pc);
+
+// prints misprediction rates and the branches with the most mispredictions
+void print_predictor(s_sim_context *ctx, FILE *out);
+
+// releases the predictor
+void predictor_free(s_predictor *predictor);
+
+#endif
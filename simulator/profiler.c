@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "profiler.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+int is_branch(uchar ins_type) {
+    return ins_type >= INS_BGE && ins_type <= INS_BNE;
+}
+
+void profile_init(s_sim_context *ctx) {
+    int length = ctx->program_image.text_length;
+    ctx->profile = calloc(1, sizeof(s_profile));
+    if (ctx->profile == NULL) {
+        simerror("profile_init: out of memory");
+    }
+    // one extra entry, so that an early block exit can always be recorded
+    ctx->profile->entries = calloc(length + 1, sizeof(uquad));
+    ctx->profile->taken = calloc(length + 1, sizeof(uquad));
+    if (ctx->profile->entries == NULL || ctx->profile->taken == NULL) {
+        simerror("profile_init: out of memory");
+    }
+}
+
+void profile_block(s_sim_context *ctx, int start, int length) {
+    int last = start + length - 1;
+    const s_instruction *ins = &ctx->program_image.text[last];
+    ctx->profile->entries[start]++;
+    if (length < ctx->program_image.block_length[start]) {
+        ctx->profile->entries[last + 1]--;
+    }
+    if (is_branch(ins->instruction_type) && ctx->processor.pc != last + 1) {
+        ctx->profile->taken[last]++;
+    }
+}
+
+// sort order of the report, the most executed instruction first
+uquad *sort_counts;
+
+int compare_counts(const void *a, const void *b) {
+    int i = *(const int *) a, j = *(const int *) b;
+    if (sort_counts[i] != sort_counts[j]) {
+        return sort_counts[i] < sort_counts[j] ? 1 : -1;
+    }
+    return i - j;
+}
+
+void print_profile(s_sim_context *ctx, FILE *out) {
+    static pthread_mutex_t sort_mutex = PTHREAD_MUTEX_INITIALIZER;
+    int length = ctx->program_image.text_length;
+    uquad *counts = calloc(length + 1, sizeof(uquad));
+    int *order = calloc(length + 1, sizeof(int));
+    const char **lines = calloc(length + 1, sizeof(char *));
+    const char **labels = calloc(length + 1, sizeof(char *));
+    char line_buffer[CHAR_BUFFER_LENGTH], label_buffer[CHAR_BUFFER_LENGTH];
+    uquad sum = 0, total = 0;
+    int i, executed = 0;
+    if (counts == NULL || order == NULL || lines == NULL || labels == NULL) {
+        simerror("print_profile: out of memory");
+    }
+    for (i = 0; i < length; i++) {
+        sum += ctx->profile->entries[i];
+        counts[i] = sum;
+        total += sum;
+        if (sum != 0) order[executed++] = i;
+        if (is_block_end(ctx->program_image.text[i].instruction_type)) sum = 0;
+    }
+    source_lines(ctx, lines, labels);
+    pthread_mutex_lock(&sort_mutex);
+    sort_counts = counts;
+    qsort(order, executed, sizeof(int), compare_counts);
+    pthread_mutex_unlock(&sort_mutex);
+
+    fprintf(out, "\n### Profile: %llu instructions executed ###\n", (unsigned long long) total);
+    fprintf(out, "%12s %7s %12s  %-14s %-28s %10s %10s\n", "Count", "%", "Addr", "Label", "Instruction", "Taken", "Not taken");
+    for (i = 0; i < executed; i++) {
+        int pc = order[i];
+        int branch = is_branch(ctx->program_image.text[pc].instruction_type);
+        fprintf(out, "%12llu %6.2f%% [%#10x]  %-14s %-*s", (unsigned long long) counts[pc], 100.0 * counts[pc] / total,
+                TEXT_SEGMENT_START + 4*pc, labels[pc] ? source_text(labels[pc], label_buffer) : "-", branch ? 28 : 0,
+                lines[pc] ? source_text(lines[pc], line_buffer) : ins_names[ctx->program_image.text[pc].instruction_type]);
+        if (branch) {
+            fprintf(out, " %10llu %10llu", (unsigned long long) ctx->profile->taken[pc],
+                    (unsigned long long) (counts[pc] - ctx->profile->taken[pc]));
+        }
+        fprintf(out, "\n");
+    }
+    free(counts);
+    free(order);
+    free(lines);
+    free(labels);
+}
+
+void profile_free(s_sim_context *ctx) {
+    if (ctx->profile == NULL) {
+        return;
+    }
+    free(ctx->profile->entries);
+    free(ctx->profile->taken);
+    free(ctx->profile);
+    ctx->profile = NULL;
+}
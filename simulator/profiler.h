@@ -0,0 +1,40 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Counts are kept per basic block entry, not per instruction: entries[pc] is incremented when a
+block is entered at pc and decremented at the first instruction that was not executed if the
+budget ended the block early. Execution count of an instruction is the running sum of entries
+from the start of its basic block (counters are unsigned, the sum wraps back to the right value).
+*/
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _profile {
+    uquad *entries;
+    uquad *taken;           // number of taken branches, per text index of the branch
+} s_profile;
+
+/*******************
+* Functions
+*******************/
+
+// allocates the counters for the linked program (called after link_program)
+void profile_init(s_sim_context *ctx);
+
+// records one execution of length instructions starting at start, pc already points past them
+void profile_block(s_sim_context *ctx, int start, int length);
+
+// prints executed instructions sorted by execution count, annotated with the source lines
+void print_profile(s_sim_context *ctx, FILE *out);
+
+// releases the counters of the context
+void profile_free(s_sim_context *ctx);
+
+#endif
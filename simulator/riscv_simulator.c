@@ -4,27 +4,35 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <setjmp.h>
+#include <sys/mman.h>
 #include "riscv_simulator.h"
+#include "threaded_engine.h"
+#include "jit.h"
+#include "memory.h"
+#include "checkpoint.h"
+#include "profiler.h"
+#include "flamegraph.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "predictor.h"
+#include "screen.h"
+#include "debugger.h"
+#include "trace.h"
+#include "history.h"
+#include "host_io.h"
+#include "cosim.h"
+#include "harts.h"
 #include "defs.h"
 
 extern int yylineno;
+// engine options are shared by all contexts
 int max_steps = -1;
+int use_threaded_engine = FALSE;
+int use_jit = FALSE;
 
-word section_data[SECTION_DATA_LENGTH];
-word stack_segment[STACK_SEGMENT_LENGTH];
-s_instruction section_text[SECTION_TEXT_LENGTH];
-s_symbol symbol_table[SYMTAB_LENGTH];
-s_symbol globals[SECTION_DATA_LENGTH];
-s_processor processor;
-
-char source_buffer[256];
-s_source source[2000];  // :D
-
-int symtab_index = 0;
-int data_index = 0;
-int text_index = 0;
-int source_index = 0;
-int global_index = 0;
+// context of the simulation running on this thread, errors are reported to it
+__thread s_sim_context *current_context = NULL;
 
 /* reads from keypress, doesn't echo
    AUTHOR: Zobayer Hasan, http://zobayer.blogspot.com/2010/12/getch-getche-in-gccg.html */
@@ -113,209 +121,480 @@ int cprintf(const char *format, ...) {
     return ret;
 }
 
-word get_scaled_4b_aligned_offset(word offset) {
-    if (offset % 4 != 0) {
-        simerror("get_scaled_4b_aligned_offset - offset %d is not aligned to 4 bytes", offset);
+void sim_abort(int code) {
+    if (current_context != NULL && current_context->error_jump != NULL) {
+        current_context->error_code = code;
+        longjmp(*current_context->error_jump, 1);
+    }
+    // the trace up to the error is the interesting part
+    if (current_context != NULL && current_context->trace != NULL) {
+        trace_close(current_context);
+    }
+    // so is the output of the guest
+    if (current_context != NULL) {
+        host_io_flush(current_context);
+    }
+    exit(code);
+}
+
+void sim_fail(int code, const char *title, const char *format, ...) {
+    char message[CHAR_BUFFER_LENGTH];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+    if (current_context != NULL && current_context->error_jump != NULL) {
+        snprintf(current_context->error_message, sizeof(current_context->error_message), "%s %s", title, message);
+    } else {
+        cprintf("\n{RED}%s{NRM} ", title);
+        printf("%s\n", message);
     }
-    return offset / 4;
+    sim_abort(code);
 }
 
-word get_memory_offset(uchar reg, word offset) {
-    return *get_reg(reg) / 4 + get_scaled_4b_aligned_offset(offset);
+word *get_memory(s_sim_context *ctx, uchar reg, word offset) {
+    uword address = (uword) *get_reg(ctx, reg) + offset;
+    if (address % 4 != 0) {
+        simerror("get_memory: address %#x is not aligned to 4 bytes - %d(%s)", address, offset, abi_regs[reg]);
+    }
+    return memory_word(&ctx->memory, address);
 }
 
-word *get_memory(uchar reg, word offset) {
-    word scaled = get_memory_offset(reg, offset);
-    if (reg == GLOBAL_POINTER) {
-        if (scaled >= SECTION_DATA_LENGTH || scaled < 0) {
-            simerror("get_memory invalid access to global memory - %d(%s)", offset, abi_regs[reg]);
+word *get_store_memory(s_sim_context *ctx, uchar reg, word offset) {
+    uword address = (uword) *get_reg(ctx, reg) + offset;
+    if (address % 4 != 0) {
+        simerror("get_memory: address %#x is not aligned to 4 bytes - %d(%s)", address, offset, abi_regs[reg]);
+    }
+    return memory_store_word(&ctx->memory, address);
+}
+
+word muldiv(uchar ins_type, word rs1, word rs2) {
+    switch (ins_type) {
+        case INS_MUL:
+            return (uword) rs1 * (uword) rs2;
+        case INS_MULH:
+            return ((quad) rs1 * (quad) rs2) >> 32;
+        case INS_MULHSU:
+            return ((quad) rs1 * (quad) (uword) rs2) >> 32;
+        case INS_MULHU:
+            return ((uquad) (uword) rs1 * (uword) rs2) >> 32;
+        // division by zero and overflow don't trap, results are defined by the spec
+        case INS_DIV:
+            if (rs2 == 0) return -1;
+            if (rs1 == INT32_MIN && rs2 == -1) return rs1;
+            return rs1 / rs2;
+        case INS_DIVU:
+            if (rs2 == 0) return -1;
+            return (uword) rs1 / (uword) rs2;
+        case INS_REM:
+            if (rs2 == 0) return rs1;
+            if (rs1 == INT32_MIN && rs2 == -1) return 0;
+            return rs1 % rs2;
+        case INS_REMU:
+            if (rs2 == 0) return rs1;
+            return (uword) rs1 % (uword) rs2;
+        default:
+            simerror("muldiv: invalid instruction");
+    }
+}
+
+word *get_atomic_memory(s_sim_context *ctx, uchar reg) {
+    uword address = *get_reg(ctx, reg);
+    if (address % 4 != 0) {
+        simerror("get_atomic_memory: address %#x is not aligned to 4 bytes - (%s)", address, abi_regs[reg]);
+    }
+    return memory_store_word(&ctx->memory, address);
+}
+
+word amo(uchar ins_type, word *memory, word value) {
+    word old;
+    switch (ins_type) {
+        case INS_AMOSWAP:
+            return __atomic_exchange_n(memory, value, __ATOMIC_SEQ_CST);
+        case INS_AMOADD:
+            return __atomic_fetch_add(memory, value, __ATOMIC_SEQ_CST);
+        case INS_AMOXOR:
+            return __atomic_fetch_xor(memory, value, __ATOMIC_SEQ_CST);
+        case INS_AMOAND:
+            return __atomic_fetch_and(memory, value, __ATOMIC_SEQ_CST);
+        case INS_AMOOR:
+            return __atomic_fetch_or(memory, value, __ATOMIC_SEQ_CST);
+        default:
+            break;
+    }
+    // min and max have no host instruction, a failed exchange reloads old
+    old = __atomic_load_n(memory, __ATOMIC_SEQ_CST);
+    while (1) {
+        word result;
+        switch (ins_type) {
+            case INS_AMOMIN:  result = old < value ? old : value; break;
+            case INS_AMOMAX:  result = old > value ? old : value; break;
+            case INS_AMOMINU: result = (uword) old < (uword) value ? old : value; break;
+            case INS_AMOMAXU: result = (uword) old > (uword) value ? old : value; break;
+            default: simerror("amo: invalid instruction");
         }
-        return &section_data[scaled];
-    } else if (reg == FRAME_POINTER || reg == STACK_POINTER) {
-        if (scaled >= STACK_SEGMENT_LENGTH || scaled < 0) {
-            simerror("get_memory invalid access to stack segment - %d(%s)", offset, abi_regs[reg]);
+        if (__atomic_compare_exchange_n(memory, &old, result, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            return old;
         }
-        return &stack_segment[scaled];
-    } else {
-        simerror("get_memory invalid use of base register - use sp, fp or gp");
     }
 }
 
-word *get_reg(uchar reg) {
+static const struct {
+    word csr;
+    const char *name;
+} csrs[] = {
+    { CSR_CYCLE, "cycle" }, { CSR_TIME, "time" }, { CSR_INSTRET, "instret" },
+    { CSR_CYCLEH, "cycleh" }, { CSR_TIMEH, "timeh" }, { CSR_INSTRETH, "instreth" },
+    { CSR_MHARTID, "mhartid" }
+};
+
+// cycles of the pipeline model up to the previous instruction, or one cycle per instruction without it
+uquad cycles(s_sim_context *ctx) {
+    if (ctx->pipeline != NULL) {
+        return ctx->pipeline->last_ex;
+    }
+    return ctx->step_count + ctx->run_executed;
+}
+
+word csr_read(s_sim_context *ctx, word csr) {
+    // time has no frequency of its own, it counts cycles like the mtime of a core clocked timer,
+    // so all counters are deterministic (the host clock is available through clock_gettime)
+    switch (csr) {
+        case CSR_CYCLE:
+        case CSR_TIME:
+            return cycles(ctx);
+        case CSR_CYCLEH:
+        case CSR_TIMEH:
+            return cycles(ctx) >> 32;
+        case CSR_INSTRET:
+            return ctx->step_count + ctx->run_executed;
+        case CSR_INSTRETH:
+            return (ctx->step_count + ctx->run_executed) >> 32;
+        case CSR_MHARTID:
+            return ctx->hart_id;
+        default:
+            simerror("csr_read: CSR %#x is not supported", csr);
+    }
+}
+
+const char *csr_name(word csr) {
+    int i;
+    for (i = 0; i < sizeof(csrs) / sizeof(csrs[0]); i++) {
+        if (csrs[i].csr == csr) return csrs[i].name;
+    }
+    return NULL;
+}
+
+word csr_number(const char *name) {
+    int i;
+    for (i = 0; i < sizeof(csrs) / sizeof(csrs[0]); i++) {
+        if (strcmp(csrs[i].name, name) == 0) return csrs[i].csr;
+    }
+    return -1;
+}
+
+word *get_reg(s_sim_context *ctx, uchar reg) {
     if (reg >= RV32I_REG_NUM) {
         simerror("get_reg: invalid register index");
     }
-    return &processor.regs[reg];
+    return &ctx->processor.regs[reg];
+}
+
+void *grow_array(void *array, int *capacity, int needed, size_t element_size) {
+    int new_capacity = *capacity > 0 ? *capacity : INITIAL_ARRAY_LENGTH;
+    if (needed <= *capacity) {
+        return array;
+    }
+    while (new_capacity < needed) new_capacity *= 2;
+    array = realloc(array, new_capacity * element_size);
+    if (array == NULL) {
+        simerror("grow_array: out of memory");
+    }
+    memset((char *) array + *capacity * element_size, 0, (new_capacity - *capacity) * element_size);
+    *capacity = new_capacity;
+    return array;
+}
+
+void reserve_text(s_sim_context *ctx, int count) {
+    ctx->section_text = grow_array(ctx->section_text, &ctx->text_capacity, ctx->text_index + count, sizeof(s_instruction));
+}
+
+void reserve_source(s_sim_context *ctx, int count) {
+    ctx->source = grow_array(ctx->source, &ctx->source_capacity, ctx->source_index + count, sizeof(s_source));
+}
+
+void reserve_globals(s_sim_context *ctx, int count) {
+    int capacity = ctx->global_capacity;
+    ctx->globals = grow_array(ctx->globals, &ctx->global_capacity, ctx->global_index + count, sizeof(s_symbol));
+    // the interactive mode keeps the last shown value of every global
+    ctx->global_cache = grow_array(ctx->global_cache, &capacity, ctx->global_capacity, sizeof(word));
+}
+
+// FNV-1a
+uword hash_name(const char *name) {
+    uword hash = 2166136261u;
+    while (*name) {
+        hash ^= (uchar) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int find_symbol(s_symbol_hash *hash, const s_symbol *symbols, const char *name) {
+    uword slot;
+    if (hash->capacity == 0) {
+        return -1;
+    }
+    for (slot = hash_name(name) & (hash->capacity - 1); hash->slots[slot] != 0; slot = (slot + 1) & (hash->capacity - 1)) {
+        if (strcmp(symbols[hash->slots[slot] - 1].name, name) == 0) {
+            return hash->slots[slot] - 1;
+        }
+    }
+    return -1;
 }
 
-int get_label_address(word label_index) {
-    if (label_index >= symtab_index) {
+void add_symbol(s_symbol_hash *hash, const s_symbol *symbols, int count, int index) {
+    uword slot;
+    int i;
+    // the table is kept at most half full, it is rebuilt from the symbols when it grows
+    if (2 * count > hash->capacity) {
+        free(hash->slots);
+        hash->capacity = hash->capacity > 0 ? 2 * hash->capacity : 2 * INITIAL_ARRAY_LENGTH;
+        while (2 * count > hash->capacity) hash->capacity *= 2;
+        hash->slots = calloc(hash->capacity, sizeof(int));
+        if (hash->slots == NULL) {
+            simerror("add_symbol: out of memory");
+        }
+        for (i = 0; i < count; i++) {
+            if (i != index) add_symbol(hash, symbols, count, i);
+        }
+    }
+    slot = hash_name(symbols[index].name) & (hash->capacity - 1);
+    while (hash->slots[slot] != 0) slot = (slot + 1) & (hash->capacity - 1);
+    hash->slots[slot] = index + 1;
+}
+
+int get_label_address(s_sim_context *ctx, word label_index) {
+    if (label_index >= ctx->symtab_index) {
         simerror("get_label_address: invalid label index");
     }
-    return symbol_table[label_index].offset;
+    return ctx->symbol_table[label_index].offset;
 }
 
-void insert_label_unchecked(char *name, uchar defined) {
-    symbol_table[symtab_index].name = strdup(name);
-    symbol_table[symtab_index].defined = defined;
-    symbol_table[symtab_index].offset = NO_ADDRESS;
+void insert_label_unchecked(s_sim_context *ctx, char *name, uchar defined) {
+    ctx->symbol_table = grow_array(ctx->symbol_table, &ctx->symtab_capacity, ctx->symtab_index + 1, sizeof(s_symbol));
+    ctx->symbol_table[ctx->symtab_index].name = strdup(name);
+    ctx->symbol_table[ctx->symtab_index].defined = defined;
+    ctx->symbol_table[ctx->symtab_index].offset = NO_ADDRESS;
     //debug("creating label: %s, on index: %d, defined: %d, address: %d", name, symtab_index, defined, symbol_table[symtab_index].offset);
-    symtab_index++;
+    ctx->symtab_index++;
+    add_symbol(&ctx->label_hash, ctx->symbol_table, ctx->symtab_index, ctx->symtab_index - 1);
 }
 
 s_operand create_reg_operand(uchar reg) {
-    s_operand op;
+    s_operand op = { 0 };
     op.operand_type = OP_REGISTER;
     op.register_index = reg;
     return op;
 }
 
 s_operand create_imm_operand(word imm) {
-    s_operand op;
+    s_operand op = { 0 };
     op.operand_type = OP_IMMEDIATE;
     op.data = imm;
     return op;
 }
 
 s_operand create_reg_offset_operand(word offset, uchar reg) {
-    s_operand op;
+    s_operand op = { 0 };
     op.operand_type = OP_REGISTER_OFFSET;
     op.data = offset;
     op.register_index = reg;
     return op;
 }
 
-s_operand create_address_operand(char *name) {
-    s_operand op;
+s_operand create_address_operand(s_sim_context *ctx, char *name) {
+    s_operand op = { 0 };
     op.operand_type = OP_ADDRESS;
     //debug("creating address operand, symtab_index: %d", symtab_index);
-    op.data = ensure_label(name);
+    op.data = ensure_label(ctx, name);
     return op;
 }
 
-void insert_label(char *name) {
-    int i;
-    for (i = 0; i < symtab_index; i++) {
-        if (strcmp(name, symbol_table[i].name) == 0) {
-            if (symbol_table[i].defined == TRUE) {
-                parsererror("label %s already defined", name);
-            } else {
-                symbol_table[i].defined = TRUE;
-                //debug("found label %s which is not defined...with address %d...", symbol_table[i].name, symbol_table[i].offset);
-                return;
-            }
+s_operand create_text_index_operand(int index) {
+    s_operand op = { 0 };
+    op.operand_type = OP_TEXT_INDEX;
+    op.data = index;
+    return op;
+}
+
+void insert_label(s_sim_context *ctx, char *name) {
+    int i = find_symbol(&ctx->label_hash, ctx->symbol_table, name);
+    if (i >= 0) {
+        if (ctx->symbol_table[i].defined == TRUE) {
+            parsererror("label %s already defined", name);
         }
+        ctx->symbol_table[i].defined = TRUE;
+        //debug("found label %s which is not defined...with address %d...", symbol_table[i].name, symbol_table[i].offset);
+    } else {
+        i = ctx->symtab_index;
+        insert_label_unchecked(ctx, name, TRUE);
     }
-    insert_label_unchecked(name, TRUE);
+    ctx->pending_labels = grow_array(ctx->pending_labels, &ctx->pending_capacity, ctx->pending_count + 1, sizeof(int));
+    ctx->pending_labels[ctx->pending_count++] = i;
 }
 
-int ensure_label(char *name) {
-    int i;
-    for (i = 0; i < symtab_index; i++) {
-        if (strcmp(name, symbol_table[i].name) == 0) {
-            //debug("names matched: %s == %s", name, symbol_table[i].name);
-            return i;
-        }
+int ensure_label(s_sim_context *ctx, char *name) {
+    int i = find_symbol(&ctx->label_hash, ctx->symbol_table, name);
+    if (i >= 0) {
+        //debug("names matched: %s == %s", name, symbol_table[i].name);
+        return i;
     }
     //debug("didn't find label: %s", name);
-    i = symtab_index;
+    i = ctx->symtab_index;
     // Insert the label because it does not exist
-    insert_label_unchecked(name, FALSE);
+    insert_label_unchecked(ctx, name, FALSE);
     //debug("value of newly created label: %d", i);
     return i;
 }
 
-void insert_data(word data) {
-    section_data[data_index] = data;
-    data_index++;
+void insert_data(s_sim_context *ctx, word data) {
+    *memory_word(&ctx->memory, STATIC_DATA_START + 4*ctx->data_index) = data;
+    ctx->data_index++;
 }
 
-void insert_global(char *name) {
-    int i;
-    for (i = 0; i < global_index; i++) {
-        if (strcmp(name, globals[i].name) == 0) {
-            parsererror("redefinition of global symbol: %s", name);
-        }
+void insert_global(s_sim_context *ctx, char *name) {
+    if (find_symbol(&ctx->global_hash, ctx->globals, name) >= 0) {
+        parsererror("redefinition of global symbol: %s", name);
+    }
+    reserve_globals(ctx, 1);
+    ctx->globals[ctx->global_index].name = strdup(name);
+    ctx->globals[ctx->global_index].offset = ctx->data_index;
+    ctx->global_index++;
+    add_symbol(&ctx->global_hash, ctx->globals, ctx->global_index, ctx->global_index - 1);
+}
+
+void insert_jump(s_sim_context *ctx, uchar ins_type, char *name) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
+    if (ins_type != INS_RET) {
+        ctx->section_text[ctx->text_index].destination = create_address_operand(ctx, name);
     }
-    globals[global_index].name = strdup(name);
-    globals[global_index].offset = data_index;
-    global_index++;
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
+}
+
+void insert_branch(s_sim_context *ctx, uchar ins_type, uchar sign_type, uchar rs1, uchar rs2, char *name) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
+    ctx->section_text[ctx->text_index].sign_type = sign_type;
+    ctx->section_text[ctx->text_index].destination = create_address_operand(ctx, name);
+    ctx->section_text[ctx->text_index].source1 = create_reg_operand(rs1);
+    ctx->section_text[ctx->text_index].source2 = create_reg_operand(rs2);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_jump(uchar ins_type, char *name) {
-    section_text[text_index].instruction_type = ins_type;
+void insert_jump_to(s_sim_context *ctx, uchar ins_type, int target) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
     if (ins_type != INS_RET) {
-        section_text[text_index].destination = create_address_operand(name);
+        ctx->section_text[ctx->text_index].destination = create_text_index_operand(target);
     }
-    insert_instruction(&section_text[text_index]);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_branch(uchar ins_type, uchar sign_type, uchar rs1, uchar rs2, char *name) {
-    section_text[text_index].instruction_type = ins_type;
-    section_text[text_index].sign_type = sign_type;
-    section_text[text_index].destination = create_address_operand(name);
-    section_text[text_index].source1 = create_reg_operand(rs1);
-    section_text[text_index].source2 = create_reg_operand(rs2);
-    insert_instruction(&section_text[text_index]);
+void insert_branch_to(s_sim_context *ctx, uchar ins_type, uchar sign_type, uchar rs1, uchar rs2, int target) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
+    ctx->section_text[ctx->text_index].sign_type = sign_type;
+    ctx->section_text[ctx->text_index].destination = create_text_index_operand(target);
+    ctx->section_text[ctx->text_index].source1 = create_reg_operand(rs1);
+    ctx->section_text[ctx->text_index].source2 = create_reg_operand(rs2);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_load_store(uchar ins_type, uchar rd, word offset, uchar rs) {
-    section_text[text_index].instruction_type = ins_type;
+void insert_load_store(s_sim_context *ctx, uchar ins_type, uchar rd, word offset, uchar rs) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
     if (ins_type == INS_SW) {
-        section_text[text_index].destination = create_reg_offset_operand(offset, rs);
-        section_text[text_index].source1 = create_reg_operand(rd);
+        ctx->section_text[ctx->text_index].destination = create_reg_offset_operand(offset, rs);
+        ctx->section_text[ctx->text_index].source1 = create_reg_operand(rd);
     } else {
-        section_text[text_index].destination = create_reg_operand(rd);
+        ctx->section_text[ctx->text_index].destination = create_reg_operand(rd);
         if (ins_type == INS_LI) {
-            section_text[text_index].source1 = create_imm_operand(offset);
+            ctx->section_text[ctx->text_index].source1 = create_imm_operand(offset);
         } else {
-            section_text[text_index].source1 = create_reg_offset_operand(offset, rs);
+            ctx->section_text[ctx->text_index].source1 = create_reg_offset_operand(offset, rs);
         }
     }
-    insert_instruction(&section_text[text_index]);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_arithmetic(uchar ins_type, uchar rd, uchar rs1, uchar rs2) {
-    section_text[text_index].instruction_type = ins_type;
-    section_text[text_index].destination = create_reg_operand(rd);
-    section_text[text_index].source1 = create_reg_operand(rs1);
-    section_text[text_index].source2 = create_reg_operand(rs2);
-    insert_instruction(&section_text[text_index]);
+void insert_arithmetic(s_sim_context *ctx, uchar ins_type, uchar rd, uchar rs1, uchar rs2) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
+    ctx->section_text[ctx->text_index].destination = create_reg_operand(rd);
+    ctx->section_text[ctx->text_index].source1 = create_reg_operand(rs1);
+    ctx->section_text[ctx->text_index].source2 = create_reg_operand(rs2);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_arithmetic_immediate(uchar ins_type, uchar rd, uchar rs1, word immediate) {
-    section_text[text_index].instruction_type = ins_type;
-    section_text[text_index].destination = create_reg_operand(rd);
-    section_text[text_index].source1 = create_reg_operand(rs1);
-    section_text[text_index].source2 = create_imm_operand(immediate);
-    insert_instruction(&section_text[text_index]);
+void insert_arithmetic_immediate(s_sim_context *ctx, uchar ins_type, uchar rd, uchar rs1, word immediate) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
+    ctx->section_text[ctx->text_index].destination = create_reg_operand(rd);
+    ctx->section_text[ctx->text_index].source1 = create_reg_operand(rs1);
+    ctx->section_text[ctx->text_index].source2 = create_imm_operand(immediate);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_nop() {
-    section_text[text_index].instruction_type = INS_NOP;
-    insert_instruction(&section_text[text_index]);
+void insert_nop(s_sim_context *ctx) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = INS_NOP;
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
 }
 
-void insert_instruction(s_instruction *ins) {
+void insert_atomic(s_sim_context *ctx, uchar ins_type, uchar rd, uchar rs2, uchar rs1) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = ins_type;
+    ctx->section_text[ctx->text_index].destination = create_reg_operand(rd);
+    ctx->section_text[ctx->text_index].source1 = create_reg_operand(rs1);
+    ctx->section_text[ctx->text_index].source2 = create_reg_operand(rs2);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
+}
+
+void insert_csrr(s_sim_context *ctx, uchar rd, word csr) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = INS_CSRR;
+    ctx->section_text[ctx->text_index].destination = create_reg_operand(rd);
+    ctx->section_text[ctx->text_index].source1 = create_imm_operand(csr);
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
+}
+
+void insert_ecall(s_sim_context *ctx) {
+    reserve_text(ctx, 1);
+    ctx->section_text[ctx->text_index].instruction_type = INS_ECALL;
+    insert_instruction(ctx, &ctx->section_text[ctx->text_index]);
+}
+
+void insert_instruction(s_sim_context *ctx, s_instruction *ins) {
     //debug("inserted instruction at index: %d", text_index);
-    // check if there are any labels with unassigned address and assign them to this instruction
-    //debug("symbol table index: %d", symtab_index);
+    // labels defined since the previous instruction point to this one
     int i;
-    for (i = symtab_index-1; i >= 0; i--) {
-        if (symbol_table[i].offset == NO_ADDRESS && symbol_table[i].defined == TRUE) {
-            //debug("assigning value %d to label: %s", text_index, symbol_table[i].name);
-            symbol_table[i].offset = text_index; // point to the currently inserted instruction
-            //debug("assigned %d to label: %s...", text_index, symbol_table[i].name);
-        }
+    for (i = 0; i < ctx->pending_count; i++) {
+        //debug("assigning value %d to label: %s", text_index, symbol_table[pending_labels[i]].name);
+        ctx->symbol_table[ctx->pending_labels[i]].offset = ctx->text_index;
     }
-    text_index++;
+    ctx->pending_count = 0;
+    ctx->text_index++;
 }
 
 // Copy-pase from hipsim :D
-void insert_source_f(char *s) {
-    source[source_index].text = strdup(s);
-    source[source_index].address = text_index;
-    source_index++;
+void insert_source_f(s_sim_context *ctx, char *s) {
+    reserve_source(ctx, 1);
+    ctx->source[ctx->source_index].text = strdup(s);
+    ctx->source[ctx->source_index].address = ctx->text_index;
+    ctx->source[ctx->source_index].line = ctx->parsing ? yylineno : 0;
+    ctx->source_index++;
     //debug("inserting source code at index: %d", source_index);
 }
 
@@ -326,53 +605,139 @@ char type_char(int sign_type) {
     return ' ';
 }
 
-void init_simulator() {
-    int i;
-    processor.done = FALSE;
-    processor.pc = 0;
+void init_simulator(s_sim_context *ctx) {
+    ctx->processor.done = FALSE;
+    ctx->processor.pc = 0;
     // initialize frame, stack and global pointer
-    processor.regs[FRAME_POINTER]  = 4*(STACK_SEGMENT_LENGTH - 1);
-    processor.regs[STACK_POINTER]  = 4*(STACK_SEGMENT_LENGTH - 1);
-    processor.regs[GLOBAL_POINTER] = 0;
-    for (i = 0; i < SECTION_TEXT_LENGTH; i++) {
-        section_text[i].instruction_type = INS_NOP;
-        section_text[i].sign_type = NO_TYPE;
-    }
+    memory_init(&ctx->memory);
+    ctx->processor.regs[FRAME_POINTER]  = STACK_SEGMENT_START;
+    ctx->processor.regs[STACK_POINTER]  = STACK_SEGMENT_START;
+    ctx->processor.regs[GLOBAL_POINTER] = STATIC_DATA_START;
+    ctx->max_steps = max_steps;
     //debug("initialized simulator...");
 }
 
-void check_undefined_labels() {
+s_sim_context *create_context() {
+    s_sim_context *ctx = calloc(1, sizeof(s_sim_context));
+    if (ctx == NULL) {
+        simerror("create_context: out of memory");
+    }
+    init_simulator(ctx);
+    return ctx;
+}
+
+void free_context(s_sim_context *ctx) {
     int i;
-    for (i = 0; i < symtab_index; i++) {
-        if (symbol_table[i].defined == FALSE) {
-            parsererror("undefined label: %s", symbol_table[i].name);
+    for (i = 0; i < ctx->symtab_index; i++) free(ctx->symbol_table[i].name);
+    for (i = 0; i < ctx->global_index; i++) free(ctx->globals[i].name);
+    for (i = 0; i < ctx->source_index; i++) free(ctx->source[i].text);
+    free(ctx->section_text);
+    free(ctx->symbol_table);
+    free(ctx->globals);
+    free(ctx->source);
+    free(ctx->global_cache);
+    free(ctx->label_hash.slots);
+    free(ctx->pending_labels);
+    free(ctx->global_hash.slots);
+    if (ctx->program_image.text != NULL) {
+        munmap((void *) ctx->program_image.text, (ctx->program_image.text_length > 0 ? ctx->program_image.text_length : 1) * (sizeof(s_instruction) + sizeof(int)));
+    }
+    threaded_free(ctx);
+    jit_free(ctx);
+    profile_free(ctx);
+    flamegraph_free(ctx);
+    pipeline_free(ctx);
+    cache_free(ctx->icache);
+    cache_free(ctx->dcache);
+    predictor_free(ctx->predictor);
+    debug_free(ctx);
+    history_free(ctx);
+    host_io_free(ctx);
+    cosim_free(ctx);
+    harts_free(ctx);
+    memory_free(&ctx->memory);
+    free(ctx);
+}
+
+void check_undefined_labels(s_sim_context *ctx) {
+    int i;
+    for (i = 0; i < ctx->symtab_index; i++) {
+        if (ctx->symbol_table[i].defined == FALSE) {
+            parsererror("undefined label: %s", ctx->symbol_table[i].name);
         }
-        if (symbol_table[i].offset == NO_ADDRESS) {
-            parsererror("unassigned label: %s", symbol_table[i].name);
+        if (ctx->symbol_table[i].offset == NO_ADDRESS) {
+            parsererror("unassigned label: %s", ctx->symbol_table[i].name);
         }
         //debug("%s: %d", symbol_table[i].name, symbol_table[i].offset);
     }
 }
 
-void step() {
-    if (processor.pc < 0 || processor.pc >= text_index) {
+int is_block_end(uchar ins_type) {
+    switch (ins_type) {
+        // csrr ends its block, so the engines know how many instructions were executed before it
+        case INS_JAL: case INS_RET: case INS_J: case INS_NOP: case INS_ECALL: case INS_CSRR:
+        case INS_BGE: case INS_BLE: case INS_BGT: case INS_BLT: case INS_BEQ: case INS_BNE:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+int is_atomic(uchar ins_type) {
+    return ins_type >= INS_LR && ins_type <= INS_AMOMAXU;
+}
+
+void link_program(s_sim_context *ctx) {
+    int i;
+    s_instruction *text;
+    int *block_length;
+    size_t text_size = (ctx->text_index > 0 ? ctx->text_index : 1) * sizeof(s_instruction);
+    size_t block_size = (ctx->text_index > 0 ? ctx->text_index : 1) * sizeof(int);
+    // labels are already bound, so every label operand becomes the text index of its target
+    for (i = 0; i < ctx->text_index; i++) {
+        if (ctx->section_text[i].destination.operand_type == OP_ADDRESS) {
+            ctx->section_text[i].destination.data = get_label_address(ctx, ctx->section_text[i].destination.data);
+            ctx->section_text[i].destination.operand_type = OP_TEXT_INDEX;
+        }
+    }
+    text = mmap(NULL, text_size + block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (text == MAP_FAILED) {
+        simerror("link_program: can't allocate program image");
+    }
+    memcpy(text, ctx->section_text, ctx->text_index * sizeof(s_instruction));
+    // split the program into basic blocks, walking backwards from the end of each block
+    block_length = (int *) ((char *) text + text_size);
+    for (i = ctx->text_index - 1; i >= 0; i--) {
+        if (is_block_end(text[i].instruction_type) || i == ctx->text_index - 1) {
+            block_length[i] = 1;
+        } else {
+            block_length[i] = block_length[i + 1] + 1;
+        }
+    }
+    mprotect(text, text_size + block_size, PROT_READ);
+    ctx->program_image.text = text;
+    ctx->program_image.block_length = block_length;
+    ctx->program_image.text_length = ctx->text_index;
+}
+
+void step(s_sim_context *ctx) {
+    if (ctx->processor.pc < 0 || ctx->processor.pc >= ctx->program_image.text_length) {
         simerror("step: invalid value in program counter");
     }
-    s_instruction *ins = &section_text[processor.pc];
+    const s_instruction *ins = &ctx->program_image.text[ctx->processor.pc];
     switch (ins->instruction_type) {
         case INS_JAL:
             //debug("jal");
-            *get_reg(RETURN_ADDRESS_REG) = processor.pc + 1;
-            processor.pc = get_label_address(ins->destination.data);
+            *get_reg(ctx, RETURN_ADDRESS_REG) = ctx->processor.pc + 1;
+            ctx->processor.pc = ins->destination.data;
             break;
         case INS_RET: 
             //debug("ret");
-            processor.pc = *get_reg(RETURN_ADDRESS_REG);
+            ctx->processor.pc = *get_reg(ctx, RETURN_ADDRESS_REG);
             break;
         case INS_J: 
             //debug("j");
-            //debug("jumping to: %d", get_label_address(ins->destination.data));
-            processor.pc = get_label_address(ins->destination.data);
+            ctx->processor.pc = ins->destination.data;
             break;
         case INS_BGE: 
             //debug("bge");
@@ -400,43 +765,123 @@ void step() {
             break;
         case INS_ADD: 
             //debug("add");
-            *get_reg(ins->destination.register_index) = *get_reg(ins->source1.register_index) + *get_reg(ins->source2.register_index); 
-            processor.pc++;
+            *get_reg(ctx, ins->destination.register_index) = (uword) *get_reg(ctx, ins->source1.register_index) + *get_reg(ctx, ins->source2.register_index);
+            ctx->processor.pc++;
             break;
         case INS_ADDI: 
             //debug("addi");
-            *get_reg(ins->destination.register_index) = *get_reg(ins->source1.register_index) + ins->source2.data; 
-            processor.pc++;
+            *get_reg(ctx, ins->destination.register_index) = (uword) *get_reg(ctx, ins->source1.register_index) + ins->source2.data;
+            ctx->processor.pc++;
             break;
         case INS_SUB: 
             //debug("sub");
-            *get_reg(ins->destination.register_index) = *get_reg(ins->source1.register_index) - *get_reg(ins->source2.register_index); 
-            processor.pc++;
+            *get_reg(ctx, ins->destination.register_index) = (uword) *get_reg(ctx, ins->source1.register_index) - *get_reg(ctx, ins->source2.register_index);
+            ctx->processor.pc++;
             break;
         case INS_MV: 
             //debug("mv");
-            *get_reg(ins->destination.register_index) = *get_reg(ins->source1.register_index);
-            processor.pc++;
+            *get_reg(ctx, ins->destination.register_index) = *get_reg(ctx, ins->source1.register_index);
+            ctx->processor.pc++;
             break;
         case INS_LW: 
             //debug("lw");
-            *get_reg(ins->destination.register_index) = *get_memory(ins->source1.register_index, ins->source1.data);
-            processor.pc++;
+            *get_reg(ctx, ins->destination.register_index) = *get_memory(ctx, ins->source1.register_index, ins->source1.data);
+            ctx->processor.pc++;
             break;
         case INS_SW: 
             //debug("sw");
-            *get_memory(ins->destination.register_index, ins->destination.data) = *get_reg(ins->source1.register_index);
-            processor.pc++;
+            *get_store_memory(ctx, ins->destination.register_index, ins->destination.data) = *get_reg(ctx, ins->source1.register_index);
+            ctx->processor.pc++;
+            break;
+        case INS_SLLI:
+            //debug("slli");
+            *get_reg(ctx, ins->destination.register_index) = (uword) *get_reg(ctx, ins->source1.register_index) << ins->source2.data;
+            ctx->processor.pc++;
+            break;
+        case INS_SRLI:
+            //debug("srli");
+            *get_reg(ctx, ins->destination.register_index) = (uword) *get_reg(ctx, ins->source1.register_index) >> ins->source2.data;
+            ctx->processor.pc++;
+            break;
+        case INS_SRAI:
+            //debug("srai");
+            *get_reg(ctx, ins->destination.register_index) = *get_reg(ctx, ins->source1.register_index) >> ins->source2.data;
+            ctx->processor.pc++;
+            break;
+        case INS_MUL:
+        case INS_MULH:
+        case INS_MULHSU:
+        case INS_MULHU:
+        case INS_DIV:
+        case INS_DIVU:
+        case INS_REM:
+        case INS_REMU:
+            //debug("mul/div");
+            *get_reg(ctx, ins->destination.register_index) = muldiv(ins->instruction_type, *get_reg(ctx, ins->source1.register_index), *get_reg(ctx, ins->source2.register_index));
+            ctx->processor.pc++;
             break;
         case INS_LI: 
             //debug("li");
-            *get_reg(ins->destination.register_index) = ins->source1.data;
-            processor.pc++;
+            *get_reg(ctx, ins->destination.register_index) = ins->source1.data;
+            ctx->processor.pc++;
             break;
         case INS_NOP:
             //debug("nop");
-            processor.done = TRUE; 
-            processor.pc++;
+            ctx->processor.done = TRUE; 
+            ctx->processor.pc++;
+            break;
+        case INS_ECALL:
+            //debug("ecall");
+            host_ecall(ctx);
+            ctx->processor.pc++;
+            break;
+        case INS_LR: {
+            //debug("lr.w");
+            word *memory = get_atomic_memory(ctx, ins->source1.register_index);
+            ctx->reserved = TRUE;
+            ctx->reservation_address = *get_reg(ctx, ins->source1.register_index);
+            ctx->reservation_value = __atomic_load_n(memory, __ATOMIC_SEQ_CST);
+            if (ins->destination.register_index != 0) {
+                *get_reg(ctx, ins->destination.register_index) = ctx->reservation_value;
+            }
+            ctx->processor.pc++;
+            break; }
+        case INS_SC: {
+            //debug("sc.w");
+            // the word still holding the loaded value stands in for the reservation (an ABA store goes unnoticed)
+            word *memory = get_atomic_memory(ctx, ins->source1.register_index);
+            word expected = ctx->reservation_value;
+            int success = ctx->reserved && ctx->reservation_address == (uword) *get_reg(ctx, ins->source1.register_index)
+                          && __atomic_compare_exchange_n(memory, &expected, *get_reg(ctx, ins->source2.register_index),
+                                                         FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            ctx->reserved = FALSE;
+            if (ins->destination.register_index != 0) {
+                *get_reg(ctx, ins->destination.register_index) = !success;
+            }
+            ctx->processor.pc++;
+            break; }
+        case INS_AMOSWAP:
+        case INS_AMOADD:
+        case INS_AMOXOR:
+        case INS_AMOAND:
+        case INS_AMOOR:
+        case INS_AMOMIN:
+        case INS_AMOMAX:
+        case INS_AMOMINU:
+        case INS_AMOMAXU: {
+            //debug("amo");
+            word old = amo(ins->instruction_type, get_atomic_memory(ctx, ins->source1.register_index), *get_reg(ctx, ins->source2.register_index));
+            if (ins->destination.register_index != 0) {
+                *get_reg(ctx, ins->destination.register_index) = old;
+            }
+            ctx->processor.pc++;
+            break; }
+        case INS_CSRR:
+            //debug("csrr");
+            if (ins->destination.register_index != 0) {
+                *get_reg(ctx, ins->destination.register_index) = csr_read(ctx, ins->source1.data);
+            }
+            ctx->processor.pc++;
             break;
         default: {
             simerror("step encountered an invalid instruction type");
@@ -444,153 +889,417 @@ void step() {
     }
 }
 
-void print_registers() {
-    static word reg_cache[RV32I_REG_NUM];
+void observed_step(s_sim_context *ctx) {
+    int pc = ctx->processor.pc;
+    if (ctx->history != NULL) {
+        history_record(ctx);
+    }
+    // caches look at the operands before the instruction changes them
+    if (ctx->icache != NULL || ctx->dcache != NULL) {
+        cache_step(ctx);
+    }
+    if (ctx->trace != NULL) {
+        trace_fetch(ctx);
+    }
+    step(ctx);
+    if (ctx->trace != NULL) {
+        trace_retire(ctx, pc);
+    }
+    // the pipeline flushes only on mispredictions, so the predictor goes first
+    if (ctx->predictor != NULL) {
+        predictor_account(ctx, pc);
+    }
+    if (ctx->pipeline != NULL) {
+        pipeline_account(ctx, pc);
+    }
+}
+
+void print_registers(s_sim_context *ctx) {
     int i;
-    cprintf("\n\n{BLU}### Registers ###{NRM}\n");
-    printf("PC=%-#10x", processor.pc * 4 + TEXT_SEGMENT_START);
+    screen_printf(ctx->screen, "\n\n{BLU}### Registers ###{NRM}\n");
+    screen_printf(ctx->screen, "PC=%-#10x", ctx->processor.pc * 4 + TEXT_SEGMENT_START);
     for (i = 0; i < RV32I_REG_NUM; i++) {
-        word reg_value = processor.regs[i];
-        if (i == GLOBAL_POINTER) reg_value += STATIC_DATA_START + reg_value*4;
-        if (i == STACK_POINTER) reg_value = STACK_SEGMENT_START - (STACK_SEGMENT_LENGTH - 1 - reg_value)*4;
-        if (i == FRAME_POINTER) reg_value = STACK_SEGMENT_START - (STACK_SEGMENT_LENGTH - 1 - reg_value)*4;
-        if (i % 4 == 0) printf("\n");
-        printf("[x%-2d] %-4s= ", i, abi_regs[i]);
-        if (processor.regs[i] == reg_cache[i]) {
-            printf("%-12d ", reg_value);
+        word reg_value = ctx->processor.regs[i];
+        if (i % 4 == 0) screen_printf(ctx->screen, "\n");
+        screen_printf(ctx->screen, "[x%-2d] %-4s= ", i, abi_regs[i]);
+        if (ctx->processor.regs[i] == ctx->reg_cache[i]) {
+            screen_printf(ctx->screen, "%-12d ", reg_value);
         } else {
-            cprintf("{RED}%-12d{NRM} ", reg_value);
+            screen_printf(ctx->screen, "{RED}%-12d{NRM} ", reg_value);
         }
-        reg_cache[i] = processor.regs[i];
+        ctx->reg_cache[i] = ctx->processor.regs[i];
     }
 }
 
-void print_global_segment() {
-    static word global_cache[SECTION_DATA_LENGTH];
+void print_global_segment(s_sim_context *ctx) {
     int i;
-    cprintf("\n\n{BLU}### Global segment ###{NRM}\n");
-    for (i = 0; i < global_index; i++) {
-        if (i == processor.regs[GLOBAL_POINTER]) {
-            if (section_data[i] == global_cache[i]) {
-                cprintf("[%#10x] %-10s = %-5d {GRN}<- gp{NRM}", i*4 + STATIC_DATA_START, globals[i].name, section_data[i]);
+    screen_printf(ctx->screen, "\n\n{BLU}### Global segment ###{NRM}\n");
+    for (i = 0; i < ctx->global_index; i++) {
+        uword address = STATIC_DATA_START + 4*ctx->globals[i].offset;
+        word value = memory_peek(&ctx->memory, address);
+        if (address == (uword) ctx->processor.regs[GLOBAL_POINTER]) {
+            if (value == ctx->global_cache[i]) {
+                screen_printf(ctx->screen, "[%#10x] %-10s = %-5d {GRN}<- gp{NRM}", address, ctx->globals[i].name, value);
             } else {
-                cprintf("[%#10x] %-10s = {RED}%-5d{NRM} {GRN}<- gp{NRM}", i*4 + STATIC_DATA_START, globals[i].name, section_data[i]);
+                screen_printf(ctx->screen, "[%#10x] %-10s = {RED}%-5d{NRM} {GRN}<- gp{NRM}", address, ctx->globals[i].name, value);
             }
         } else {
-            if (section_data[i] == global_cache[i]) {
-            printf("[%#10x] %-10s = %-5d", i*4 + STATIC_DATA_START, globals[i].name, section_data[i]);
+            if (value == ctx->global_cache[i]) {
+                screen_printf(ctx->screen, "[%#10x] %-10s = %-5d", address, ctx->globals[i].name, value);
             } else {
-                cprintf("[%#10x] %-10s = {RED}%-5d{NRM}", i*4 + STATIC_DATA_START, globals[i].name, section_data[i]);
+                screen_printf(ctx->screen, "[%#10x] %-10s = {RED}%-5d{NRM}", address, ctx->globals[i].name, value);
             }
         }
-        global_cache[i] = section_data[i];
-        printf("\n");
+        ctx->global_cache[i] = value;
+        screen_printf(ctx->screen, "\n");
     }
 }
 
-void print_stack_segment() {
-    static word stack_cache[STACK_SEGMENT_LENGTH];
-    cprintf("\n\n{BLU}### Stack segment ###{NRM}\n");
+void print_stack_segment(s_sim_context *ctx) {
+    screen_printf(ctx->screen, "\n\n{BLU}### Stack segment ###{NRM}\n");
     int lines = 10;
-    int max_stack_idx = STACK_SEGMENT_LENGTH - 1;
-    int min_stack_idx = 0;
     int fp_idx = 0;
     int sp_idx = 1;
     int i;
-    int first[2];
-    int last[2];
-    int rescaled[] = {processor.regs[FRAME_POINTER] / 4, processor.regs[STACK_POINTER] / 4};
+    quad first[2];
+    quad last[2];
+    quad pointers[] = {(uword) ctx->processor.regs[FRAME_POINTER], (uword) ctx->processor.regs[STACK_POINTER]};
     for (i = 0; i < 2; i++) {
-        first[i] = rescaled[i] + lines/2 + lines%2;
-        last[i] = rescaled[i] - lines/2;
-        if (first[i] > max_stack_idx) { last[i] = last[i] - (first[i] - max_stack_idx); first[i] = max_stack_idx; }
-        if (last[i] < 0) { first[i] = first[i] + last[i]; last[i] = 0; }
-        if (first[i] > max_stack_idx) { first[i] = max_stack_idx; }
+        first[i] = pointers[i] + 4*(lines/2 + lines%2);
+        last[i] = pointers[i] - 4*(lines/2);
+        if (first[i] > STACK_SEGMENT_START) { last[i] = last[i] - (first[i] - STACK_SEGMENT_START); first[i] = STACK_SEGMENT_START; }
     }
     char *names[] = {"fp", "sp"};
-    cprintf("{BLU}FP relative stack             | SP relative stack             | SP~FP relative offset{NRM}\n");
-    for (;first[0]>=last[0] && first[1]>=last[1]; first[0]--, first[1]--) {
+    screen_printf(ctx->screen, "{BLU}FP relative stack             | SP relative stack             | SP~FP relative offset{NRM}\n");
+    for (;first[0]>=last[0] && first[1]>=last[1]; first[0] -= 4, first[1] -= 4) {
         for (i = 0; i < 2; i++) {
             if (first[i] >= last[i]) {
-                if (stack_cache[first[i]] != stack_segment[first[i]]) cprintf("{RED}");
-                printf("[%#10x] %-5d", STACK_SEGMENT_START - (STACK_SEGMENT_LENGTH - first[i] - 1)*4, stack_segment[first[i]]);
-                if (first[i] == rescaled[i]) {
-                    cprintf(" {GRN}<-     %s{NRM} ", names[i]);
+                uword address = first[i];
+                word value = memory_peek(&ctx->memory, address);
+                int cached = (address >> 2) % STACK_CACHE_LENGTH;
+                if (ctx->stack_cache_address[cached] == address && ctx->stack_cache_value[cached] != value) screen_printf(ctx->screen, "{RED}");
+                screen_printf(ctx->screen, "[%#10x] %-5d", address, value);
+                if (first[i] == pointers[i]) {
+                    screen_printf(ctx->screen, " {GRN}<-     %s{NRM} ", names[i]);
                 } else {
-                    int diff = 4*(first[i] - rescaled[i]);
-                    printf(" <- %3d(%s)", diff, names[i]);
+                    int diff = first[i] - pointers[i];
+                    screen_printf(ctx->screen, " <- %3d(%s)", diff, names[i]);
                 }
                 // If we are displaying stack pointer, then also display the relative offset based on the frame pointer
                 if (i == sp_idx) {
-                    int fp_diff = 4*(first[sp_idx] - rescaled[fp_idx]);
-                    cprintf(" {BLU}[%5d(fp)]{NRM}", fp_diff);
+                    int fp_diff = first[sp_idx] - pointers[fp_idx];
+                    screen_printf(ctx->screen, " {BLU}[%5d(fp)]{NRM}", fp_diff);
                 }
-                cprintf("{NRM}");
-                stack_cache[first[i]] = stack_segment[first[i]];
+                screen_printf(ctx->screen, "{NRM}");
+                ctx->stack_cache_address[cached] = address;
+                ctx->stack_cache_value[cached] = value;
             }
-            if (i == fp_idx) printf(" | ");
+            if (i == fp_idx) screen_printf(ctx->screen, " | ");
         }
-        printf("\n");
+        screen_printf(ctx->screen, "\n");
     }
 }
 
-void print_code_segment() {
+void print_code_segment(s_sim_context *ctx) {
     //debug("i am here");
     int lines = 10;
     int i, first, last;
-    for (i = 0; i < source_index; i++)
-        if (source[i].address == processor.pc) break;
+    for (i = 0; i < ctx->source_index; i++)
+        if (ctx->source[i].address == ctx->processor.pc) break;
     first = i - lines/2;
     last = i + lines/2 + lines%2;
     if (first < 0) { last = last - first; first = 0; }
-    if (last > source_index) { first = first + source_index - last; last = source_index; }
+    if (last > ctx->source_index) { first = first + ctx->source_index - last; last = ctx->source_index; }
     if (first < 0) { first = 0; }
-    cprintf("{BLU}### Code segment ###{NRM}");
-    cprintf("\n{BLU}PC    Addr         Label        Instruction{NRM}");
+    screen_printf(ctx->screen, "{BLU}### Code segment ###{NRM}");
+    screen_printf(ctx->screen, "\n{BLU}PC    Addr         Label        Instruction{NRM}");
     for (i = first; i < last ; i++) {
         char c;
-        if (source[i].address == source[i+1].address) c = ' ';
-        else if (source[i].address == processor.pc) c = '>';
+        if (i + 1 < ctx->source_index && ctx->source[i].address == ctx->source[i+1].address) c = ' ';
+        else if (ctx->source[i].address == ctx->processor.pc) c = '>';
+        else if (breakpoint_at(ctx, ctx->source[i].address)) c = '*';
         else c = ' ';
-        cprintf("\n{RED}%c{NRM} [%#10x] %s%s{NRM}", c, TEXT_SEGMENT_START + 4*source[i].address,
-                c == '>' ? "[RED]" : "", source[i].text);
+        screen_printf(ctx->screen, "\n{RED}%c{NRM} [%#10x] %s%s{NRM}", c, TEXT_SEGMENT_START + 4*ctx->source[i].address,
+                c == '>' ? "[RED]" : "", ctx->source[i].text);
     }
 }
 
-word run_interactive() {
-    //debug("running interactiveee dsjgnsksdkgsdkdg");
-    do {
-        system("clear");
-        //debug("i am hereeeeeeee");
-        print_code_segment();
-        print_global_segment();
-        print_registers();
-        print_stack_segment();
-        printf("\nPress any key to continue, ctrl+c for exit...");
-        getch();
-        step();
-    } while (!processor.done);
-    system("clear");
-    print_code_segment();
-    print_global_segment();
-    print_registers();
-    print_stack_segment();
-    cprintf("\n\n{BLU}Program exit code (%s): {GRN}%d{NRM}\n", abi_regs[FUNCTION_REGISTER], processor.regs[FUNCTION_REGISTER]);
+void source_lines(s_sim_context *ctx, const char **lines, const char **labels) {
+    const char *label = NULL;
+    int i;
+    // the last source line of an address is its instruction, the ones before it are labels
+    for (i = 0; i < ctx->source_index; i++) {
+        int address = ctx->source[i].address;
+        if (ctx->source[i].text[0] != '\t') {
+            label = ctx->source[i].text;
+        } else if (address >= 0 && address < ctx->program_image.text_length) {
+            lines[address] = ctx->source[i].text;
+            labels[address] = label;
+        }
+    }
+}
+
+const char *source_text(const char *text, char *buffer) {
+    while (*text == '\t') text++;
+    snprintf(buffer, CHAR_BUFFER_LENGTH, "%.*s", (int) strcspn(text, ":"), text);
+    return buffer;
+}
+
+// executes one instruction in the interactive mode
+void interactive_step(s_sim_context *ctx) {
+    int pc = ctx->processor.pc;
+    checkpoint_if_due(ctx);
+    observed_step(ctx);
+    if (ctx->profile != NULL) profile_block(ctx, pc, 1);
+    if (ctx->flamegraph != NULL) flamegraph_block(ctx, pc, 1);
+    ctx->step_count++;
+}
+
+// draws the whole state with the status text in the last row, only the changes reach the terminal
+void render_frame(s_sim_context *ctx, const char *status) {
+    screen_begin(ctx->screen);
+    print_code_segment(ctx);
+    print_global_segment(ctx);
+    print_registers(ctx);
+    print_stack_segment(ctx);
+    screen_line(ctx->screen, ctx->screen->rows - 1);
+    screen_printf(ctx->screen, "%s", status);
+    screen_flush(ctx->screen);
+}
+
+// edits a line in the last row of the screen, returns FALSE if it was cancelled with escape
+int read_line(s_sim_context *ctx, const char *prompt, char *line, int size) {
+    int length = 0;
+    int ch;
+    line[0] = 0;
+    while (TRUE) {
+        screen_line(ctx->screen, ctx->screen->rows - 1);
+        screen_printf(ctx->screen, "{CYN}%s{NRM}%s", prompt, line);
+        screen_flush(ctx->screen);
+        ch = getch();
+        if (ch == '\n' || ch == '\r') return TRUE;
+        if (ch == 27 || ch == EOF) return FALSE;
+        if ((ch == 127 || ch == '\b') && length > 0) {
+            line[--length] = 0;
+        } else if (ch >= ' ' && ch < 127 && length < size - 1) {
+            line[length++] = ch;
+            line[length] = 0;
+        }
+    }
+}
+
+// runs from the instruction on the screen, which is executed even if it has a breakpoint, and describes the stop
+void interactive_run(s_sim_context *ctx, uquad budget, char *status, size_t size) {
+    if (ctx->debug != NULL) ctx->debug->skip_pc = ctx->processor.pc;
+    run_budget(ctx, budget);
+    debug_stop_text(ctx, status, size);
+}
+
+word run_interactive(s_sim_context *ctx) {
+    char line[CHAR_BUFFER_LENGTH];
+    char status[2 * CHAR_BUFFER_LENGTH] = "";
+    char *end;
+    long count;
+    int target, ch, temporary;
+    uword address;
+    ctx->screen = screen_create();
+    history_init(ctx);
+    // a run to the first breakpoint or watchpoint could have happened already
+    debug_stop_text(ctx, status, sizeof(status));
+    while (!ctx->processor.done) {
+        if (status[0] == 0) {
+            snprintf(status, sizeof(status), "{BLU}[step %llu]{NRM} any key - step, n - run N steps, u - run until, "
+                     "c - continue, p - step back, r - reverse continue, b - breakpoint, w - watchpoint, ctrl+c - exit", (unsigned long long) ctx->step_count);
+        }
+        render_frame(ctx, status);
+        status[0] = 0;
+        ch = getch();
+        if (ch == 'n') {
+            if (!read_line(ctx, "Number of steps: ", line, sizeof(line))) continue;
+            count = strtol(line, &end, 10);
+            if (line[0] == 0 || *end != 0 || count <= 0) {
+                snprintf(status, sizeof(status), "{RED}Invalid number of steps: %s{NRM}", line);
+                continue;
+            }
+            interactive_run(ctx, count, status, sizeof(status));
+        } else if (ch == 'u') {
+            if (!read_line(ctx, "Run until address, label or :line: ", line, sizeof(line))) continue;
+            target = breakpoint_location(ctx, line);
+            if (target < 0) {
+                snprintf(status, sizeof(status), "{RED}No instruction at %s{NRM}", line);
+                continue;
+            }
+            // the target is a breakpoint for this run only, so the loops can be followed
+            temporary = !breakpoint_at(ctx, target);
+            set_breakpoint(ctx, target, TRUE);
+            interactive_run(ctx, UNLIMITED_STEPS, status, sizeof(status));
+            if (temporary) set_breakpoint(ctx, target, FALSE);
+            if (ctx->processor.pc == target) status[0] = 0;
+        } else if (ch == 'c') {
+            interactive_run(ctx, UNLIMITED_STEPS, status, sizeof(status));
+        } else if (ch == 'p') {
+            if (history_back(ctx, 1) == 0) {
+                snprintf(status, sizeof(status), "{RED}There is no earlier step in the history{NRM}");
+            }
+        } else if (ch == 'r') {
+            if (history_reverse_continue(ctx) == 0) {
+                snprintf(status, sizeof(status), "{RED}There is no earlier step in the history{NRM}");
+            } else if (debug_stopped(ctx)) {
+                debug_stop_text(ctx, status, sizeof(status));
+            } else {
+                snprintf(status, sizeof(status), "Start of the history at step %llu", (unsigned long long) ctx->step_count);
+            }
+        } else if (ch == 'b') {
+            if (!read_line(ctx, "Breakpoint at address, label or :line: ", line, sizeof(line))) continue;
+            target = breakpoint_location(ctx, line);
+            if (target < 0) {
+                snprintf(status, sizeof(status), "{RED}No instruction at %s{NRM}", line);
+                continue;
+            }
+            set_breakpoint(ctx, target, !breakpoint_at(ctx, target));
+            snprintf(status, sizeof(status), "Breakpoint at %#x %s", TEXT_SEGMENT_START + 4*target,
+                     breakpoint_at(ctx, target) ? "set" : "removed");
+        } else if (ch == 'w') {
+            if (!read_line(ctx, "Watchpoint on global, address or offset(sp|fp): ", line, sizeof(line))) continue;
+            if (!watchpoint_location(ctx, line, &address)) {
+                snprintf(status, sizeof(status), "{RED}Invalid watchpoint location %s{NRM}", line);
+                continue;
+            }
+            if (!set_watchpoint(ctx, address, !watchpoint_at(ctx, address))) {
+                snprintf(status, sizeof(status), "{RED}There can be at most %d watchpoints{NRM}", MAX_WATCHPOINTS);
+                continue;
+            }
+            snprintf(status, sizeof(status), "Watchpoint on %#x %s", address, watchpoint_at(ctx, address) ? "set" : "removed");
+        } else {
+            interactive_step(ctx);
+        }
+    }
+    render_frame(ctx, "");
+    screen_free(ctx->screen);
+    ctx->screen = NULL;
+    history_free(ctx);
+    host_io_flush(ctx);
+    cprintf("\n{BLU}Program exit code (%s): {GRN}%d{NRM}\n", abi_regs[FUNCTION_REGISTER], ctx->processor.regs[FUNCTION_REGISTER]);
     printf("\nAll OK.\n");
+    return ctx->processor.regs[FUNCTION_REGISTER];
 }
 
-word run_simulator() {
+// executes at most budget instructions with the selected engine, returns number of executed instructions
+uquad run_steps(s_sim_context *ctx, uquad budget) {
+    uquad executed = 0;
     int i;
-    // for (i = 0; i < source_index; i++) {
-    //     debug("%d: %s", source[i].address, source[i].text);
-    // }
-    // for (i = 0; i < global_index; i++) {
-    //     debug("%s: %d", globals[i].name, globals[i].offset);
-    // }
-    check_undefined_labels();
-    do {
-        step();
-        if (max_steps > 0) max_steps--;
-    } while (!processor.done && (max_steps != 0));
-    return processor.regs[FUNCTION_REGISTER];
-}
\ No newline at end of file
+    // the profiler, the timing models and the history see every block in the loop below, so they run
+    // without the other engines, a trace alone runs in the threaded engine outside of the debugger
+    int modeled = ctx->pipeline != NULL || ctx->icache != NULL || ctx->dcache != NULL || ctx->predictor != NULL
+                  || ctx->history != NULL;
+    int timed = modeled || ctx->trace != NULL;
+    int observed = ctx->profile != NULL || ctx->flamegraph != NULL || timed;
+    s_debugger *debug = ctx->debug;
+    const int *block_length = debug != NULL ? debug->block_length : ctx->program_image.block_length;
+    if (debug != NULL) {
+        ctx->memory.watch_hit = FALSE;
+        // a run that starts at the breakpoint where the previous one stopped executes its instruction first
+        if (budget > 0 && ctx->processor.pc == debug->skip_pc && breakpoint_at(ctx, ctx->processor.pc)) {
+            int start = ctx->processor.pc;
+            if (timed) observed_step(ctx); else step(ctx);
+            if (ctx->profile != NULL) profile_block(ctx, start, 1);
+            if (ctx->flamegraph != NULL) flamegraph_block(ctx, start, 1);
+            executed = 1;
+        }
+    }
+    if (executed == budget || ctx->processor.done || ctx->memory.watch_hit) {
+        // nothing left to do
+    } else if (use_jit && !observed && debug == NULL) {
+        executed += jit_run(ctx, budget - executed);
+    } else if ((use_threaded_engine || use_jit) && !observed) {
+        threaded_translate(ctx);
+        executed += threaded_run(ctx, budget - executed);
+    } else if (ctx->trace != NULL && !modeled && ctx->profile == NULL && ctx->flamegraph == NULL && debug == NULL) {
+        // the traced variants of the threaded handlers write the records
+        threaded_translate(ctx);
+        executed += threaded_run(ctx, budget - executed);
+    } else {
+        while (executed < budget && !ctx->processor.done) {
+            // done and the budget are checked once per basic block, nop can only be the last instruction
+            int length = 1;
+            int start = ctx->processor.pc;
+            if (ctx->processor.pc >= 0 && ctx->processor.pc < ctx->program_image.text_length) {
+                length = block_length[ctx->processor.pc];
+            }
+            // blocks of the debugger start at breakpoints and end with stores
+            if (debug != NULL && breakpoint_at(ctx, start)) {
+                break;
+            }
+            if ((uquad) length > budget - executed) {
+                length = 1;
+            }
+            // csrr can only be the last instruction of a block
+            ctx->run_executed = executed + length - 1;
+            if (ctx->trace != NULL && !modeled) {
+                trace_block(ctx, length);
+            } else if (timed) {
+                for (i = 0; i < length; i++) {
+                    observed_step(ctx);
+                }
+            } else {
+                for (i = 0; i < length; i++) {
+                    step(ctx);
+                }
+            }
+            if (ctx->profile != NULL) profile_block(ctx, start, length);
+            if (ctx->flamegraph != NULL) flamegraph_block(ctx, start, length);
+            executed += length;
+            if (debug != NULL && ctx->memory.watch_hit) {
+                break;
+            }
+        }
+    }
+    ctx->run_executed = 0;
+    if (debug != NULL) {
+        debug_check_stop(ctx);
+    }
+    return executed;
+}
+
+uquad run_budget(s_sim_context *ctx, uquad budget) {
+    uquad executed = 0;
+    if (ctx->debug != NULL) {
+        ctx->debug->stop = STOP_NONE;
+    }
+    checkpoint_if_due(ctx);
+    if (ctx->checkpoint_path != NULL && ctx->checkpoint_at > ctx->step_count) {
+        // stop exactly at the checkpoint, then continue with the rest of the budget
+        uquad until_checkpoint = ctx->checkpoint_at - ctx->step_count;
+        executed = run_steps(ctx, budget < until_checkpoint ? budget : until_checkpoint);
+        ctx->step_count += executed;
+        if (!ctx->processor.done) {
+            checkpoint_if_due(ctx);
+        }
+    }
+    if (executed < budget && !ctx->processor.done && !debug_stopped(ctx)) {
+        uquad rest = run_steps(ctx, budget - executed);
+        executed += rest;
+        ctx->step_count += rest;
+    }
+    return executed;
+}
+
+word run_simulator(s_sim_context *ctx) {
+    // -s 0 executes one step, like the original do-while loop
+    uquad budget = ctx->max_steps > 0 ? ctx->max_steps : (ctx->max_steps == 0 ? 1 : UNLIMITED_STEPS);
+    uquad executed = run_budget(ctx, budget);
+    char message[2 * CHAR_BUFFER_LENGTH];
+    // a complete run reports every breakpoint and watchpoint and goes on
+    while (debug_stopped(ctx)) {
+        debug_stop_text(ctx, message, sizeof(message));
+        fprintf(stderr, "\n%s\n", message);
+        if (executed == budget || ctx->processor.done) break;
+        executed += run_budget(ctx, budget - executed);
+    }
+    if (ctx->checkpoint_path != NULL) {
+        fprintf(stderr, "\nWarning: program stopped after %llu steps, no checkpoint was written\n", (unsigned long long) ctx->step_count);
+    }
+    if (ctx->max_steps > 0) ctx->max_steps -= executed;
+    host_io_flush(ctx);
+    return ctx->processor.regs[FUNCTION_REGISTER];
+}
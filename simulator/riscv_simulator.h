@@ -1,7 +1,10 @@
 #ifndef RISCV_SIMULATOR_H
 #define RISCV_SIMULATOR_H
 
+#include <stdio.h>
+#include <setjmp.h>
 #include "defs.h"
+#include "memory.h"
 
 /*******************
 * Structures
@@ -36,80 +39,231 @@ typedef struct _symbol {
 typedef struct _source {
     char *text;
     int address;
+    int line;               // line in the assembly file, 0 for programs loaded from ELF files
 } s_source;
 
+// open addressing hash table over an array of symbols, slots hold symbol index + 1 (0 is an empty slot)
+typedef struct _symbol_hash {
+    int *slots;
+    int capacity;
+} s_symbol_hash;
+
+// linked program, shared read-only by all execution engines
+// block_length[i] is the number of instructions from i up to the end of its basic block
+typedef struct _image {
+    const s_instruction *text;
+    const int *block_length;
+    int text_length;
+} s_image;
+
+// complete state of one simulation, every simulator function works on the context it gets
+typedef struct _sim_context {
+    s_processor processor;
+    s_memory memory;
+    s_image program_image;
+    // program as it is built by the parser or the ELF loader, arrays grow as needed
+    s_instruction *section_text;
+    s_symbol *symbol_table;
+    s_symbol *globals;
+    s_source *source;
+    s_symbol_hash label_hash;
+    s_symbol_hash global_hash;
+    // defined labels which are bound to the next inserted instruction
+    int *pending_labels;
+    int pending_count;
+    int pending_capacity;
+    char source_buffer[CHAR_BUFFER_LENGTH];
+    // set while parse_program() runs, source lines then get their line numbers
+    int parsing;
+    int symtab_index;
+    int data_index;
+    int text_index;
+    int source_index;
+    int global_index;
+    int text_capacity;
+    int symtab_capacity;
+    int source_capacity;
+    int global_capacity;
+    int error_count;
+    // step limit (-s), number of executed instructions and the requested checkpoint
+    int max_steps;
+    uquad step_count;
+    // instructions the running engine has executed but not yet added to step_count (instret is the sum)
+    uquad run_executed;
+    uquad checkpoint_at;
+    char *checkpoint_path;
+    // code translated by the threaded engine and the JIT on the first run
+    struct _threaded_ins *threaded_text;
+    struct _jit *jit;
+    // execution counters of the profiler (-p), NULL if profiling is off
+    struct _profile *profile;
+    // shadow call stack and its samples (--flamegraph), NULL if it is off
+    struct _flamegraph *flamegraph;
+    // timing model of the 5-stage pipeline (--pipeline), NULL if it is off
+    struct _pipeline *pipeline;
+    // L1 cache models (--icache, --dcache), NULL if they are off
+    struct _cache *icache;
+    struct _cache *dcache;
+    // branch predictor (--predictor), NULL if it is off
+    struct _predictor *predictor;
+    // binary execution trace (--trace), NULL if it is off
+    struct _trace *trace;
+    // undo log and snapshots of the interactive mode, NULL outside of it
+    struct _history *history;
+    // breakpoints and watchpoints, NULL if none are set
+    struct _debugger *debug;
+    // terminal frame of the interactive mode, NULL outside of it
+    struct _screen *screen;
+    // output buffer of the system calls, NULL until the program writes
+    struct _host_io *io;
+    int io_shared;
+    // reference context of --cosim, NULL if it is off
+    struct _cosim *cosim;
+    // mhartid, and the other harts of --harts (the first hart only), NULL for one hart
+    int hart_id;
+    struct _harts *harts;
+    // reservation of lr.w, which sc.w needs
+    int reserved;
+    uword reservation_address;
+    word reservation_value;
+    // values shown in the previous frame of the interactive mode, used to highlight the changed ones
+    word reg_cache[RV32I_REG_NUM];
+    word *global_cache;
+    uword stack_cache_address[STACK_CACHE_LENGTH];
+    word stack_cache_value[STACK_CACHE_LENGTH];
+    // if set, errors jump here with error_code and error_message instead of exiting
+    jmp_buf *error_jump;
+    int error_code;
+    char error_message[CHAR_BUFFER_LENGTH];
+} s_sim_context;
+
+// context of the simulation running on the current thread
+extern __thread s_sim_context *current_context;
+
 /*******************
 * Macros
 *******************/
 
 #define GENERATE_BRANCH(compare) {\
     if (ins->sign_type == SIGNED_TYPE) {\
-        word rs1_val = *get_reg(ins->source1.register_index);\
-        word rs2_val = *get_reg(ins->source2.register_index);\
+        word rs1_val = *get_reg(ctx, ins->source1.register_index);\
+        word rs2_val = *get_reg(ctx, ins->source2.register_index);\
         if (rs1_val compare rs2_val) {\
-            processor.pc = get_label_address(ins->destination.data);\
+            ctx->processor.pc = ins->destination.data;\
         } else {\
-            processor.pc++;\
+            ctx->processor.pc++;\
         }\
     } else {\
-        uword rs1_val = (uword) *get_reg(ins->source1.register_index);\
-        uword rs2_val = (uword) *get_reg(ins->source2.register_index);\
+        uword rs1_val = (uword) *get_reg(ctx, ins->source1.register_index);\
+        uword rs2_val = (uword) *get_reg(ctx, ins->source2.register_index);\
         if (rs1_val compare rs2_val) {\
-            processor.pc = get_label_address(ins->destination.data);\
+            ctx->processor.pc = ins->destination.data;\
         } else {\
-            processor.pc++;\
+            ctx->processor.pc++;\
         }\
     }\
 }\
 
 // Copy-pase from hipsim :D
 //pomoćni makroi za parser
-extern char source_buffer[];
 //makro za ubacivanje linije koda u source za ispis
-#define insert_source(args...) sprintf(source_buffer, args), insert_source_f(source_buffer)
+#define insert_source(ctx, args...) snprintf(ctx->source_buffer, sizeof ctx->source_buffer, args), insert_source_f(ctx, ctx->source_buffer)
 
 /*******************
 * Functions
 *******************/
 
+// grows the array to hold at least needed elements, new elements are zeroed
+void *grow_array(void *array, int *capacity, int needed, size_t element_size);
+
+// makes room for count more instructions, source lines or globals
+void reserve_text(s_sim_context *ctx, int count);
+void reserve_source(s_sim_context *ctx, int count);
+void reserve_globals(s_sim_context *ctx, int count);
+
+// returns index of the symbol with the name, or -1 if it is not in the table
+int find_symbol(s_symbol_hash *hash, const s_symbol *symbols, const char *name);
+
+// adds symbols[index] to the table, count is the number of symbols in the array
+void add_symbol(s_symbol_hash *hash, const s_symbol *symbols, int count, int index);
+
 // read the value stored in the register
-word *get_reg(uchar reg);
+word *get_reg(s_sim_context *ctx, uchar reg);
+
+// result of RV32M instruction
+word muldiv(uchar ins_type, word rs1, word rs2);
 
 // read the data from memory (global or stack segment) based on the input register
-word *get_memory(uchar reg, word offset);
+word *get_memory(s_sim_context *ctx, uchar reg, word offset);
+
+// same as get_memory(), for the word which is about to be written (stores are checked against the watchpoints)
+word *get_store_memory(s_sim_context *ctx, uchar reg, word offset);
+
+// get pointer to the word of an atomic instruction, the address is in the register
+word *get_atomic_memory(s_sim_context *ctx, uchar reg);
+
+// executes the amo instruction on the word atomically, returns the old value
+word amo(uchar ins_type, word *memory, word value);
+
+// reads the CSR for csrr
+word csr_read(s_sim_context *ctx, word csr);
+
+// name of the CSR in the assembly, NULL if csrr can't read it
+const char *csr_name(word csr);
+
+// number of the CSR with the name, -1 if csrr can't read it
+word csr_number(const char *name);
 
 // get label address
-int get_label_address(word label_index);
+int get_label_address(s_sim_context *ctx, word label_index);
 
 // ensures that the label is crated, returns index of the label in the symbol table
-int ensure_label(char *name);
+int ensure_label(s_sim_context *ctx, char *name);
 
 // insert label definition
-void insert_label(char *name);
+void insert_label(s_sim_context *ctx, char *name);
+
+// adds the label to the symbol table without looking for it first
+void insert_label_unchecked(s_sim_context *ctx, char *name, uchar defined);
 
 // insert unconditional jump instruction in section text
-void insert_jump(uchar ins_type, char *name);
+void insert_jump(s_sim_context *ctx, uchar ins_type, char *name);
 
 // insert branch instruction in section text
-void insert_branch(uchar ins_type, uchar sign_type, uchar rs1, uchar rs2, char *name);
+void insert_branch(s_sim_context *ctx, uchar ins_type, uchar sign_type, uchar rs1, uchar rs2, char *name);
+
+// insert unconditional jump to already known text index (used by the ELF loader)
+void insert_jump_to(s_sim_context *ctx, uchar ins_type, int target);
+
+// insert branch to already known text index (used by the ELF loader)
+void insert_branch_to(s_sim_context *ctx, uchar ins_type, uchar sign_type, uchar rs1, uchar rs2, int target);
 
 // insers load & store instruction in section text
-void insert_load_store(uchar ins_type, uchar rd, word offset, uchar rs);
+void insert_load_store(s_sim_context *ctx, uchar ins_type, uchar rd, word offset, uchar rs);
 
 // insert arithmetic instruction in section text
-void insert_arithmetic(uchar ins_type, uchar rd, uchar rs1, uchar rs2);
+void insert_arithmetic(s_sim_context *ctx, uchar ins_type, uchar rd, uchar rs1, uchar rs2);
 
 // insert arithmetic immediate instruction in section text
-void insert_arithmetic_immediate(uchar ins_type, uchar rd, uchar rs1, word immediate);
+void insert_arithmetic_immediate(s_sim_context *ctx, uchar ins_type, uchar rd, uchar rs1, word immediate);
 
 // inserts nop instruction
-void insert_nop();
+void insert_nop(s_sim_context *ctx);
+
+// inserts ecall instruction
+void insert_ecall(s_sim_context *ctx);
+
+// inserts lr.w, sc.w or amo instruction, rs1 holds the address
+void insert_atomic(s_sim_context *ctx, uchar ins_type, uchar rd, uchar rs2, uchar rs1);
+
+// inserts csrr instruction
+void insert_csrr(s_sim_context *ctx, uchar rd, word csr);
 
 // insert global in section data
-void insert_data(word data);
+void insert_data(s_sim_context *ctx, word data);
 
 // insert global symbol 
-void insert_global(char *name);
+void insert_global(s_sim_context *ctx, char *name);
 
 // create register operand
 s_operand create_reg_operand(uchar reg);
@@ -121,43 +275,77 @@ s_operand create_imm_operand(word imm);
 s_operand create_reg_offset_operand(word offset, uchar reg);
 
 // create address operand
-s_operand create_address_operand(char *name);
+s_operand create_address_operand(s_sim_context *ctx, char *name);
 
 // insert instruction in section text
-void insert_instruction(s_instruction *ins);
+void insert_instruction(s_sim_context *ctx, s_instruction *ins);
 
 // initializes simulator
-void init_simulator();
+void init_simulator(s_sim_context *ctx);
+
+// allocates and initializes a new context
+s_sim_context *create_context();
+
+// releases the context together with its memory and translated code
+void free_context(s_sim_context *ctx);
 
 // executes one instruction
-void step();
+void step(s_sim_context *ctx);
+
+// executes one instruction and feeds it to the pipeline, cache and branch predictor models
+void observed_step(s_sim_context *ctx);
 
 // runs simulation and returns exit code from main
-word run_simulator();
+word run_simulator(s_sim_context *ctx);
+
+// runs at most budget instructions, stops exactly at the checkpoint and at breakpoints and watchpoints,
+// returns number of executed instructions
+uquad run_budget(s_sim_context *ctx, uquad budget);
 
 // check if there are any labels which are not defined
-void check_undefined_labels();
+void check_undefined_labels(s_sim_context *ctx);
+
+// resolves label operands into text indexes and freezes section text into program_image
+void link_program(s_sim_context *ctx);
+
+// check if the instruction ends a basic block (control transfer or nop)
+int is_block_end(uchar ins_type);
+
+// check if the instruction is lr.w, sc.w or amo (all of them except lr.w store)
+int is_atomic(uchar ins_type);
 
 // return u extension for unsigned instructions or no extension for the signed ones
 char type_char(int sign_type);
 
 // insert source code
-void insert_source_f(char *source);
+void insert_source_f(s_sim_context *ctx, char *source);
+
+// fills the instruction line and the label above it for every text index (NULL where there is no source)
+void source_lines(s_sim_context *ctx, const char **lines, const char **labels);
+
+// copies a source line without indentation and without the colon of a label, returns the buffer
+const char *source_text(const char *text, char *buffer);
 
 // runs simulator in the interactive mode
-word run_interactive();
+word run_interactive(s_sim_context *ctx);
+
+// writes register values to the interactive screen
+void print_registers(s_sim_context *ctx);
+
+// writes global segment to the interactive screen
+void print_global_segment(s_sim_context *ctx);
 
-// prints register values
-void print_registers();
+// writes stack segment to the interactive screen
+void print_stack_segment(s_sim_context *ctx);
 
-// prints global segment
-void print_global_segment();
+// writes code segment to the interactive screen
+void print_code_segment(s_sim_context *ctx);
 
-// prints stack segment
-void print_stack_segment();
+// parses assembly into the context and checks the labels, returns number of errors (riscvsim.y)
+int parse_program(s_sim_context *ctx, FILE *input);
 
-// prints code segment
-void print_code_segment();
+// loads an ELF executable or an assembly file into the context (riscvsim.y)
+void load_program(s_sim_context *ctx, const char *path, int with_source);
 
 //pomoćne funkcije
 int getch(void);
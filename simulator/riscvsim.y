@@ -8,22 +8,46 @@
 #include <getopt.h>
 #include <libgen.h> //basename
 #include <unistd.h> //isatty
+#include <setjmp.h>
+#include <pthread.h>
 #include "defs.h"
 #include "riscv_simulator.h"
+#include "elf_loader.h"
+#include "checkpoint.h"
+#include "batch.h"
+#include "profiler.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "predictor.h"
+#include "debugger.h"
+#include "trace.h"
+#include "cosim.h"
+#include "harts.h"
+#include "stats.h"
+#include "flamegraph.h"
 
-int yyparse(void);
 int yylex(void);
-int yyerror(char *s);
+int yyerror(s_sim_context *ctx, char *s);
 void warning(char *s);
+void yyrestart(FILE *input);
 
 extern int yylineno;
 extern int max_steps;
+extern int use_threaded_engine;
+extern int use_jit;
 char char_buffer[CHAR_BUFFER_LENGTH];
-int error_count = 0;
 int mainarg = 0;
+// scanner and parser are not reentrant, batch workers parse one at a time
+pthread_mutex_t parse_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 %}
 
+%code requires {
+#include "riscv_simulator.h"
+}
+
+%parse-param { s_sim_context *ctx }
+
 %union {
     long i;
     char* s;
@@ -48,12 +72,20 @@ int mainarg = 0;
 %token _ADDI
 %token _SUB
 %token _MV
+%token <i> _SHIFT_IMM
+%token <i> _MULDIV
 
 %token _LW
 %token _SW
 %token _LI
 
 %token _NOP
+%token _ECALL
+%token _LR
+%token _SC
+%token <i> _AMO
+%token _CSRR
+%token <i> _RDCSR
 
 %token <i> _NUMBER
 %token <i> _REGISTER
@@ -82,8 +114,8 @@ variable_list
 variable
     : _LABEL_DEF _WORD _NUMBER
     {
-        insert_global($1);
-        insert_data($3);
+        insert_global(ctx, $1);
+        insert_data(ctx, $3);
     }
     ;
 
@@ -105,9 +137,9 @@ label_def
     : _LABEL_DEF
     {
         //debug("inserting label %s ...", $1);
-        insert_source("%s:", $1);
+        insert_source(ctx, "%s:", $1);
         //debug("inserted label in source");
-        insert_label($1);
+        insert_label(ctx, $1);
     }
     ;
 
@@ -116,6 +148,8 @@ asm_line
     | branch_ins
     | load_store_ins
     | arithmetic_ins
+    | atomic_ins
+    | csr_ins
     ;
 
 jump_ins
@@ -127,24 +161,24 @@ jump_ins
 jal_ins
     : _JAL _LABEL
     {
-        insert_source("\t\t\tjal %s", $2);
-        insert_jump(INS_JAL, $2);
+        insert_source(ctx, "\t\t\tjal %s", $2);
+        insert_jump(ctx, INS_JAL, $2);
     }
     ;
 
 j_ins
     : _J _LABEL
     {
-        insert_source("\t\t\tj %s", $2);
-        insert_jump(INS_J, $2);
+        insert_source(ctx, "\t\t\tj %s", $2);
+        insert_jump(ctx, INS_J, $2);
     }
     ;
 
 ret_ins
     : _RET
     {
-        insert_source("\t\t\tret");
-        insert_jump(INS_RET, NULL);
+        insert_source(ctx, "\t\t\tret");
+        insert_jump(ctx, INS_RET, NULL);
     }
     ;
 
@@ -160,48 +194,48 @@ branch_ins
 bge_ins
     : _BGE _REGISTER _COMMA _REGISTER _COMMA _LABEL
     {
-        insert_source("\t\t\tbge%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
-        insert_branch(INS_BGE, $1, $2, $4, $6);
+        insert_source(ctx, "\t\t\tbge%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
+        insert_branch(ctx, INS_BGE, $1, $2, $4, $6);
     }
     ;
 
 ble_ins
     : _BLE _REGISTER _COMMA _REGISTER _COMMA _LABEL
     {
-        insert_source("\t\t\tble%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
-        insert_branch(INS_BLE, $1, $2, $4, $6);
+        insert_source(ctx, "\t\t\tble%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
+        insert_branch(ctx, INS_BLE, $1, $2, $4, $6);
     }
     ;
 
 bgt_ins
     : _BGT _REGISTER _COMMA _REGISTER _COMMA _LABEL
     {
-        insert_source("\t\t\tbgt%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
-        insert_branch(INS_BGT, $1, $2, $4, $6);
+        insert_source(ctx, "\t\t\tbgt%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
+        insert_branch(ctx, INS_BGT, $1, $2, $4, $6);
     }
     ;
 
 blt_ins
     : _BLT _REGISTER _COMMA _REGISTER _COMMA _LABEL
     {
-        insert_source("\t\t\tblt%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
-        insert_branch(INS_BLT, $1, $2, $4, $6);
+        insert_source(ctx, "\t\t\tblt%c %s, %s, %s", type_char($1), abi_regs[$2], abi_regs[$4], $6);
+        insert_branch(ctx, INS_BLT, $1, $2, $4, $6);
     }
     ;
 
 beq_ins
     : _BEQ _REGISTER _COMMA _REGISTER _COMMA _LABEL
     {
-        insert_source("\t\t\tbeq %s, %s, %s", abi_regs[$2], abi_regs[$4], $6);
-        insert_branch(INS_BEQ, $1, $2, $4, $6);
+        insert_source(ctx, "\t\t\tbeq %s, %s, %s", abi_regs[$2], abi_regs[$4], $6);
+        insert_branch(ctx, INS_BEQ, $1, $2, $4, $6);
     }
     ;
 
 bne_ins
     : _BNE _REGISTER _COMMA _REGISTER _COMMA _LABEL
     {
-        insert_source("\t\t\tbne %s, %s, %s", abi_regs[$2], abi_regs[$4], $6);
-        insert_branch(INS_BNE, $1, $2, $4, $6);
+        insert_source(ctx, "\t\t\tbne %s, %s, %s", abi_regs[$2], abi_regs[$4], $6);
+        insert_branch(ctx, INS_BNE, $1, $2, $4, $6);
     }
     ;
 
@@ -214,24 +248,24 @@ load_store_ins
 load_ins
     : _LW _REGISTER _COMMA _NUMBER _LPAREN _REGISTER _RPAREN
     {
-        insert_source("\t\t\tlw %s, %ld(%s)", abi_regs[$2], $4, abi_regs[$6]);
-        insert_load_store(INS_LW, $2, $4, $6);
+        insert_source(ctx, "\t\t\tlw %s, %ld(%s)", abi_regs[$2], $4, abi_regs[$6]);
+        insert_load_store(ctx, INS_LW, $2, $4, $6);
     }
     ;
 
 store_ins
     : _SW _REGISTER _COMMA _NUMBER _LPAREN _REGISTER _RPAREN
     {
-        insert_source("\t\t\tsw %s, %ld(%s)", abi_regs[$2], $4, abi_regs[$6]);
-        insert_load_store(INS_SW, $2, $4, $6);
+        insert_source(ctx, "\t\t\tsw %s, %ld(%s)", abi_regs[$2], $4, abi_regs[$6]);
+        insert_load_store(ctx, INS_SW, $2, $4, $6);
     }
     ;
 
 load_imm_ins
     : _LI _REGISTER _COMMA _NUMBER
     {
-        insert_source("\t\t\tli %s, %ld", abi_regs[$2], $4);
-        insert_load_store(INS_LI, $2, $4, 88);
+        insert_source(ctx, "\t\t\tli %s, %ld", abi_regs[$2], $4);
+        insert_load_store(ctx, INS_LI, $2, $4, 88);
     }
     ;
 
@@ -240,80 +274,374 @@ arithmetic_ins
     | addi_ins
     | sub_ins
     | mv_ins
+    | shift_imm_ins
+    | muldiv_ins
     | _NOP
     {
-        insert_source("\t\t\tnop");
-        insert_nop();
+        insert_source(ctx, "\t\t\tnop");
+        insert_nop(ctx);
+    }
+    | _ECALL
+    {
+        insert_source(ctx, "\t\t\tecall");
+        insert_ecall(ctx);
     }
     ;
 
 add_ins
     : _ADD _REGISTER _COMMA _REGISTER _COMMA _REGISTER
     {
-        insert_source("\t\t\tadd %s, %s, %s", abi_regs[$2], abi_regs[$4], abi_regs[$6]);
-        insert_arithmetic(INS_ADD, $2, $4, $6);
+        insert_source(ctx, "\t\t\tadd %s, %s, %s", abi_regs[$2], abi_regs[$4], abi_regs[$6]);
+        insert_arithmetic(ctx, INS_ADD, $2, $4, $6);
     }
     ;
 
 addi_ins
     : _ADDI _REGISTER _COMMA _REGISTER _COMMA _NUMBER
     {
-        insert_source("\t\t\taddi %s, %s, %ld", abi_regs[$2], abi_regs[$4], $6);
-        insert_arithmetic_immediate(INS_ADDI, $2, $4, $6);
+        insert_source(ctx, "\t\t\taddi %s, %s, %ld", abi_regs[$2], abi_regs[$4], $6);
+        insert_arithmetic_immediate(ctx, INS_ADDI, $2, $4, $6);
     }
     ;
 
 sub_ins
     : _SUB _REGISTER _COMMA _REGISTER _COMMA _REGISTER
     {
-        insert_source("\t\t\tsub %s, %s, %s", abi_regs[$2], abi_regs[$4], abi_regs[$6]);
-        insert_arithmetic(INS_SUB, $2, $4, $6);
+        insert_source(ctx, "\t\t\tsub %s, %s, %s", abi_regs[$2], abi_regs[$4], abi_regs[$6]);
+        insert_arithmetic(ctx, INS_SUB, $2, $4, $6);
     }
     ;
 
 mv_ins
     : _MV _REGISTER _COMMA _REGISTER
     {
-        insert_source("\t\t\tmv %s, %s", abi_regs[$2], abi_regs[$4]);
-        insert_arithmetic_immediate(INS_MV, $2, $4, 0);
+        insert_source(ctx, "\t\t\tmv %s, %s", abi_regs[$2], abi_regs[$4]);
+        insert_arithmetic_immediate(ctx, INS_MV, $2, $4, 0);
+    }
+    ;
+
+shift_imm_ins
+    : _SHIFT_IMM _REGISTER _COMMA _REGISTER _COMMA _NUMBER
+    {
+        if ($6 < 0 || $6 >= 32) {
+            parsererror("shift amount %ld out of range 0..31", $6);
+        }
+        insert_source(ctx, "\t\t\t%s %s, %s, %ld", ins_names[$1], abi_regs[$2], abi_regs[$4], $6);
+        insert_arithmetic_immediate(ctx, $1, $2, $4, $6);
+    }
+    ;
+
+muldiv_ins
+    : _MULDIV _REGISTER _COMMA _REGISTER _COMMA _REGISTER
+    {
+        insert_source(ctx, "\t\t\t%s %s, %s, %s", ins_names[$1], abi_regs[$2], abi_regs[$4], abi_regs[$6]);
+        insert_arithmetic(ctx, $1, $2, $4, $6);
+    }
+    ;
+
+atomic_ins
+    : _LR _REGISTER _COMMA _LPAREN _REGISTER _RPAREN
+    {
+        insert_source(ctx, "\t\t\tlr.w %s, (%s)", abi_regs[$2], abi_regs[$5]);
+        insert_atomic(ctx, INS_LR, $2, 0, $5);
+    }
+    | _SC _REGISTER _COMMA _REGISTER _COMMA _LPAREN _REGISTER _RPAREN
+    {
+        insert_source(ctx, "\t\t\tsc.w %s, %s, (%s)", abi_regs[$2], abi_regs[$4], abi_regs[$7]);
+        insert_atomic(ctx, INS_SC, $2, $4, $7);
+    }
+    | _AMO _REGISTER _COMMA _REGISTER _COMMA _LPAREN _REGISTER _RPAREN
+    {
+        insert_source(ctx, "\t\t\t%s %s, %s, (%s)", ins_names[$1], abi_regs[$2], abi_regs[$4], abi_regs[$7]);
+        insert_atomic(ctx, $1, $2, $4, $7);
+    }
+    ;
+
+csr_ins
+    : _CSRR _REGISTER _COMMA _LABEL
+    {
+        // CSR names aren't keywords, so labels like time or cycle stay usable
+        word csr = csr_number($4);
+        if (csr < 0) {
+            parsererror("unknown CSR %s", $4);
+        }
+        free($4);
+        insert_source(ctx, "\t\t\tcsrr %s, %s", abi_regs[$2], csr_name(csr));
+        insert_csrr(ctx, $2, csr);
+    }
+    | _CSRR _REGISTER _COMMA _NUMBER
+    {
+        if (csr_name($4) == NULL) {
+            parsererror("unknown CSR %ld", $4);
+        }
+        insert_source(ctx, "\t\t\tcsrr %s, %s", abi_regs[$2], csr_name($4));
+        insert_csrr(ctx, $2, $4);
+    }
+    | _RDCSR _REGISTER
+    {
+        insert_source(ctx, "\t\t\trd%s %s", csr_name($1), abi_regs[$2]);
+        insert_csrr(ctx, $2, $1);
     }
     ;
 
 %%
 
-int yyerror(char *s) {
-    fprintf(stderr, "\nSimulator: ASM parsing error in line %d: %s\n", yylineno, s);
-    error_count++;
+int yyerror(s_sim_context *ctx, char *s) {
+    if (ctx->error_jump != NULL) {
+        // batch mode reports only the first error of each program
+        if (ctx->error_count == 0) {
+            snprintf(ctx->error_message, sizeof(ctx->error_message), "ASM parsing error in line %d: %s", yylineno, s);
+        }
+    } else {
+        fprintf(stderr, "\nSimulator: ASM parsing error in line %d: %s\n", yylineno, s);
+    }
+    ctx->error_count++;
     return 0;
 }
 
+int parse_program(s_sim_context *ctx, FILE *input) {
+    jmp_buf jump;
+    jmp_buf *outer = ctx->error_jump;
+    int errors;
+    pthread_mutex_lock(&parse_mutex);
+    yyrestart(input);
+    yylineno = 1;
+    if (outer != NULL) {
+        // release the parser before the error reaches the context
+        ctx->error_jump = &jump;
+        if (setjmp(jump) != 0) {
+            ctx->error_jump = outer;
+            ctx->parsing = FALSE;
+            pthread_mutex_unlock(&parse_mutex);
+            longjmp(*outer, 1);
+        }
+    }
+    ctx->parsing = TRUE;
+    yyparse(ctx);
+    ctx->parsing = FALSE;
+    if (ctx->error_count == 0) {
+        check_undefined_labels(ctx);
+    }
+    errors = ctx->error_count;
+    ctx->error_jump = outer;
+    pthread_mutex_unlock(&parse_mutex);
+    return errors;
+}
+
+void load_program(s_sim_context *ctx, const char *path, int with_source) {
+    FILE *input;
+    // RV32 executables are decoded directly, anything else is parsed as assembly
+    if (is_elf_file(path)) {
+        load_elf(ctx, path, with_source);
+        return;
+    }
+    input = fopen(path, "r");
+    if (input == NULL) {
+        argerror("Can't open input file %s", path);
+    }
+    parse_program(ctx, input);
+    fclose(input);
+}
+
+//dugačke opcije
+enum { OPT_CHECKPOINT_AT = 256, OPT_RESTORE, OPT_BATCH, OPT_PIPELINE, OPT_ICACHE, OPT_DCACHE, OPT_PREDICTOR, OPT_BREAK, OPT_WATCH, OPT_TRACE, OPT_COSIM, OPT_HARTS, OPT_STATS, OPT_FLAMEGRAPH, OPT_SAMPLE_INTERVAL };
+
+static struct option long_options[] = {
+    { "checkpoint-at", required_argument, NULL, OPT_CHECKPOINT_AT },
+    { "restore",       required_argument, NULL, OPT_RESTORE },
+    { "batch",         required_argument, NULL, OPT_BATCH },
+    { "pipeline",      optional_argument, NULL, OPT_PIPELINE },
+    { "icache",        required_argument, NULL, OPT_ICACHE },
+    { "dcache",        required_argument, NULL, OPT_DCACHE },
+    { "predictor",     required_argument, NULL, OPT_PREDICTOR },
+    { "break",         required_argument, NULL, OPT_BREAK },
+    { "watch",         required_argument, NULL, OPT_WATCH },
+    { "trace",         required_argument, NULL, OPT_TRACE },
+    { "cosim",         required_argument, NULL, OPT_COSIM },
+    { "harts",         required_argument, NULL, OPT_HARTS },
+    { "stats",         no_argument,       NULL, OPT_STATS },
+    { "flamegraph",    required_argument, NULL, OPT_FLAMEGRAPH },
+    { "sample-interval", required_argument, NULL, OPT_SAMPLE_INTERVAL },
+    { NULL, 0, NULL, 0 }
+};
+
 int main(int argc, char *argv[]) {
     int run_complete = FALSE;
+    int profile = FALSE;
+    int forwarding = -1;
+    char *icache_config = NULL;
+    char *dcache_config = NULL;
+    char *predictor_config = NULL;
+    char *trace_path = NULL;
+    char *flamegraph_path = NULL;
+    uquad sample_interval = 0;
+    uquad cosim_interval = 0;
+    int hart_count = 1;
+    int stats_requested = FALSE;
+    s_stats stats;
+    int analysis;
+    // locations of --break and --watch, resolved after the program is linked
+    char **breakpoints = calloc(argc, sizeof(char *));
+    char **watchpoints = calloc(argc, sizeof(char *));
+    int breakpoint_count = 0;
+    int watchpoint_count = 0;
+    uword address;
+    int i, pc;
+    char *restore_path = NULL;
+    char *batch_path = NULL;
+    int batch_threads = 0;
+    uquad checkpoint_at = 0;
+    char *checkpoint_path = NULL;
+    char *end;
+    s_sim_context *ctx;
     while (1) {
-        char c = getopt(argc, argv, ":hrs:");
+        // options end at the input file, so --checkpoint-at can take the file that follows it
+        int c = getopt_long(argc, argv, "+:hj::prs:t", long_options, NULL);
         if (c == -1) break;
         switch(c) {
             case 'h' : {
-                    cprintf("\n{BLU}RISC-V RV32I Simulator{NRM} v0.1");
+                    cprintf("\n{BLU}RISC-V RV32IM Simulator{NRM} v0.1");
                     cprintf("\n\nUsage: {BLU}%s{NRM} [options] {BLU}< asm_file{NRM}", basename(strdup(argv[0])));
+                    cprintf("\n   or: {BLU}%s{NRM} [options] {BLU}asm_or_elf_file{NRM}", basename(strdup(argv[0])));
+                    cprintf("\n   or: {BLU}%s{NRM} [options] {BLU}--batch list_file{NRM}", basename(strdup(argv[0])));
                     cprintf("\nIf started without options, simulator will run asm code");
-                    cprintf("\nstep by step. Possible options are:");
+                    cprintf("\nstep by step (n - run N steps, u - run until address/label,");
+                    cprintf("\nc - continue, p - step back, r - reverse continue, b - breakpoint,");
+                    cprintf("\nw - watchpoint). Possible options are:");
                     cprintf("\n{GRN}-h{NRM}     - this help");
                     cprintf("\n{GRN}-r{NRM}     - complete run of the program, only exit code (%%%d) output",FUNCTION_REGISTER);
                     cprintf("\n{GRN}-s NUM{NRM} - maximal number of execution steps for complete run");
-                    cprintf("\n         (simulator will return code %d if this number is reached)\n\n",STEP_ERROR);
+                    cprintf("\n         (simulator will return code %d if this number is reached)",STEP_ERROR);
+                    cprintf("\n{GRN}-t{NRM}     - use the pre-decoded threaded engine for complete run");
+                    cprintf("\n{GRN}-j{NRM}     - translate hot blocks to x86-64 code for complete run");
+                    cprintf("\n{GRN}-p{NRM}     - count executions of every instruction and print the hot spots at exit");
+                    cprintf("\n{GRN}--pipeline[=none|alu|full]{NRM} - count cycles of an in-order 5-stage pipeline with the given");
+                    cprintf("\n         forwarding (default: full) and print CPI and stall cycles at exit");
+                    cprintf("\n{GRN}--icache CONFIG{NRM}, {GRN}--dcache CONFIG{NRM} - simulate L1 instruction/data cache, CONFIG is");
+                    cprintf("\n         size[:line[:ways[:lru|fifo|random[:wb|wt]]]] and miss rates are printed at exit");
+                    cprintf("\n{GRN}--predictor CONFIG{NRM} - simulate a branch predictor and a return address stack, CONFIG is");
+                    cprintf("\n         btfn|bimodal|gshare|tournament[:bits] and misprediction rates are printed at exit");
+                    cprintf("\n{GRN}--flamegraph FILE{NRM} - sample the call stack (followed through jal and ret), write the");
+                    cprintf("\n         folded stacks to FILE and print inclusive and self samples per function at exit");
+                    cprintf("\n{GRN}--sample-interval NUM{NRM} - instructions between call stack samples (default: %d)", FLAMEGRAPH_INTERVAL);
+                    cprintf("\n{GRN}--break LOCATION{NRM} - stop before the instruction at a label, text address or :line");
+                    cprintf("\n         (interactive mode runs to the first stop, -r reports every stop and goes on)");
+                    cprintf("\n{GRN}--watch LOCATION{NRM} - stop after a store to a global, data address or offset(sp|fp)");
+                    cprintf("\n{GRN}--trace FILE{NRM} - write a binary trace of executed instructions, register writes");
+                    cprintf("\n         and memory accesses to FILE (see trace-tool)");
+                    cprintf("\n{GRN}--cosim NUM{NRM} - run the program also in the reference interpreter and compare");
+                    cprintf("\n         registers and memory with the selected engine every NUM steps (needs -r),");
+                    cprintf("\n         a difference ends the run with code %d", COSIM_ERROR);
+                    cprintf("\n{GRN}--harts NUM{NRM} - run NUM harts on host threads with shared memory, each hart");
+                    cprintf("\n         reads its number from mhartid (needs -r, at most %d harts)", MAX_HARTS);
+                    cprintf("\n{GRN}--stats{NRM} - print executed instructions, load and run time, MIPS and peak RSS");
+                    cprintf("\n         at exit (needs -r, used by bench/run.sh)");
+                    cprintf("\n{GRN}--checkpoint-at NUM FILE{NRM} - save simulator state to FILE after NUM steps");
+                    cprintf("\n{GRN}--restore FILE{NRM} - continue from a checkpoint instead of loading a program");
+                    cprintf("\n{GRN}--batch FILE{NRM} - complete run of every program listed in FILE (one path per line),");
+                    cprintf("\n         prints path, exit code and result for each of them");
+                    cprintf("\n{GRN}-jNUM{NRM}  - number of worker threads for --batch (default: number of CPUs)\n\n");
                     exit(0);
                     break; }
+            case 'p' : {
+                    profile = TRUE;
+                    break; }
             case 'r' : {
                     run_complete = TRUE;
                     break; }
             case 's' : {
                     max_steps = atoi(optarg);
                     break; }
+            case 't' : {
+                    use_threaded_engine = TRUE;
+                    break; }
+            case 'j' : {
+                    // -j alone selects the JIT, -jNUM sets the number of batch threads
+                    if (optarg == NULL) {
+                        use_jit = TRUE;
+                        break;
+                    }
+                    batch_threads = strtol(optarg, &end, 10);
+                    if (*end != 0 || batch_threads <= 0) {
+                        argerror("Invalid number of threads %s for -j", optarg);
+                    }
+                    break; }
+            case OPT_CHECKPOINT_AT : {
+                    checkpoint_at = strtoull(optarg, &end, 10);
+                    if (*optarg == 0 || *end != 0 || *optarg == '-') {
+                        argerror("Invalid step number %s for --checkpoint-at", optarg);
+                    }
+                    if (optind >= argc) {
+                        argerror("Checkpoint file missing for option --checkpoint-at");
+                    }
+                    checkpoint_path = argv[optind++];
+                    break; }
+            case OPT_RESTORE : {
+                    restore_path = optarg;
+                    break; }
+            case OPT_BATCH : {
+                    batch_path = optarg;
+                    break; }
+            case OPT_PIPELINE : {
+                    for (forwarding = FORWARD_FULL; optarg != NULL && forwarding >= 0; forwarding--) {
+                        if (strcmp(optarg, forwarding_names[forwarding]) == 0) break;
+                    }
+                    if (forwarding < 0) {
+                        argerror("Invalid forwarding %s for --pipeline", optarg);
+                    }
+                    break; }
+            case OPT_ICACHE : {
+                    icache_config = optarg;
+                    break; }
+            case OPT_DCACHE : {
+                    dcache_config = optarg;
+                    break; }
+            case OPT_PREDICTOR : {
+                    predictor_config = optarg;
+                    break; }
+            case OPT_BREAK : {
+                    breakpoints[breakpoint_count++] = optarg;
+                    break; }
+            case OPT_WATCH : {
+                    watchpoints[watchpoint_count++] = optarg;
+                    break; }
+            case OPT_TRACE : {
+                    trace_path = optarg;
+                    break; }
+            case OPT_HARTS : {
+                    hart_count = strtol(optarg, &end, 10);
+                    if (*optarg == 0 || *end != 0 || hart_count <= 0 || hart_count > MAX_HARTS) {
+                        argerror("Invalid number of harts %s for --harts (1 to %d)", optarg, MAX_HARTS);
+                    }
+                    break; }
+            case OPT_FLAMEGRAPH : {
+                    flamegraph_path = optarg;
+                    break; }
+            case OPT_SAMPLE_INTERVAL : {
+                    sample_interval = strtoull(optarg, &end, 10);
+                    if (*optarg == 0 || *end != 0 || *optarg == '-' || sample_interval == 0) {
+                        argerror("Invalid number of instructions %s for --sample-interval", optarg);
+                    }
+                    break; }
+            case OPT_STATS : {
+                    stats_requested = TRUE;
+                    break; }
+            case OPT_COSIM : {
+                    cosim_interval = strtoull(optarg, &end, 10);
+                    if (*optarg == 0 || *end != 0 || *optarg == '-' || cosim_interval == 0) {
+                        argerror("Invalid number of steps %s for --cosim", optarg);
+                    }
+                    break; }
             case '?' : {
+                    if (optopt == 0) {
+                        argerror("Unknown option %s",argv[optind-1]);
+                    }
                     argerror("Unknown option %c",optopt);
                     break; }
             case ':' : {
+                    if (optopt >= OPT_CHECKPOINT_AT) {
+                        argerror("Argument missing for option %s",argv[optind-1]);
+                    }
                     argerror("Argument missing for option %c",optopt);
                     break; }
             default : {
@@ -322,40 +650,160 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    //proveri da li postoji ulazni fajl
-    if (isatty(fileno(stdin))) {
-        argerror("No input file was specified.");
+    // options which observe the run and print a report at exit
+    analysis = profile || forwarding >= 0 || icache_config != NULL || dcache_config != NULL || predictor_config != NULL
+               || flamegraph_path != NULL;
+    if (sample_interval > 0 && flamegraph_path == NULL) {
+        argerror("--sample-interval can only be given together with --flamegraph");
+    }
+    if (batch_path != NULL) {
+        if (optind < argc || restore_path != NULL || checkpoint_path != NULL || analysis || breakpoint_count > 0 || watchpoint_count > 0
+                || trace_path != NULL || cosim_interval > 0 || hart_count > 1 || stats_requested) {
+            argerror("Input file, --restore, --checkpoint-at, --break, --watch, --trace, --cosim, --harts, --stats and the reporting options can't be used together with --batch");
+        }
+        return run_batch(batch_path, batch_threads);
+    }
+    if (batch_threads != 0) {
+        argerror("Number of threads can only be given together with --batch");
+    }
+    // the reference loads the program again, so it can't come from the standard input
+    if (cosim_interval > 0 && (!run_complete || (optind >= argc && restore_path == NULL) || checkpoint_path != NULL || analysis
+            || breakpoint_count > 0 || watchpoint_count > 0 || trace_path != NULL)) {
+        argerror("--cosim needs -r and an input file or --restore, and can't be used together with --checkpoint-at, --break, --watch, --trace and the reporting options");
+    }
+    if (hart_count > 1 && (!run_complete || restore_path != NULL || checkpoint_path != NULL || analysis || breakpoint_count > 0
+            || watchpoint_count > 0 || trace_path != NULL || cosim_interval > 0)) {
+        argerror("--harts needs -r, and can't be used together with --restore, --checkpoint-at, --break, --watch, --trace, --cosim and the reporting options");
     }
 
-    init_simulator();
-    yyparse();
+    if (stats_requested && !run_complete) {
+        argerror("--stats needs -r");
+    }
 
-    //preusmeravanje terminala na stdin
-    freopen("/dev/tty", "rw", stdin);
+    ctx = create_context();
+    current_context = ctx;
+    stats_load_start(&stats);
+    ctx->checkpoint_at = checkpoint_at;
+    ctx->checkpoint_path = checkpoint_path;
+    if (restore_path != NULL) {
+        if (optind < argc) {
+            argerror("Input file can't be used together with --restore");
+        }
+        load_checkpoint(ctx, restore_path);
+    } else if (optind < argc) {
+        load_program(ctx, argv[optind], !run_complete || analysis || breakpoint_count > 0);
+    } else {
+        //proveri da li postoji ulazni fajl
+        if (isatty(fileno(stdin))) {
+            argerror("No input file was specified.");
+        }
+        parse_program(ctx, stdin);
+        //preusmeravanje terminala na stdin
+        // (only here, so guest programs loaded from a file can read the original stdin)
+        freopen("/dev/tty", "rw", stdin);
+    }
 
-    if (error_count) {
+    if (ctx->error_count) {
         if (!run_complete)
-            cprintf("\n{RED}There were error(s) in ASM source.{NRM}", error_count);
+            cprintf("\n{RED}There were error(s) in ASM source.{NRM}", ctx->error_count);
         printf("\n");
         exit(PARSE_ERROR);
     } else {
+        link_program(ctx);
+        if (profile) {
+            profile_init(ctx);
+        }
+        if (flamegraph_path != NULL) {
+            flamegraph_init(ctx, flamegraph_path, sample_interval > 0 ? sample_interval : FLAMEGRAPH_INTERVAL);
+        }
+        if (forwarding >= 0) {
+            pipeline_init(ctx, forwarding);
+        }
+        if (icache_config != NULL) {
+            ctx->icache = cache_create(ctx, "instruction", icache_config);
+        }
+        if (dcache_config != NULL) {
+            ctx->dcache = cache_create(ctx, "data", dcache_config);
+        }
+        if (predictor_config != NULL) {
+            ctx->predictor = predictor_create(ctx, predictor_config);
+        }
+        for (i = 0; i < breakpoint_count; i++) {
+            if ((pc = breakpoint_location(ctx, breakpoints[i])) < 0) {
+                argerror("Invalid breakpoint %s (expected label, text address or :line)", breakpoints[i]);
+            }
+            set_breakpoint(ctx, pc, TRUE);
+        }
+        for (i = 0; i < watchpoint_count; i++) {
+            if (!watchpoint_location(ctx, watchpoints[i], &address)) {
+                argerror("Invalid watchpoint %s (expected global, data address or offset(sp|fp))", watchpoints[i]);
+            }
+            if (!set_watchpoint(ctx, address, TRUE)) {
+                argerror("There can be at most %d watchpoints", MAX_WATCHPOINTS);
+            }
+        }
+        if (trace_path != NULL) {
+            trace_open(ctx, trace_path);
+        }
+        if (cosim_interval > 0) {
+            cosim_init(ctx, restore_path == NULL ? argv[optind] : NULL, restore_path, cosim_interval);
+        }
+        if (hart_count > 1) {
+            harts_init(ctx, hart_count);
+        }
         if (run_complete) {
-            word ret_val = run_simulator();
-            if (max_steps != 0) {
+            word ret_val;
+            stats_run_start(&stats, ctx);
+            ret_val = ctx->harts != NULL ? run_harts(ctx) : ctx->cosim != NULL ? run_cosim(ctx) : run_simulator(ctx);
+            stats_run_end(&stats);
+            if (ctx->max_steps != 0) {
                 printf("%d", ret_val);
             } else
                 cprintf("\n{RED}Program terminated.{NRM}");
         } else {
-            run_interactive();
+            // with breakpoints or watchpoints the program runs with the selected engine until the first stop
+            if (ctx->debug != NULL) {
+                run_budget(ctx, UNLIMITED_STEPS);
+            }
+            run_interactive(ctx);
+        }
+        trace_close(ctx);
+        if (ctx->profile != NULL) {
+            // the report goes to stderr, so that -r still prints only the exit code
+            print_profile(ctx, stderr);
+        }
+        if (ctx->flamegraph != NULL) {
+            print_flamegraph(ctx, stderr);
+        }
+        if (ctx->pipeline != NULL) {
+            print_pipeline(ctx, stderr);
+        }
+        if (ctx->icache != NULL) {
+            print_cache(ctx, ctx->icache, stderr);
+        }
+        if (ctx->dcache != NULL) {
+            print_cache(ctx, ctx->dcache, stderr);
+        }
+        if (ctx->predictor != NULL) {
+            print_predictor(ctx, stderr);
+        }
+        if (ctx->cosim != NULL) {
+            print_cosim(ctx, stderr);
+        }
+        if (ctx->harts != NULL) {
+            print_harts(ctx, stderr);
+        }
+        if (stats_requested) {
+            print_stats(ctx, &stats, stderr);
         }
     }
     printf("\n");
-    if (error_count)
+    if (ctx->error_count)
         return PARSE_ERROR;
-    else if (max_steps != 0)
+    else if (ctx->max_steps != 0)
         return NO_ERROR;
     else
         //izvršeno max_steps koraka, a program se nije završio
         return STEP_ERROR;
     return 0;
-}
\ No newline at end of file
+}
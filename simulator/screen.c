@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "screen.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+// markup names and their colors, index + 1 is kept in the attribute nibbles
+static char *color_names[] = { "BLU", "GRN", "CYN", "RED" };
+static int color_codes[] = { 4, 2, 6, 1 };
+#define COLOR_NUMBER 4
+
+void terminal_size(int *rows, int *cols) {
+    struct winsize size;
+    *rows = SCREEN_DEFAULT_ROWS;
+    *cols = SCREEN_DEFAULT_COLS;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+        *rows = size.ws_row;
+        *cols = size.ws_col;
+    }
+}
+
+void allocate_cells(s_screen *screen, int rows, int cols) {
+    size_t cells = (size_t) rows * cols;
+    free(screen->chars);
+    free(screen->attrs);
+    free(screen->shown_chars);
+    free(screen->shown_attrs);
+    screen->rows = rows;
+    screen->cols = cols;
+    screen->chars = malloc(cells);
+    screen->attrs = malloc(cells);
+    screen->shown_chars = malloc(cells);
+    screen->shown_attrs = malloc(cells);
+    if (screen->chars == NULL || screen->attrs == NULL || screen->shown_chars == NULL || screen->shown_attrs == NULL) {
+        simerror("screen: out of memory");
+    }
+    screen->clear = TRUE;
+}
+
+s_screen *screen_create() {
+    s_screen *screen = calloc(1, sizeof(s_screen));
+    int rows, cols;
+    if (screen == NULL) {
+        simerror("screen_create: out of memory");
+    }
+    terminal_size(&rows, &cols);
+    allocate_cells(screen, rows, cols);
+    return screen;
+}
+
+void screen_begin(s_screen *screen) {
+    int rows, cols;
+    terminal_size(&rows, &cols);
+    if (rows != screen->rows || cols != screen->cols) {
+        allocate_cells(screen, rows, cols);
+    }
+    memset(screen->chars, ' ', (size_t) screen->rows * screen->cols);
+    memset(screen->attrs, 0, (size_t) screen->rows * screen->cols);
+    screen->row = 0;
+    screen->col = 0;
+    screen->attr = 0;
+}
+
+// returns the color index + 1 of the markup at s ({RED}, [BLU], ...), 0 for NRM and -1 if it isn't markup
+int markup_color(const char *s, char close) {
+    int i;
+    if (s[1] == 0 || s[2] == 0 || s[3] == 0 || s[4] != close) {
+        return -1;
+    }
+    if (strncmp(s + 1, "NRM", 3) == 0) {
+        return 0;
+    }
+    for (i = 0; i < COLOR_NUMBER; i++) {
+        if (strncmp(s + 1, color_names[i], 3) == 0) return i + 1;
+    }
+    return -1;
+}
+
+void put_cell(s_screen *screen, char c) {
+    if (screen->row < screen->rows && screen->col < screen->cols) {
+        size_t cell = (size_t) screen->row * screen->cols + screen->col;
+        screen->chars[cell] = c;
+        screen->attrs[cell] = screen->attr;
+    }
+    screen->col++;
+}
+
+void screen_printf(s_screen *screen, const char *format, ...) {
+    char text[SCREEN_FORMAT_LENGTH];
+    const char *c;
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(text, SCREEN_FORMAT_LENGTH, format, ap);
+    va_end(ap);
+    for (c = text; *c; c++) {
+        int color;
+        if ((*c == '{' || *c == '[') && (color = markup_color(c, *c == '{' ? '}' : ']')) >= 0) {
+            // like the escape sequences of cprintf(), a color changes one side and NRM resets both
+            if (color == 0) screen->attr = 0;
+            else if (*c == '{') screen->attr = (screen->attr & 0xf0) | color;
+            else screen->attr = (screen->attr & 0x0f) | (color << 4);
+            c += 4;
+        } else if (*c == '\n') {
+            screen->row++;
+            screen->col = 0;
+        } else if (*c == '\t') {
+            do put_cell(screen, ' '); while (screen->col % SCREEN_TAB_WIDTH != 0);
+        } else {
+            put_cell(screen, *c);
+        }
+    }
+}
+
+void screen_line(s_screen *screen, int row) {
+    screen->row = row;
+    screen->col = 0;
+    if (row >= 0 && row < screen->rows) {
+        memset(screen->chars + (size_t) row * screen->cols, ' ', screen->cols);
+        memset(screen->attrs + (size_t) row * screen->cols, 0, screen->cols);
+    }
+}
+
+void screen_write(s_screen *screen, const char *s, size_t length) {
+    if (screen->out_length + length > screen->out_capacity) {
+        size_t capacity = screen->out_capacity > 0 ? screen->out_capacity : 4096;
+        while (screen->out_length + length > capacity) capacity *= 2;
+        screen->out = realloc(screen->out, capacity);
+        if (screen->out == NULL) {
+            simerror("screen_write: out of memory");
+        }
+        screen->out_capacity = capacity;
+    }
+    memcpy(screen->out + screen->out_length, s, length);
+    screen->out_length += length;
+}
+
+void write_attr(s_screen *screen, uchar attr) {
+    char sequence[16];
+    int length;
+    if (attr == 0) {
+        screen_write(screen, "\033[0m", 4);
+        return;
+    }
+    length = snprintf(sequence, sizeof(sequence), "\033[0;1");
+    if (attr & 0x0f) length += snprintf(sequence + length, sizeof(sequence) - length, ";3%d", color_codes[(attr & 0x0f) - 1]);
+    if (attr >> 4) length += snprintf(sequence + length, sizeof(sequence) - length, ";4%d", color_codes[(attr >> 4) - 1]);
+    screen_write(screen, sequence, length);
+    screen_write(screen, "m", 1);
+}
+
+void write_move(s_screen *screen, int row, int col) {
+    char sequence[32];
+    int length = snprintf(sequence, sizeof(sequence), "\033[%d;%dH", row + 1, col + 1);
+    screen_write(screen, sequence, length);
+}
+
+void screen_flush(s_screen *screen) {
+    int row, col;
+    int cursor_row = -1, cursor_col = -1;
+    uchar attr = 0;
+    screen->out_length = 0;
+    screen_write(screen, "\033[0m", 4);
+    if (screen->clear) {
+        screen_write(screen, "\033[H\033[2J", 7);
+        memset(screen->shown_chars, ' ', (size_t) screen->rows * screen->cols);
+        memset(screen->shown_attrs, 0, (size_t) screen->rows * screen->cols);
+        screen->clear = FALSE;
+    }
+    for (row = 0; row < screen->rows; row++) {
+        for (col = 0; col < screen->cols; col++) {
+            size_t cell = (size_t) row * screen->cols + col;
+            if (screen->chars[cell] == screen->shown_chars[cell] && screen->attrs[cell] == screen->shown_attrs[cell]) {
+                continue;
+            }
+            if (row != cursor_row || col != cursor_col) write_move(screen, row, col);
+            if (screen->attrs[cell] != attr) write_attr(screen, screen->attrs[cell]);
+            screen_write(screen, &screen->chars[cell], 1);
+            screen->shown_chars[cell] = screen->chars[cell];
+            screen->shown_attrs[cell] = screen->attrs[cell];
+            attr = screen->attrs[cell];
+            cursor_row = row;
+            cursor_col = col + 1;
+        }
+    }
+    if (attr != 0) screen_write(screen, "\033[0m", 4);
+    write_move(screen, screen->row < screen->rows ? screen->row : screen->rows - 1,
+               screen->col < screen->cols ? screen->col : screen->cols - 1);
+    fwrite(screen->out, 1, screen->out_length, stdout);
+    fflush(stdout);
+}
+
+void screen_free(s_screen *screen) {
+    if (screen == NULL) {
+        return;
+    }
+    printf("\033[0m");
+    fflush(stdout);
+    free(screen->chars);
+    free(screen->attrs);
+    free(screen->shown_chars);
+    free(screen->shown_attrs);
+    free(screen->out);
+    free(screen);
+}
@@ -0,0 +1,61 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include "defs.h"
+
+/*
+Frame buffer for the interactive mode. A frame is written with screen_printf(), which understands
+the color markup of cprintf() ({BLU}, [RED], {NRM}, ...), and screen_flush() sends to the terminal
+only the cells which differ from the previous frame, positioned with ANSI cursor addressing.
+Everything below the last terminal row is cut off.
+*/
+
+#define SCREEN_DEFAULT_ROWS      24
+#define SCREEN_DEFAULT_COLS      80
+#define SCREEN_TAB_WIDTH         8
+// longest text of one screen_printf() call, the rest is cut off
+#define SCREEN_FORMAT_LENGTH     1024
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _screen {
+    int rows;
+    int cols;
+    int row;                // write position in the frame
+    int col;
+    uchar attr;             // foreground color in the low and background color in the high nibble
+    char *chars;            // frame being written
+    uchar *attrs;
+    char *shown_chars;      // what the terminal shows
+    uchar *shown_attrs;
+    int clear;              // the terminal is cleared on the next flush
+    char *out;              // escape sequences of one flush, written at once
+    size_t out_length;
+    size_t out_capacity;
+} s_screen;
+
+/*******************
+* Functions
+*******************/
+
+// creates a screen of the size of the terminal
+s_screen *screen_create();
+
+// starts a new empty frame (and follows the terminal if it was resized)
+void screen_begin(s_screen *screen);
+
+// writes formatted text with color markup at the write position
+void screen_printf(s_screen *screen, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// moves the write position to the start of the row and blanks the row
+void screen_line(s_screen *screen, int row);
+
+// updates the changed cells on the terminal and leaves the cursor at the write position
+void screen_flush(s_screen *screen);
+
+// resets colors and releases the screen, the cursor stays at the write position
+void screen_free(s_screen *screen);
+
+#endif
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+#include "harts.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+// seconds since the start of the phase, which is restarted
+double lap(s_stats *stats) {
+    struct timespec now;
+    double seconds;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = (now.tv_sec - stats->start.tv_sec) + (now.tv_nsec - stats->start.tv_nsec) / 1e9;
+    stats->start = now;
+    return seconds;
+}
+
+void stats_load_start(s_stats *stats) {
+    clock_gettime(CLOCK_MONOTONIC, &stats->start);
+}
+
+void stats_run_start(s_stats *stats, s_sim_context *ctx) {
+    stats->load_seconds = lap(stats);
+    stats->first_step = ctx->step_count;
+}
+
+void stats_run_end(s_stats *stats) {
+    stats->run_seconds = lap(stats);
+}
+
+void print_stats(s_sim_context *ctx, s_stats *stats, FILE *out) {
+    struct rusage usage;
+    uquad instructions = ctx->step_count - stats->first_step;
+    int i;
+    if (ctx->harts != NULL) {
+        for (i = 1; i < ctx->harts->count; i++) {
+            instructions += ctx->harts->contexts[i]->step_count;
+        }
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "\n### Statistics ###\n");
+    fprintf(out, "Instructions:  %llu\n", (unsigned long long) instructions);
+    fprintf(out, "Load time:     %.6f s\n", stats->load_seconds);
+    fprintf(out, "Run time:      %.6f s\n", stats->run_seconds);
+    fprintf(out, "Throughput:    %.2f MIPS\n", stats->run_seconds > 0 ? instructions / stats->run_seconds / 1e6 : 0.0);
+    // ru_maxrss is in kilobytes on Linux
+    fprintf(out, "Peak RSS:      %ld KiB\n", usage.ru_maxrss);
+}
@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <time.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*
+Run statistics (--stats), the measurements behind bench/run.sh. Load time covers reading,
+parsing or decoding and linking the program (or restoring the checkpoint), run time covers
+only the complete run, so the throughput in MIPS is the one of the selected engine. With
+--harts the instructions of all harts are counted. Peak RSS is the high-water mark of the
+whole process as reported by getrusage().
+*/
+
+/*******************
+* Structures
+*******************/
+
+typedef struct _stats {
+    struct timespec start;      // of the phase being measured
+    double load_seconds;
+    double run_seconds;
+    uquad first_step;           // step_count before the run (not 0 after --restore)
+} s_stats;
+
+/*******************
+* Functions
+*******************/
+
+// starts measuring the load of the program
+void stats_load_start(s_stats *stats);
+
+// ends the load and starts measuring the run of the program in the context
+void stats_run_start(s_stats *stats, s_sim_context *ctx);
+
+// ends the run
+void stats_run_end(s_stats *stats);
+
+// prints instructions, load and run time, MIPS and peak RSS in lines of "name: value unit"
+void print_stats(s_sim_context *ctx, s_stats *stats, FILE *out);
+
+#endif
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "threaded_engine.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+#include "debugger.h"
+#include "trace.h"
+#include "defs.h"
+
+// handler indexes, branches are split by sign type
+enum { TH_JAL, TH_RET, TH_J, TH_BGE, TH_BGEU, TH_BLE, TH_BLEU, TH_BGT, TH_BGTU, TH_BLT, TH_BLTU,
+       TH_BEQ, TH_BNE, TH_ADD, TH_ADDI, TH_SUB, TH_MV, TH_LW, TH_SW, TH_LI,
+       TH_SLLI, TH_SRLI, TH_SRAI, TH_MUL, TH_MULDIV, TH_NOP, TH_ECALL, TH_CSRR, TH_TRAP, TH_BREAK, TH_NUMBER };
+
+int valid_reg_operand(const s_operand *op) {
+    return op->register_index < RV32I_REG_NUM;
+}
+
+// returns linked jump target, or -1 if it is outside of the program
+int resolve_target(s_sim_context *ctx, const s_operand *op) {
+    if (op->operand_type != OP_TEXT_INDEX || op->data < 0 || op->data >= ctx->program_image.text_length) {
+        return -1;
+    }
+    return op->data;
+}
+
+int branch_handler(const s_instruction *ins) {
+    int is_signed = ins->sign_type == SIGNED_TYPE;
+    switch (ins->instruction_type) {
+        case INS_BGE: return is_signed ? TH_BGE : TH_BGEU;
+        case INS_BLE: return is_signed ? TH_BLE : TH_BLEU;
+        case INS_BGT: return is_signed ? TH_BGT : TH_BGTU;
+        case INS_BLT: return is_signed ? TH_BLT : TH_BLTU;
+        case INS_BEQ: return TH_BEQ;
+        default:      return TH_BNE;
+    }
+}
+
+// decodes one instruction, everything that would fail in step() becomes a trap
+int translate_instruction(s_sim_context *ctx, const s_instruction *ins, s_threaded_ins *th) {
+    th->rd = th->rs1 = th->rs2 = NULL;
+    th->data = 0;
+    switch (ins->instruction_type) {
+        case INS_JAL:
+        case INS_J:
+            th->data = resolve_target(ctx, &ins->destination);
+            if (th->data < 0) return TH_TRAP;
+            th->rd = &ctx->processor.regs[RETURN_ADDRESS_REG];
+            return ins->instruction_type == INS_JAL ? TH_JAL : TH_J;
+        case INS_RET:
+            th->rs1 = &ctx->processor.regs[RETURN_ADDRESS_REG];
+            return TH_RET;
+        case INS_BGE:
+        case INS_BLE:
+        case INS_BGT:
+        case INS_BLT:
+        case INS_BEQ:
+        case INS_BNE:
+            th->data = resolve_target(ctx, &ins->destination);
+            if (th->data < 0 || !valid_reg_operand(&ins->source1) || !valid_reg_operand(&ins->source2)) return TH_TRAP;
+            th->rs1 = &ctx->processor.regs[ins->source1.register_index];
+            th->rs2 = &ctx->processor.regs[ins->source2.register_index];
+            return branch_handler(ins);
+        case INS_ADD:
+        case INS_SUB:
+            if (!valid_reg_operand(&ins->destination) || !valid_reg_operand(&ins->source1) || !valid_reg_operand(&ins->source2)) return TH_TRAP;
+            th->rd = &ctx->processor.regs[ins->destination.register_index];
+            th->rs1 = &ctx->processor.regs[ins->source1.register_index];
+            th->rs2 = &ctx->processor.regs[ins->source2.register_index];
+            return ins->instruction_type == INS_ADD ? TH_ADD : TH_SUB;
+        case INS_ADDI:
+        case INS_MV:
+            if (!valid_reg_operand(&ins->destination) || !valid_reg_operand(&ins->source1)) return TH_TRAP;
+            th->rd = &ctx->processor.regs[ins->destination.register_index];
+            th->rs1 = &ctx->processor.regs[ins->source1.register_index];
+            th->data = ins->source2.data;
+            return ins->instruction_type == INS_ADDI ? TH_ADDI : TH_MV;
+        case INS_LW:
+            if (!valid_reg_operand(&ins->destination) || !valid_reg_operand(&ins->source1)) return TH_TRAP;
+            th->rd = &ctx->processor.regs[ins->destination.register_index];
+            th->rs1 = &ctx->processor.regs[ins->source1.register_index];
+            th->data = ins->source1.data;
+            return TH_LW;
+        case INS_SW:
+            if (!valid_reg_operand(&ins->destination) || !valid_reg_operand(&ins->source1)) return TH_TRAP;
+            th->rs1 = &ctx->processor.regs[ins->destination.register_index];
+            th->rs2 = &ctx->processor.regs[ins->source1.register_index];
+            th->data = ins->destination.data;
+            return TH_SW;
+        case INS_SLLI:
+        case INS_SRLI:
+        case INS_SRAI:
+            if (!valid_reg_operand(&ins->destination) || !valid_reg_operand(&ins->source1)) return TH_TRAP;
+            th->rd = &ctx->processor.regs[ins->destination.register_index];
+            th->rs1 = &ctx->processor.regs[ins->source1.register_index];
+            th->data = ins->source2.data;
+            return ins->instruction_type == INS_SLLI ? TH_SLLI : ins->instruction_type == INS_SRLI ? TH_SRLI : TH_SRAI;
+        case INS_MUL:
+        case INS_MULH:
+        case INS_MULHSU:
+        case INS_MULHU:
+        case INS_DIV:
+        case INS_DIVU:
+        case INS_REM:
+        case INS_REMU:
+            if (!valid_reg_operand(&ins->destination) || !valid_reg_operand(&ins->source1) || !valid_reg_operand(&ins->source2)) return TH_TRAP;
+            th->rd = &ctx->processor.regs[ins->destination.register_index];
+            th->rs1 = &ctx->processor.regs[ins->source1.register_index];
+            th->rs2 = &ctx->processor.regs[ins->source2.register_index];
+            // everything except mul goes through muldiv(), data is the instruction type
+            th->data = ins->instruction_type;
+            return ins->instruction_type == INS_MUL ? TH_MUL : TH_MULDIV;
+        case INS_LI:
+            if (!valid_reg_operand(&ins->destination)) return TH_TRAP;
+            th->rd = &ctx->processor.regs[ins->destination.register_index];
+            th->data = ins->source1.data;
+            return TH_LI;
+        case INS_NOP:
+            return TH_NOP;
+        case INS_ECALL:
+            return TH_ECALL;
+        case INS_CSRR:
+            return TH_CSRR;
+        default:
+            return TH_TRAP;
+    }
+}
+
+void translate_text(s_sim_context *ctx, void **handlers) {
+    int i;
+    int length = ctx->program_image.text_length;
+    ctx->threaded_text = malloc((length + 1) * sizeof(s_threaded_ins));
+    if (ctx->threaded_text == NULL) {
+        simerror("threaded_translate: out of memory");
+    }
+    for (i = 0; i < length; i++) {
+        ctx->threaded_text[i].handler = handlers[translate_instruction(ctx, &ctx->program_image.text[i], &ctx->threaded_text[i])];
+        // breakpoints are patched over the instructions, which stay translated for the resume
+        if (breakpoint_at(ctx, i)) ctx->threaded_text[i].handler = handlers[TH_BREAK];
+    }
+    // falling off the end of the program is reported by step()
+    ctx->threaded_text[length].handler = handlers[TH_TRAP];
+}
+
+void threaded_translate(s_sim_context *ctx) {
+    threaded_run(ctx, 0);
+}
+
+// straight-line code inside of a block needs no bookkeeping
+#define NEXT() { ip++; goto *ip->handler; }
+
+// block terminators leave through block_enter, which charges the next block
+#define JUMP(next) { target = (next); goto block_enter; }
+
+// the record of an instruction is written when the next one starts, or when the run leaves
+#define FLUSH() {\
+    if (traced >= 0) trace_retire(ctx, traced);\
+    traced = -1;\
+}
+
+#define LEAVE(executed) { FLUSH(); return (executed); }
+
+// entry of the traced variant of a handler, which falls through to the handler
+#define TRACED(handler)\
+tr_##handler:\
+    if (traced >= 0) trace_record(ctx, ctx->trace, traced);\
+    traced = ip - text;\
+    trace_fetch_at(ctx, ctx->trace, traced);\
+th_##handler
+
+#define THREADED_BRANCH(type, compare) {\
+    if ((type) *ip->rs1 compare (type) *ip->rs2) {\
+        JUMP(ip->data);\
+    }\
+    JUMP(ip - text + 1);\
+}\
+
+uquad threaded_run(s_sim_context *ctx, uquad budget) {
+    static void *handlers[TH_NUMBER] = {
+        &&th_jal, &&th_ret, &&th_j, &&th_bge, &&th_bgeu, &&th_ble, &&th_bleu, &&th_bgt, &&th_bgtu,
+        &&th_blt, &&th_bltu, &&th_beq, &&th_bne, &&th_add, &&th_addi, &&th_sub, &&th_mv,
+        &&th_lw, &&th_sw, &&th_li,
+        &&th_slli, &&th_srli, &&th_srai, &&th_mul, &&th_muldiv, &&th_nop, &&th_ecall, &&th_csrr, &&th_trap, &&th_break
+    };
+    // a trace writes the record of every instruction from the traced variants of the handlers,
+    // a breakpoint executes nothing
+    static void *traced_handlers[TH_NUMBER] = {
+        &&tr_jal, &&tr_ret, &&tr_j, &&tr_bge, &&tr_bgeu, &&tr_ble, &&tr_bleu, &&tr_bgt, &&tr_bgtu,
+        &&tr_blt, &&tr_bltu, &&tr_beq, &&tr_bne, &&tr_add, &&tr_addi, &&tr_sub, &&tr_mv,
+        &&tr_lw, &&tr_sw, &&tr_li,
+        &&tr_slli, &&tr_srli, &&tr_srai, &&tr_mul, &&tr_muldiv, &&tr_nop, &&tr_ecall, &&tr_csrr, &&tr_trap, &&th_break
+    };
+    uquad requested = budget;
+    s_threaded_ins *text;
+    s_threaded_ins *ip;
+    int traced = -1;                    // executed instruction whose record isn't written yet
+    word target;
+    uword address;
+
+    if (ctx->threaded_text == NULL) {
+        translate_text(ctx, ctx->trace != NULL ? traced_handlers : handlers);
+    }
+    text = ctx->threaded_text;
+    if (budget == 0) {
+        return 0;
+    }
+    target = ctx->processor.pc;
+
+block_enter:
+    // the only run time pc check, needed for ret
+    if ((uword) target >= (uword) ctx->program_image.text_length) {
+        FLUSH();
+        ctx->processor.pc = target;
+        if (ctx->trace != NULL) observed_step(ctx); else step(ctx);
+    }
+    // the whole block is charged at once, if the budget runs out inside of it step() takes over
+    if (budget < (uquad) ctx->program_image.block_length[target]) {
+        FLUSH();
+        ctx->processor.pc = target;
+        while (budget > 0 && !ctx->processor.done && !breakpoint_at(ctx, ctx->processor.pc)) {
+            ctx->run_executed = requested - budget;
+            if (ctx->trace != NULL) observed_step(ctx); else step(ctx);
+            budget--;
+            if (ctx->memory.watch_hit) break;
+        }
+        return requested - budget;
+    }
+    budget -= ctx->program_image.block_length[target];
+    ip = text + target;
+    goto *ip->handler;
+
+TRACED(jal):
+    *ip->rd = ip - text + 1;
+    JUMP(ip->data);
+TRACED(ret):
+    JUMP(*ip->rs1);
+TRACED(j):
+    JUMP(ip->data);
+TRACED(bge):  THREADED_BRANCH(word, >=);
+TRACED(bgeu): THREADED_BRANCH(uword, >=);
+TRACED(ble):  THREADED_BRANCH(word, <=);
+TRACED(bleu): THREADED_BRANCH(uword, <=);
+TRACED(bgt):  THREADED_BRANCH(word, >);
+TRACED(bgtu): THREADED_BRANCH(uword, >);
+TRACED(blt):  THREADED_BRANCH(word, <);
+TRACED(bltu): THREADED_BRANCH(uword, <);
+TRACED(beq):  THREADED_BRANCH(uword, ==);
+TRACED(bne):  THREADED_BRANCH(uword, !=);
+TRACED(add):
+    *ip->rd = (uword) *ip->rs1 + *ip->rs2;
+    NEXT();
+TRACED(addi):
+    *ip->rd = (uword) *ip->rs1 + ip->data;
+    NEXT();
+TRACED(sub):
+    *ip->rd = (uword) *ip->rs1 - *ip->rs2;
+    NEXT();
+TRACED(mv):
+    *ip->rd = *ip->rs1;
+    NEXT();
+TRACED(lw):
+    address = (uword) *ip->rs1 + ip->data;
+    if (address % 4 != 0) goto th_trap;
+    *ip->rd = *memory_word(&ctx->memory, address);
+    NEXT();
+TRACED(sw):
+    address = (uword) *ip->rs1 + ip->data;
+    if (address % 4 != 0) goto th_trap;
+    if ((address & ~PAGE_OFFSET_MASK) != ctx->memory.last_base) goto th_sw_page;
+    ctx->memory.last_page[(address & PAGE_OFFSET_MASK) >> 2] = *ip->rs2;
+    NEXT();
+th_sw_page:
+    // watched pages are never cached, the run stops after a store to a watched word
+    *memory_store_word(&ctx->memory, address) = *ip->rs2;
+    if (ctx->memory.watch_hit) {
+        ctx->processor.pc = ip - text + 1;
+        LEAVE(requested - budget - (ctx->program_image.block_length[ip - text] - 1));
+    }
+    NEXT();
+TRACED(li):
+    *ip->rd = ip->data;
+    NEXT();
+TRACED(slli):
+    *ip->rd = (uword) *ip->rs1 << ip->data;
+    NEXT();
+TRACED(srli):
+    *ip->rd = (uword) *ip->rs1 >> ip->data;
+    NEXT();
+TRACED(srai):
+    *ip->rd = *ip->rs1 >> ip->data;
+    NEXT();
+TRACED(mul):
+    *ip->rd = (uword) *ip->rs1 * (uword) *ip->rs2;
+    NEXT();
+TRACED(muldiv):
+    *ip->rd = muldiv(ip->data, *ip->rs1, *ip->rs2);
+    NEXT();
+TRACED(nop):
+    ctx->processor.done = TRUE;
+    ctx->processor.pc = ip - text + 1;
+    LEAVE(requested - budget);
+TRACED(ecall):
+    // exit stops the program like nop, read can store to a watched word, everything else goes on with the next block
+    ctx->processor.pc = ip - text;
+    step(ctx);
+    if (ctx->processor.done || ctx->memory.watch_hit) {
+        LEAVE(requested - budget);
+    }
+    JUMP(ctx->processor.pc);
+TRACED(csrr):
+    // the counters see the instructions before it, the block was charged up to and including the csrr
+    ctx->run_executed = requested - budget - 1;
+    ctx->processor.pc = ip - text;
+    step(ctx);
+    JUMP(ctx->processor.pc);
+TRACED(trap):
+    // anything that was not validated at load time is left to step(), which reports the error
+    ctx->processor.pc = ip - text;
+    step(ctx);
+    // sc.w and the amo instructions store like sw
+    if (ctx->memory.watch_hit) {
+        LEAVE(requested - budget - (ctx->program_image.block_length[ip - text] - 1));
+    }
+    ip = text + ctx->processor.pc;
+    goto *ip->handler;
+th_break:
+    // the rest of the block, from the breakpoint on, is given back
+    ctx->processor.pc = ip - text;
+    LEAVE(requested - budget - ctx->program_image.block_length[ip - text]);
+}
+
+
+void threaded_free(s_sim_context *ctx) {
+    free(ctx->threaded_text);
+    ctx->threaded_text = NULL;
+}
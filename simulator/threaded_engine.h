@@ -0,0 +1,33 @@
+#ifndef THREADED_ENGINE_H
+#define THREADED_ENGINE_H
+
+#include "defs.h"
+#include "riscv_simulator.h"
+
+/*******************
+* Structures
+*******************/
+
+// pre-decoded instruction, operands are resolved to host pointers at load time
+typedef struct _threaded_ins {
+    void *handler;
+    word *rd;
+    word *rs1;
+    word *rs2;
+    word data;
+} s_threaded_ins;
+
+/*******************
+* Functions
+*******************/
+
+// translates section text into the handler stream (done once, before the first run)
+void threaded_translate(s_sim_context *ctx);
+
+// runs at most budget instructions (or until nop), returns number of executed instructions
+uquad threaded_run(s_sim_context *ctx, uquad budget);
+
+// releases the handler stream of the context
+void threaded_free(s_sim_context *ctx);
+
+#endif
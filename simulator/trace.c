@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+#include "threaded_engine.h"
+#include "riscv_simulator.h"
+#include "defs.h"
+
+void *trace_writer(void *argument) {
+    s_trace *trace = argument;
+    pthread_mutex_lock(&trace->mutex);
+    while (TRUE) {
+        while (trace->pending < 0 && !trace->finished) {
+            pthread_cond_wait(&trace->changed, &trace->mutex);
+        }
+        if (trace->pending < 0) {
+            break;
+        }
+        // the simulation goes on in the other buffer meanwhile
+        pthread_mutex_unlock(&trace->mutex);
+        size_t written = fwrite(trace->buffers[trace->pending], 1, trace->pending_length, trace->file);
+        pthread_mutex_lock(&trace->mutex);
+        if (written != trace->pending_length) {
+            trace->failed = TRUE;
+        }
+        trace->pending = -1;
+        pthread_cond_broadcast(&trace->changed);
+    }
+    pthread_mutex_unlock(&trace->mutex);
+    return NULL;
+}
+
+// returns register which the record of the instruction carries, 0 if there is none
+int traced_register(const s_instruction *ins) {
+    switch (ins->instruction_type) {
+        case INS_JAL:
+            return RETURN_ADDRESS_REG;
+        case INS_SW:
+            // a store carries the register it stores, everything else the one it writes
+            return ins->source1.register_index < RV32I_REG_NUM ? ins->source1.register_index : 0;
+        case INS_ADD: case INS_ADDI: case INS_SUB: case INS_MV: case INS_LW: case INS_LI:
+        case INS_SLLI: case INS_SRLI: case INS_SRAI:
+        case INS_MUL: case INS_MULH: case INS_MULHSU: case INS_MULHU:
+        case INS_DIV: case INS_DIVU: case INS_REM: case INS_REMU:
+            return ins->destination.register_index < RV32I_REG_NUM ? ins->destination.register_index : 0;
+        case INS_ECALL:
+            return FUNCTION_REGISTER;
+        case INS_LR: case INS_SC: case INS_CSRR:
+        case INS_AMOSWAP: case INS_AMOADD: case INS_AMOXOR: case INS_AMOAND: case INS_AMOOR:
+        case INS_AMOMIN: case INS_AMOMAX: case INS_AMOMINU: case INS_AMOMAXU:
+            return ins->destination.register_index < RV32I_REG_NUM ? ins->destination.register_index : 0;
+        default:
+            return 0;
+    }
+}
+
+// fills the memory access of the instruction, invalid registers are left to step()
+void traced_access(const s_instruction *ins, s_traced *traced) {
+    traced->access = 0;
+    if (ins->instruction_type == INS_LW && ins->source1.register_index < RV32I_REG_NUM) {
+        traced->access = TRACE_LOAD;
+        traced->base = ins->source1.register_index;
+        traced->offset = ins->source1.data;
+    } else if (ins->instruction_type == INS_SW && ins->destination.register_index < RV32I_REG_NUM) {
+        traced->access = TRACE_STORE;
+        traced->base = ins->destination.register_index;
+        traced->offset = ins->destination.data;
+    } else if (is_atomic(ins->instruction_type) && ins->source1.register_index < RV32I_REG_NUM) {
+        // lr.w loads, sc.w may store, the amo instructions do both
+        traced->access = ins->instruction_type == INS_LR ? TRACE_LOAD
+                         : ins->instruction_type == INS_SC ? TRACED_SC : TRACE_LOAD | TRACE_STORE;
+        traced->base = ins->source1.register_index;
+        traced->offset = 0;
+    }
+}
+
+void trace_open(s_sim_context *ctx, const char *path) {
+    s_trace *trace = calloc(1, sizeof(s_trace));
+    uword text_start = TEXT_SEGMENT_START;
+    word pc = ctx->processor.pc;
+    int i;
+    if (trace == NULL || (trace->buffers[0] = malloc(TRACE_BUFFER_SIZE)) == NULL
+            || (trace->buffers[1] = malloc(TRACE_BUFFER_SIZE)) == NULL) {
+        simerror("trace_open: out of memory");
+    }
+    trace->traced = calloc(ctx->program_image.text_length + 1, sizeof(s_traced));
+    if (trace->traced == NULL) {
+        simerror("trace_open: out of memory");
+    }
+    for (i = 0; i < ctx->program_image.text_length; i++) {
+        trace->traced[i].reg = traced_register(&ctx->program_image.text[i]);
+        traced_access(&ctx->program_image.text[i], &trace->traced[i]);
+    }
+    trace->path = path;
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) {
+        argerror("Can't open trace file %s", path);
+    }
+    if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LENGTH, trace->file) != TRACE_MAGIC_LENGTH
+            || fwrite(&text_start, sizeof(text_start), 1, trace->file) != 1
+            || fwrite(&pc, sizeof(pc), 1, trace->file) != 1
+            || fwrite(&ctx->step_count, sizeof(ctx->step_count), 1, trace->file) != 1) {
+        simerror("trace: can't write %s", path);
+    }
+    trace->end = trace->buffers[0];
+    trace->full = trace->end + TRACE_BUFFER_SIZE - TRACE_MAX_RECORD;
+    trace->pending = -1;
+    trace->last_pc = pc - 1;
+    pthread_mutex_init(&trace->mutex, NULL);
+    pthread_cond_init(&trace->changed, NULL);
+    if (pthread_create(&trace->writer, NULL, trace_writer, trace) != 0) {
+        simerror("trace_open: can't start the writer thread");
+    }
+    ctx->trace = trace;
+    // the threaded engine is translated again with the traced variants of its handlers
+    threaded_free(ctx);
+}
+
+void trace_swap(s_trace *trace) {
+    pthread_mutex_lock(&trace->mutex);
+    while (trace->pending >= 0) {
+        pthread_cond_wait(&trace->changed, &trace->mutex);
+    }
+    trace->pending = trace->current;
+    trace->pending_length = trace->end - trace->buffers[trace->current];
+    pthread_cond_broadcast(&trace->changed);
+    pthread_mutex_unlock(&trace->mutex);
+    trace->current ^= 1;
+    trace->end = trace->buffers[trace->current];
+    trace->full = trace->end + TRACE_BUFFER_SIZE - TRACE_MAX_RECORD;
+}
+
+void trace_fetch(s_sim_context *ctx) {
+    int pc = ctx->processor.pc;
+    ctx->trace->reg = 0;
+    ctx->trace->access = 0;
+    // invalid pc is reported by step()
+    if (pc >= 0 && pc < ctx->program_image.text_length) {
+        trace_fetch_at(ctx, ctx->trace, pc);
+    }
+}
+
+void trace_retire(s_sim_context *ctx, int pc) {
+    trace_record(ctx, ctx->trace, pc);
+}
+
+void trace_block(s_sim_context *ctx, int length) {
+    s_trace *trace = ctx->trace;
+    int pc = ctx->processor.pc;
+    uchar *p;
+    int i;
+    // invalid pc is reported by step()
+    if (pc < 0 || pc >= ctx->program_image.text_length) {
+        step(ctx);
+        return;
+    }
+    p = trace->end;
+    // only the last instruction of a block can jump, the others are at pc + 1
+    for (i = 0; i < length; i++, pc++) {
+        trace_fetch_at(ctx, trace, pc);
+        step(ctx);
+        p = trace_put_record(ctx, trace, pc, p);
+        if (p > trace->full) {
+            trace->end = p;
+            trace_swap(trace);
+            p = trace->end;
+        }
+    }
+    trace->end = p;
+}
+
+void trace_close(s_sim_context *ctx) {
+    s_trace *trace = ctx->trace;
+    int failed;
+    if (trace == NULL) {
+        return;
+    }
+    // errors below must not come back here
+    ctx->trace = NULL;
+    threaded_free(ctx);
+    if (trace->end > trace->buffers[trace->current]) {
+        trace_swap(trace);
+    }
+    pthread_mutex_lock(&trace->mutex);
+    trace->finished = TRUE;
+    pthread_cond_broadcast(&trace->changed);
+    pthread_mutex_unlock(&trace->mutex);
+    pthread_join(trace->writer, NULL);
+    failed = trace->failed || fclose(trace->file) != 0;
+    pthread_mutex_destroy(&trace->mutex);
+    pthread_cond_destroy(&trace->changed);
+    free(trace->buffers[0]);
+    free(trace->buffers[1]);
+    free(trace->traced);
+    if (failed) {
+        simerror("trace: can't write %s", trace->path);
+    }
+    free(trace);
+}
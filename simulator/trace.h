@@ -0,0 +1,192 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "defs.h"
+#include "riscv_simulator.h"
+#include "memory.h"
+
+/*
+Binary execution trace (--trace), one record per executed instruction:
+    header: magic, text segment start, text index of the first instruction, step count at the start
+    record: flags byte with a register in its low bits, then the fields its flags announce
+        TRACE_JUMP   pc - (previous pc + 1)
+        register     value - previous traced value of the register, which the instruction wrote
+        TRACE_LOAD   address - previous memory address
+        TRACE_STORE  address - previous memory address, then the register holds the stored value
+lr.w is a load and a successful sc.w a store like sw (a failed one has no address). The amo
+instructions have both flags with a single address, their register is the one they wrote.
+Numbers are zigzag encoded varints (LEB128), traced register values start at 0, so a store of a
+register which was written before costs a single byte. The simulation fills one buffer while a
+writer thread writes the other one to the file.
+*/
+
+#define TRACE_MAGIC              "RVSIMTR1"
+#define TRACE_MAGIC_LENGTH       8
+#define TRACE_BUFFER_SIZE        (1 << 20)
+// flags byte and three varints of at most 5 bytes, each written as 8 bytes
+#define TRACE_MAX_RECORD         24
+
+#define TRACE_REG_MASK           0x1f
+#define TRACE_JUMP               0x20
+#define TRACE_LOAD               0x40
+#define TRACE_STORE              0x80
+// sc.w stores only if it succeeds, never written to the file
+#define TRACED_SC                0x01
+
+/*******************
+* Structures
+*******************/
+
+// what the record of the instruction at a text index carries, computed when the trace is opened
+typedef struct _traced {
+    uchar reg;                  // register in the record, 0 for none
+    uchar access;               // TRACE_LOAD, TRACE_STORE, both for amo, TRACED_SC for sc.w
+    uchar base;                 // register with the memory address
+    word offset;                // added to it
+} s_traced;
+
+typedef struct _trace {
+    FILE *file;
+    const char *path;
+    uchar *buffers[2];
+    int current;                // buffer which the simulation fills
+    uchar *end;                 // of the records in it
+    uchar *full;                // a record after this may not fit
+    int pending;                // buffer handed to the writer, -1 if there is none
+    size_t pending_length;
+    int finished;
+    int failed;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    // encoder state, mirrored by the readers
+    int last_pc;
+    uword last_address;
+    word registers[RV32I_REG_NUM];
+    s_traced *traced;           // per text index
+    // record of the current instruction, taken before it executes
+    uchar reg;
+    uchar access;               // TRACE_LOAD and TRACE_STORE flags
+    uword address;
+} s_trace;
+
+/*******************
+* Functions
+*******************/
+
+// opens the trace file and starts the writer thread (called after link_program)
+void trace_open(s_sim_context *ctx, const char *path);
+
+// remembers the memory address of the instruction at pc (called before step())
+void trace_fetch(s_sim_context *ctx);
+
+// appends the record of the instruction at pc, which step() has just executed
+void trace_retire(s_sim_context *ctx, int pc);
+
+// executes a basic block of length instructions with step() and appends their records, for runs
+// which only trace while the debugger is active (the others trace from the threaded engine)
+void trace_block(s_sim_context *ctx, int length);
+
+// hands the filled buffer to the writer and goes on with the other one
+void trace_swap(s_trace *trace);
+
+// writes the rest of the trace and closes the file
+void trace_close(s_sim_context *ctx);
+
+// returns the zigzag encoded value
+static inline uword zigzag_encode(word value) {
+    return ((uword) value << 1) ^ (uword) (value >> 31);
+}
+
+static inline word zigzag_decode(uword value) {
+    return (word) ((value >> 1) ^ (0u - (value & 1)));
+}
+
+// the groups of 7 bits are spread over 8 bytes which are written at once, without a branch
+// per group
+static inline uchar *trace_put_long_varint(uchar *p, uword value) {
+    // by the number of leading zeros, the continuation bits of the groups before the last one
+    // and the length
+    static const uquad continued[32] = {
+        0x80808080ull, 0x80808080ull, 0x80808080ull, 0x80808080ull, 0x808080ull, 0x808080ull, 0x808080ull,
+        0x808080ull, 0x808080ull, 0x808080ull, 0x808080ull, 0x8080ull, 0x8080ull, 0x8080ull, 0x8080ull,
+        0x8080ull, 0x8080ull, 0x8080ull, 0x80ull, 0x80ull, 0x80ull, 0x80ull, 0x80ull, 0x80ull, 0x80ull,
+        0, 0, 0, 0, 0, 0, 0
+    };
+    static const uchar lengths[32] = {
+        5, 5, 5, 5, 4, 4, 4, 4, 4, 4, 4, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1
+    };
+    int zeros = __builtin_clz(value | 1);
+    uquad groups = (value & 0x7f) | (uquad) (value & 0x3f80) << 1 | (uquad) (value & 0x1fc000) << 2
+                   | (uquad) (value & 0xfe00000) << 3 | (uquad) (value & 0xf0000000) << 4;
+    groups |= continued[zeros];
+    memcpy(p, &groups, sizeof(groups));
+    return p + lengths[zeros];
+}
+
+// most deltas fit in a single byte
+static inline uchar *trace_put_varint(uchar *p, uword value) {
+    if (value < 0x80) {
+        *p = value;
+        return p + 1;
+    }
+    return trace_put_long_varint(p, value);
+}
+
+// remembers the register and the memory address of the instruction at the text index before it executes
+static inline void trace_fetch_at(s_sim_context *ctx, s_trace *trace, int pc) {
+    const s_traced *traced = &trace->traced[pc];
+    trace->reg = traced->reg;
+    trace->access = traced->access;
+    if (traced->access == 0) {
+        return;
+    }
+    trace->address = (uword) ctx->processor.regs[traced->base] + traced->offset;
+    if (traced->access == TRACED_SC) {
+        // the same test as step(), a trace has only one hart
+        trace->access = 0;
+        if (ctx->reserved && ctx->reservation_address == trace->address
+                && memory_peek(&ctx->memory, trace->address) == ctx->reservation_value) {
+            // a successful sc.w carries the register it stores like sw
+            trace->access = TRACE_STORE;
+            trace->reg = ctx->program_image.text[pc].source2.register_index;
+        }
+    }
+}
+
+// writes the record of the executed instruction at the text index to p, returns the end of the record
+static inline uchar *trace_put_record(s_sim_context *ctx, s_trace *trace, int pc, uchar *p) {
+    uchar *record = p++;
+    int reg = trace->reg;
+    uchar flags = reg;
+    if (pc != trace->last_pc + 1) {
+        flags |= TRACE_JUMP;
+        p = trace_put_varint(p, zigzag_encode(pc - (trace->last_pc + 1)));
+    }
+    if (reg != 0) {
+        word value = ctx->processor.regs[reg];
+        p = trace_put_varint(p, zigzag_encode((uword) value - (uword) trace->registers[reg]));
+        trace->registers[reg] = value;
+    }
+    if (trace->access) {
+        flags |= trace->access;
+        p = trace_put_varint(p, zigzag_encode(trace->address - trace->last_address));
+        trace->last_address = trace->address;
+    }
+    *record = flags;
+    trace->last_pc = pc;
+    return p;
+}
+
+// appends the record of the instruction at the text index, which has just executed
+static inline void trace_record(s_sim_context *ctx, s_trace *trace, int pc) {
+    trace->end = trace_put_record(ctx, trace, pc, trace->end);
+    if (trace->end > trace->full) {
+        trace_swap(trace);
+    }
+}
+
+#endif
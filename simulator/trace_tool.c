@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include "trace.h"
+#include "defs.h"
+
+/*
+Reads binary traces written by riscvsim --trace. The text command prints one line per
+instruction, the summary command counts the records and lists the hottest instructions.
+Both of them see only the records which pass all of the given filters.
+*/
+
+#define HOT_SPOTS                10
+
+typedef struct {
+    uquad first_step, last_step;
+    uword first_pc, last_pc;
+    uword first_address, last_address;
+    int memory;                 // only records with a memory access in the range pass
+    int reg;                    // only records which write this register pass, -1 for any
+} s_filter;
+
+typedef struct {
+    uquad step;
+    uword pc;                   // address of the instruction
+    uchar flags;
+    int rd;                     // register written by the instruction, or the stored one
+    word value;                 // of rd
+    uword address;
+} s_record;
+
+typedef struct {
+    uquad records, jumps, reg_writes;
+    uquad loads[3], stores[3];  // per segment: data, stack, other
+    uquad reg_counts[RV32I_REG_NUM];
+    uquad *pc_counts;           // per text index
+    int pc_length;
+} s_summary;
+
+static char *segment_names[] = { "data", "stack", "other" };
+
+void fail(const char *message, const char *argument) {
+    fprintf(stderr, "trace-tool: %s%s\n", message, argument);
+    exit(ARG_ERROR);
+}
+
+int read_varint(FILE *input, uword *value) {
+    int shift, c;
+    *value = 0;
+    for (shift = 0; shift < 35; shift += 7) {
+        if ((c = getc(input)) == EOF) return FALSE;
+        *value |= (uword) (c & 0x7f) << shift;
+        if (!(c & 0x80)) return TRUE;
+    }
+    return FALSE;
+}
+
+// parses FIRST[:LAST] into the range, a missing LAST is the same as FIRST
+void parse_range(const char *text, uquad *first, uquad *last, const char *option) {
+    char *end;
+    *first = strtoull(text, &end, 0);
+    *last = *first;
+    if (end == text) fail("invalid range for ", option);
+    if (*end == ':') {
+        const char *start = end + 1;
+        *last = strtoull(start, &end, 0);
+        if (end == start) fail("invalid range for ", option);
+    }
+    if (*end != 0 || *last < *first) fail("invalid range for ", option);
+}
+
+int parse_register(const char *name) {
+    char *end;
+    int i;
+    for (i = 0; i < RV32I_REG_NUM; i++) {
+        if (strcmp(name, abi_regs[i]) == 0) return i;
+    }
+    if (name[0] == 'x') {
+        i = strtol(name + 1, &end, 10);
+        if (name[1] != 0 && *end == 0 && i >= 0 && i < RV32I_REG_NUM) return i;
+    }
+    fail("invalid register ", name);
+    return -1;
+}
+
+int segment(uword address) {
+    if (address >= STACK_SEGMENT_START - 0x10000000u) return 1;
+    return address >= STATIC_DATA_START ? 0 : 2;
+}
+
+// a store carries the stored register, an amo (load and store) the one it wrote
+int writes(const s_record *record) {
+    return record->rd != 0 && (!(record->flags & TRACE_STORE) || (record->flags & TRACE_LOAD));
+}
+
+int passes(const s_filter *filter, const s_record *record) {
+    if (record->step < filter->first_step || record->step > filter->last_step) return FALSE;
+    if (record->pc < filter->first_pc || record->pc > filter->last_pc) return FALSE;
+    if (filter->reg >= 0 && (!writes(record) || record->rd != filter->reg)) return FALSE;
+    if (filter->memory && (!(record->flags & (TRACE_LOAD | TRACE_STORE))
+            || record->address < filter->first_address || record->address > filter->last_address)) return FALSE;
+    return TRUE;
+}
+
+void print_record(const s_record *record) {
+    printf("%10llu  %#07x", (unsigned long long) record->step, record->pc);
+    if (record->flags & TRACE_JUMP) printf("  <-");
+    if (writes(record)) printf("  %s = %d", abi_regs[record->rd], record->value);
+    if (record->flags & TRACE_LOAD) printf("  load %#010x", record->address);
+    if ((record->flags & (TRACE_LOAD | TRACE_STORE)) == TRACE_STORE) {
+        printf("  store %#010x = %d", record->address, record->value);
+    } else if (record->flags & TRACE_STORE) {
+        printf("  store %#010x", record->address);
+    }
+    printf("\n");
+}
+
+void count_record(s_summary *summary, const s_record *record, uword text_start) {
+    int pc = (record->pc - text_start) / 4;
+    summary->records++;
+    if (record->flags & TRACE_JUMP) summary->jumps++;
+    if (writes(record)) {
+        summary->reg_writes++;
+        summary->reg_counts[record->rd]++;
+    }
+    if (record->flags & TRACE_LOAD) summary->loads[segment(record->address)]++;
+    if (record->flags & TRACE_STORE) summary->stores[segment(record->address)]++;
+    if (pc < 0) return;
+    if (pc >= summary->pc_length) {
+        int length = summary->pc_length > 0 ? summary->pc_length : 1024;
+        while (length <= pc) length *= 2;
+        summary->pc_counts = realloc(summary->pc_counts, length * sizeof(uquad));
+        if (summary->pc_counts == NULL) fail("out of memory", "");
+        memset(summary->pc_counts + summary->pc_length, 0, (length - summary->pc_length) * sizeof(uquad));
+        summary->pc_length = length;
+    }
+    summary->pc_counts[pc]++;
+}
+
+void print_summary(s_summary *summary, uword text_start) {
+    int i, j, best;
+    printf("Instructions:    %llu\n", (unsigned long long) summary->records);
+    printf("Jumps taken:     %llu\n", (unsigned long long) summary->jumps);
+    printf("Register writes: %llu\n", (unsigned long long) summary->reg_writes);
+    for (i = 0; i < 3; i++) {
+        printf("Memory %-6s    %llu loads, %llu stores\n", segment_names[i],
+               (unsigned long long) summary->loads[i], (unsigned long long) summary->stores[i]);
+    }
+    printf("Most written registers:");
+    for (i = 0; i < 4; i++) {
+        for (best = -1, j = 1; j < RV32I_REG_NUM; j++) {
+            if (summary->reg_counts[j] > 0 && (best < 0 || summary->reg_counts[j] > summary->reg_counts[best])) best = j;
+        }
+        if (best < 0) break;
+        printf(" %s (%llu)", abi_regs[best], (unsigned long long) summary->reg_counts[best]);
+        summary->reg_counts[best] = 0;
+    }
+    printf("\nHottest instructions:\n");
+    for (i = 0; i < HOT_SPOTS; i++) {
+        for (best = -1, j = 0; j < summary->pc_length; j++) {
+            if (summary->pc_counts[j] > 0 && (best < 0 || summary->pc_counts[j] > summary->pc_counts[best])) best = j;
+        }
+        if (best < 0) break;
+        printf("  %#07x  %llu (%.1f%%)\n", text_start + 4*best, (unsigned long long) summary->pc_counts[best],
+               100.0 * summary->pc_counts[best] / summary->records);
+        summary->pc_counts[best] = 0;
+    }
+}
+
+void usage(const char *name) {
+    printf("Usage: %s [options] text|summary trace_file\n", name);
+    printf("Reads a trace written by riscvsim --trace. Options select the records:\n");
+    printf("-s FIRST[:LAST] - steps in the range\n");
+    printf("-p ADDR[:ADDR]  - instructions at text addresses in the range\n");
+    printf("-m ADDR[:ADDR]  - loads and stores of addresses in the range\n");
+    printf("-r REG          - writes to the register (abi name or xN)\n");
+}
+
+int main(int argc, char *argv[]) {
+    s_filter filter = { 0, ~0ull, 0, ~0u, 0, ~0u, FALSE, -1 };
+    s_summary summary;
+    s_record record;
+    char magic[TRACE_MAGIC_LENGTH];
+    word registers[RV32I_REG_NUM] = { 0 };
+    uword text_start, address = 0, value;
+    word first_pc;
+    uquad step, first, last;
+    int pc, summarize, c, truncated = FALSE;
+    FILE *input;
+    while ((c = getopt(argc, argv, "hs:p:m:r:")) != -1) {
+        switch (c) {
+            case 'h':
+                usage(basename(argv[0]));
+                return NO_ERROR;
+            case 's':
+                parse_range(optarg, &filter.first_step, &filter.last_step, "-s");
+                break;
+            case 'p':
+                parse_range(optarg, &first, &last, "-p");
+                filter.first_pc = first;
+                filter.last_pc = last;
+                break;
+            case 'm':
+                parse_range(optarg, &first, &last, "-m");
+                filter.first_address = first;
+                filter.last_address = last;
+                filter.memory = TRUE;
+                break;
+            case 'r':
+                filter.reg = parse_register(optarg);
+                break;
+            default:
+                usage(basename(argv[0]));
+                return ARG_ERROR;
+        }
+    }
+    if (optind + 2 != argc || (strcmp(argv[optind], "text") != 0 && strcmp(argv[optind], "summary") != 0)) {
+        usage(basename(argv[0]));
+        return ARG_ERROR;
+    }
+    summarize = strcmp(argv[optind], "summary") == 0;
+    if ((input = fopen(argv[optind + 1], "rb")) == NULL) {
+        fail("can't open ", argv[optind + 1]);
+    }
+    if (fread(magic, 1, TRACE_MAGIC_LENGTH, input) != TRACE_MAGIC_LENGTH || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LENGTH) != 0
+            || fread(&text_start, sizeof(text_start), 1, input) != 1 || fread(&first_pc, sizeof(first_pc), 1, input) != 1
+            || fread(&step, sizeof(step), 1, input) != 1) {
+        fail("not a trace file: ", argv[optind + 1]);
+    }
+    memset(&summary, 0, sizeof(summary));
+    pc = first_pc - 1;
+    // the records are deltas, so the ones which don't pass are decoded too
+    while (step < filter.last_step && (c = getc(input)) != EOF) {
+        truncated = TRUE;
+        record.flags = c & ~TRACE_REG_MASK;
+        record.rd = c & TRACE_REG_MASK;
+        record.step = ++step;
+        pc++;
+        if (record.flags & TRACE_JUMP) {
+            if (!read_varint(input, &value)) break;
+            pc += zigzag_decode(value);
+        }
+        record.pc = text_start + 4*pc;
+        if (record.rd != 0) {
+            if (!read_varint(input, &value)) break;
+            registers[record.rd] = (uword) registers[record.rd] + (uword) zigzag_decode(value);
+        }
+        // a store of zero has no register
+        record.value = registers[record.rd];
+        if (record.flags & (TRACE_LOAD | TRACE_STORE)) {
+            if (!read_varint(input, &value)) break;
+            address += zigzag_decode(value);
+            record.address = address;
+        }
+        truncated = FALSE;
+        if (!passes(&filter, &record)) continue;
+        if (summarize) count_record(&summary, &record, text_start);
+        else print_record(&record);
+    }
+    if (truncated) {
+        fprintf(stderr, "trace-tool: truncated record at step %llu\n", (unsigned long long) step);
+    }
+    if (summarize) {
+        print_summary(&summary, text_start);
+    }
+    fclose(input);
+    return NO_ERROR;
+}